@@ -0,0 +1,271 @@
+#include "hw02.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+
+namespace bench {
+
+/**
+ * seconds one call of the function takes, averaged over enough calls to take a while.
+ */
+double seconds_per_call(const std::function<void()>& call) {
+    size_t calls = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed{0};
+    while (elapsed.count() < 0.2) {
+        call();
+        calls += 1;
+        elapsed = std::chrono::steady_clock::now() - start;
+    }
+    return elapsed.count() / static_cast<double>(calls);
+}
+
+
+/**
+ * the largest k for which C(n, k) fits the result type, up to n / 2.
+ */
+template <typename result_t>
+uint64_t largest_k(uint64_t n) {
+    uint64_t k = 0;
+    try {
+        while (k < n / 2) {
+            combination<result_t>(n, k + 1);
+            k += 1;
+        }
+    }
+    catch (std::overflow_error&) {}
+    return k;
+}
+
+
+/**
+ * the fixed width versions, for the largest results that fit.
+ */
+template <typename result_t>
+void fixed_width(const char* name, uint64_t max_n) {
+    std::cout << name << std::endl;
+    for (uint64_t n = 100; n <= max_n; n *= 10) {
+        uint64_t k = largest_k<result_t>(n);
+        volatile result_t sink = 0;
+        double seconds = seconds_per_call([&] { sink = sink + combination<result_t>(n, k); });
+
+        std::cout << "  C(" << std::setw(7) << n << ", " << std::setw(2) << k << ") "
+                  << std::setw(10) << std::fixed << std::setprecision(1) << seconds * 1e9 << " ns" << std::endl;
+    }
+}
+
+
+/**
+ * arbitrary precision results, which grow with n.
+ */
+void big(uint64_t max_n) {
+    std::cout << "big_uint" << std::endl;
+    for (uint64_t n = 100; n <= max_n; n *= 10) {
+        big_uint combinations;
+        double combination_seconds = seconds_per_call([&] { combinations = combination<big_uint>(n, n / 2); });
+
+        big_uint permutations;
+        double permutation_seconds = seconds_per_call([&] { permutations = permutation<big_uint>(n, n / 100); });
+
+        std::cout << "  C(" << std::setw(7) << n << ", n/2) "
+                  << std::setw(10) << std::fixed << std::setprecision(3) << combination_seconds * 1e3 << " ms, "
+                  << std::setw(8) << combinations.bit_width() << " bits;"
+                  << "  P(" << std::setw(7) << n << ", n/100) "
+                  << std::setw(10) << permutation_seconds * 1e3 << " ms, "
+                  << std::setw(8) << permutations.bit_width() << " bits" << std::endl;
+    }
+}
+
+
+/**
+ * the factorial as it was computed before the tables.
+ */
+uint64_t recursive_factorial(uint64_t val) {
+    if (val == 0 || val == 1) {
+        return 1;
+    }
+    return val * recursive_factorial(val - 1);
+}
+
+
+/**
+ * table lookups against computing the results, for many small inputs.
+ */
+void tables() {
+    // the inputs vary, so the compiler can't compute the results beforehand
+    std::vector<uint64_t> ns;
+    std::vector<uint64_t> ks;
+    for (uint64_t i = 0; i < 10'000; i++) {
+        ns.push_back(i * 7 % detail::binomial_rows);
+        ks.push_back(i * 13 % (ns.back() + 1));
+    }
+
+    auto per_call = [&](const char* name, auto function) {
+        volatile uint64_t sink = 0;
+        double seconds = seconds_per_call([&] {
+            uint64_t sum = 0;
+            for (size_t i = 0; i < ns.size(); i++) {
+                sum += function(ns[i], ks[i]);
+            }
+            sink = sink + sum;
+        });
+        std::cout << "  " << std::left << std::setw(24) << name << std::right << std::setw(8)
+                  << std::fixed << std::setprecision(2) << seconds / static_cast<double>(ns.size()) * 1e9
+                  << " ns" << std::endl;
+    };
+
+    std::cout << "n < 64" << std::endl;
+    per_call("recursive factorial", [](uint64_t n, uint64_t) { return recursive_factorial(n % 21); });
+    per_call("factorial table", [](uint64_t n, uint64_t) { return factorial(n % 21); });
+    per_call("computed combination", [](uint64_t n, uint64_t k) { return combination<uint64_t>(n, k); });
+    per_call("combination table", [](uint64_t n, uint64_t k) { return combination(n, k); });
+}
+
+
+/**
+ * combinations mod p, one by one and in batches.
+ */
+void modular(uint64_t max_n) {
+    auto start = std::chrono::steady_clock::now();
+    modular_combinatorics tables{max_n};
+    std::chrono::duration<double> setup = std::chrono::steady_clock::now() - start;
+
+    std::cout << "mod " << tables.prime() << ", tables up to n = " << max_n << " in "
+              << std::fixed << std::setprecision(3) << setup.count() << " s" << std::endl;
+
+    std::vector<uint32_t> ns;
+    std::vector<uint32_t> ks;
+    for (uint64_t i = 0; i < 1'000'000; i++) {
+        ns.push_back(static_cast<uint32_t>(i * 2654435761 % (max_n + 1)));
+        ks.push_back(static_cast<uint32_t>(i * 40503 % (ns.back() + 1)));
+    }
+    std::vector<uint32_t> results(ns.size());
+
+    double single = seconds_per_call([&] {
+        for (size_t i = 0; i < ns.size(); i++) {
+            results[i] = tables.combination(ns[i], ks[i]);
+        }
+    });
+    double batch = seconds_per_call([&] { tables.combinations(ns, ks, results); });
+
+    auto per_query = [&](double seconds) { return seconds / static_cast<double>(ns.size()) * 1e9; };
+    std::cout << "  single queries  " << std::setw(8) << std::setprecision(2) << per_query(single) << " ns" << std::endl;
+    std::cout << "  batch queries   " << std::setw(8) << per_query(batch) << " ns" << std::endl;
+}
+
+/**
+ * items per second over a whole range, one by one, in batches and split
+ * between threads. the items are summed so they can't be skipped.
+ */
+template <typename range_t, typename value_t>
+void enumerate(const char* name, const range_t& range, size_t width) {
+    constexpr size_t batch_size = 4096;
+    auto items_per_second = [&](double seconds) { return static_cast<double>(range.size()) / seconds / 1e6; };
+
+    auto sum_item = [](auto item) {
+        if constexpr (std::is_integral_v<decltype(item)>) {
+            return uint64_t{item};
+        }
+        else {
+            uint64_t sum = 0;
+            for (auto value : item) {
+                sum += value;
+            }
+            return sum;
+        }
+    };
+
+    auto batched = [&](range_t part) {
+        enumeration_batch<value_t> batch{batch_size, width};
+        uint64_t sum = 0;
+        while (part.fill(batch)) {
+            for (value_t value : batch.values()) {
+                sum += value;
+            }
+        }
+        return sum;
+    };
+
+    volatile uint64_t sink = 0;
+    double single = seconds_per_call([&] {
+        range_t part = range;
+        uint64_t sum = 0;
+        for (auto item : part) {
+            sum += sum_item(item);
+        }
+        sink = sink + sum;
+    });
+    double batch = seconds_per_call([&] { sink = sink + batched(range); });
+
+    size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+    double parallel = seconds_per_call([&] {
+        std::vector<uint64_t> sums(threads);
+        {
+            std::vector<std::jthread> workers;
+            auto parts = range.split(threads);
+            for (size_t i = 0; i < parts.size(); i++) {
+                workers.emplace_back([&, i, part = parts[i]] { sums[i] = batched(part); });
+            }
+        }
+        for (uint64_t sum : sums) {
+            sink = sink + sum;
+        }
+    });
+
+    std::cout << "  " << std::left << std::setw(20) << name << std::right << std::setw(12) << range.size()
+              << " items " << std::fixed << std::setprecision(1)
+              << std::setw(8) << items_per_second(single) << " M/s one by one, "
+              << std::setw(8) << items_per_second(batch) << " M/s in batches, "
+              << std::setw(8) << items_per_second(parallel) << " M/s on " << threads << " threads" << std::endl;
+}
+
+
+/**
+ * enumeration throughput of the combination, subset and permutation ranges.
+ */
+void enumeration() {
+    std::cout << "enumeration" << std::endl;
+    enumerate<combination_range, uint32_t>("C(30, 8) indexes", combination_range{30, 8}, 8);
+    enumerate<subset_mask_range, uint64_t>("C(32, 8) masks", subset_mask_range{32, 8}, 1);
+    enumerate<permutation_range, uint32_t>("10! permutations", permutation_range{10}, 10);
+
+    // splitting needs to find the first item of each part
+    combination_range large{1'000'000, 3};
+    double split = seconds_per_call([&] { large.split(64); });
+    std::cout << "  split of C(10^6, 3) in 64 parts " << std::setw(8) << std::setprecision(2)
+              << split * 1e6 << " us" << std::endl;
+}
+
+} // namespace bench
+
+
+int main(int argc, char* argv[]) {
+    uint64_t max_n = 1'000'000;
+    if (argc > 1) {
+        max_n = std::strtoull(argv[1], nullptr, 10);
+    }
+
+    // past 20!, the factorial based version was wrong here
+    std::cout << "C(30, 15) = " << combination(30, 15) << std::endl;
+
+    bench::tables();
+    bench::fixed_width<uint64_t>("uint64_t", max_n);
+#ifdef __SIZEOF_INT128__
+    bench::fixed_width<uint128_t>("uint128_t", max_n);
+#endif
+    bench::big(max_n);
+    bench::modular(max_n * 10);
+    bench::enumeration();
+
+    return 0;
+}
@@ -0,0 +1,226 @@
+#include "big_uint.h"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+
+
+namespace {
+
+using limbs_t = std::vector<uint32_t>;
+
+// below this many limbs, schoolbook multiplication is faster than splitting
+constexpr size_t karatsuba_threshold = 32;
+
+
+void trim(limbs_t& limbs) {
+    while (not limbs.empty() and limbs.back() == 0) {
+        limbs.pop_back();
+    }
+}
+
+
+std::span<const uint32_t> trimmed(std::span<const uint32_t> limbs) {
+    while (not limbs.empty() and limbs.back() == 0) {
+        limbs = limbs.first(limbs.size() - 1);
+    }
+    return limbs;
+}
+
+
+/** add the value to the target, starting at the given limb. the target has to be large enough. */
+void add_at(std::span<uint32_t> target, std::span<const uint32_t> value, size_t offset) {
+    uint64_t carry = 0;
+    size_t i = 0;
+    for (; i < value.size(); i++) {
+        carry += uint64_t{target[offset + i]} + value[i];
+        target[offset + i] = static_cast<uint32_t>(carry);
+        carry >>= 32;
+    }
+    for (; carry != 0; i++) {
+        carry += target[offset + i];
+        target[offset + i] = static_cast<uint32_t>(carry);
+        carry >>= 32;
+    }
+}
+
+
+/** subtract the value from the target, which is at least as large */
+void subtract(limbs_t& target, std::span<const uint32_t> value) {
+    int64_t borrow = 0;
+    size_t i = 0;
+    for (; i < value.size(); i++) {
+        borrow += int64_t{target[i]} - value[i];
+        target[i] = static_cast<uint32_t>(borrow);
+        borrow >>= 32;
+    }
+    for (; borrow != 0; i++) {
+        borrow += target[i];
+        target[i] = static_cast<uint32_t>(borrow);
+        borrow >>= 32;
+    }
+}
+
+
+limbs_t sum(std::span<const uint32_t> left, std::span<const uint32_t> right) {
+    if (left.size() < right.size()) {
+        std::swap(left, right);
+    }
+    limbs_t result(left.begin(), left.end());
+    result.push_back(0);
+    add_at(result, right, 0);
+    trim(result);
+    return result;
+}
+
+
+limbs_t schoolbook(std::span<const uint32_t> left, std::span<const uint32_t> right) {
+    limbs_t result(left.size() + right.size());
+    for (size_t i = 0; i < left.size(); i++) {
+        uint64_t carry = 0;
+        for (size_t j = 0; j < right.size(); j++) {
+            carry += uint64_t{left[i]} * right[j] + result[i + j];
+            result[i + j] = static_cast<uint32_t>(carry);
+            carry >>= 32;
+        }
+        result[i + right.size()] = static_cast<uint32_t>(carry);
+    }
+    trim(result);
+    return result;
+}
+
+
+/**
+ * karatsuba multiplication: with both numbers split in halves at limb m,
+ * a * b = a1 b1 B^2m + ((a0 + a1)(b0 + b1) - a0 b0 - a1 b1) B^m + a0 b0,
+ * which takes three multiplications of half the size instead of four.
+ */
+limbs_t multiply(std::span<const uint32_t> left, std::span<const uint32_t> right) {
+    left = trimmed(left);
+    right = trimmed(right);
+    if (left.size() < right.size()) {
+        std::swap(left, right);
+    }
+    if (right.size() < karatsuba_threshold) {
+        return schoolbook(left, right);
+    }
+
+    size_t m = left.size() / 2;
+    limbs_t result(left.size() + right.size() + 1);
+
+    if (right.size() <= m) {
+        // too unbalanced to split both, multiply each half of the larger one
+        add_at(result, multiply(left.first(m), right), 0);
+        add_at(result, multiply(left.subspan(m), right), m);
+        trim(result);
+        return result;
+    }
+
+    auto left_low = left.first(m);
+    auto left_high = left.subspan(m);
+    auto right_low = right.first(m);
+    auto right_high = right.subspan(m);
+
+    limbs_t low = multiply(left_low, right_low);
+    limbs_t high = multiply(left_high, right_high);
+    limbs_t middle = multiply(sum(left_low, left_high), sum(right_low, right_high));
+    subtract(middle, low);
+    subtract(middle, high);
+    trim(middle);
+
+    add_at(result, low, 0);
+    add_at(result, middle, m);
+    add_at(result, high, 2 * m);
+    trim(result);
+    return result;
+}
+
+} // namespace
+
+
+big_uint::big_uint(uint64_t value) {
+    while (value != 0) {
+        limbs_.push_back(static_cast<uint32_t>(value));
+        value >>= 32;
+    }
+}
+
+
+uint32_t big_uint::divide(uint32_t divisor) {
+    if (divisor == 0) {
+        throw std::domain_error{"division by zero"};
+    }
+
+    uint64_t remainder = 0;
+    for (size_t i = limbs_.size(); i-- > 0;) {
+        uint64_t current = (remainder << 32) | limbs_[i];
+        limbs_[i] = static_cast<uint32_t>(current / divisor);
+        remainder = current % divisor;
+    }
+    trim(limbs_);
+    return static_cast<uint32_t>(remainder);
+}
+
+
+uint64_t big_uint::bit_width() const {
+    if (limbs_.empty()) {
+        return 0;
+    }
+    return (limbs_.size() - 1) * 32 + static_cast<uint64_t>(std::bit_width(limbs_.back()));
+}
+
+
+std::string big_uint::to_string() const {
+    if (limbs_.empty()) {
+        return "0";
+    }
+
+    // peel off 9 decimal digits at a time, least significant first
+    constexpr uint32_t chunk = 1'000'000'000;
+    big_uint rest = *this;
+    std::vector<uint32_t> chunks;
+    while (not rest.limbs_.empty()) {
+        chunks.push_back(rest.divide(chunk));
+    }
+
+    std::string text = std::to_string(chunks.back());
+    for (size_t i = chunks.size() - 1; i-- > 0;) {
+        std::string digits = std::to_string(chunks[i]);
+        text.append(9 - digits.size(), '0');
+        text += digits;
+    }
+    return text;
+}
+
+
+big_uint operator*(const big_uint& left, const big_uint& right) {
+    big_uint result;
+    result.limbs_ = multiply(left.limbs_, right.limbs_);
+    return result;
+}
+
+
+std::ostream& operator<<(std::ostream& out, const big_uint& value) {
+    return out << value.to_string();
+}
+
+
+big_uint product(std::span<const uint64_t> factors) {
+    if (factors.empty()) {
+        return 1;
+    }
+
+    std::vector<big_uint> level(factors.begin(), factors.end());
+    while (level.size() > 1) {
+        std::vector<big_uint> next;
+        next.reserve((level.size() + 1) / 2);
+        for (size_t i = 0; i + 1 < level.size(); i += 2) {
+            next.push_back(level[i] * level[i + 1]);
+        }
+        if (level.size() % 2 == 1) {
+            next.push_back(std::move(level.back()));
+        }
+        level = std::move(next);
+    }
+    return std::move(level.front());
+}
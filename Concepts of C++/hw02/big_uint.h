@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <string>
+#include <vector>
+
+
+/**
+ * unsigned integer of arbitrary size, for results beyond 128 bits.
+ *
+ * it only has what the combinatorics need: products, division by small
+ * numbers and decimal output. large products use karatsuba multiplication.
+ */
+class big_uint {
+public:
+    big_uint() = default;
+
+    big_uint(uint64_t value);
+
+    /**
+     * divide by the divisor, and return the remainder.
+     * @throw std::domain_error when dividing by zero.
+     */
+    uint32_t divide(uint32_t divisor);
+
+    /** number of bits needed to store the value, 0 for zero */
+    uint64_t bit_width() const;
+
+    /** the value in decimal */
+    std::string to_string() const;
+
+    /** 32 bit digits, least significant first, without leading zeros */
+    std::span<const uint32_t> limbs() const { return limbs_; }
+
+    friend big_uint operator*(const big_uint& left, const big_uint& right);
+
+    big_uint& operator*=(const big_uint& other) {
+        return *this = *this * other;
+    }
+
+    bool operator==(const big_uint& other) const = default;
+
+private:
+    std::vector<uint32_t> limbs_;
+};
+
+
+std::ostream& operator<<(std::ostream& out, const big_uint& value);
+
+
+/**
+ * product of all the factors, multiplied pairwise in a balanced tree
+ * so most multiplications are of numbers of similar size.
+ */
+big_uint product(std::span<const uint64_t> factors);
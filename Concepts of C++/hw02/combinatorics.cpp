@@ -1,29 +1,189 @@
 #include "combinatorics.h"
 
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
 
-uint64_t factorial(uint64_t val) {
-    // TODO
-    if (val == 0 || val == 1) {
-    	return 1;
-    } else {
-    	return val * factorial(val - 1);
+
+namespace {
+
+// up to here, big combinations are built from the primes below n
+constexpr uint64_t sieve_limit = uint64_t{1} << 26;
+
+
+template <typename result_t>
+constexpr result_t max_value = static_cast<result_t>(~result_t{0});
+
+
+template <typename result_t>
+[[noreturn]] void overflow(const char* function, uint64_t n, uint64_t k) {
+    throw std::overflow_error{std::string{function} + "(" + std::to_string(n) + ", " + std::to_string(k)
+                              + ") doesn't fit " + std::to_string(sizeof(result_t) * 8) + " bits"};
+}
+
+
+// euclid's algorithm, as std::gcd doesn't take 128 bit numbers in strict mode
+template <typename value_t>
+value_t gcd(value_t a, value_t b) {
+    while (b != 0) {
+        a = std::exchange(b, a % b);
+    }
+    return a;
+}
+
+
+/** factors packed into as few 64 bit words as possible, for multiplying them as big numbers */
+class factor_words {
+public:
+    void add(uint64_t factor) {
+        if (factor != 0 and word > max_value<uint64_t> / factor) {
+            words.push_back(word);
+            word = 1;
+        }
+        word *= factor;
+    }
+
+    big_uint product() {
+        words.push_back(std::exchange(word, 1));
+        return ::product(words);
+    }
+
+private:
+    std::vector<uint64_t> words;
+    uint64_t word = 1;
+};
+
+
+/** all primes up to the limit, by the sieve of eratosthenes */
+std::vector<uint64_t> primes_up_to(uint64_t limit) {
+    std::vector<bool> composite(limit + 1);
+    std::vector<uint64_t> primes;
+    for (uint64_t i = 2; i <= limit; i++) {
+        if (composite[i]) {
+            continue;
+        }
+        primes.push_back(i);
+        for (uint64_t multiple = i * i; multiple <= limit; multiple += i) {
+            composite[multiple] = true;
+        }
     }
+    return primes;
 }
 
 
-uint64_t permutation(uint64_t val, uint64_t val2) {
-    // TODO
-    if (val < val2) {
-    	return  0;
+/** exponent of the prime in n!, by legendre's formula */
+uint64_t factorial_exponent(uint64_t n, uint64_t prime) {
+    uint64_t exponent = 0;
+    while (n != 0) {
+        n /= prime;
+        exponent += n;
     }
-    return factorial(val) / factorial(val - val2);
+    return exponent;
 }
 
+} // namespace
+
+
+template <typename result_t>
+result_t permutation(uint64_t n, uint64_t k) {
+    if (n < k) {
+        return 0;
+    }
 
-uint64_t combination(uint64_t val, uint64_t val2) {
-    // TODO
-    if (val < val2) {
-    	return 0;
+    result_t result = 1;
+    for (uint64_t factor = n - k + 1; factor <= n and factor != 0; factor++) {
+        if (result > max_value<result_t> / factor) {
+            overflow<result_t>("permutation", n, k);
+        }
+        result *= factor;
     }
-    return factorial(val) / (factorial(val2) * factorial(val - val2));
+    return result;
 }
+
+
+template <typename result_t>
+result_t combination(uint64_t n, uint64_t k) {
+    if (n < k) {
+        return 0;
+    }
+    // C(n, k) = C(n, n - k), the fewer steps the better
+    k = std::min(k, n - k);
+
+    // C(n - k + i, i) = C(n - k + i - 1, i - 1) (n - k + i) / i
+    // dividing the previous result and the factor by their gcd first
+    // means neither step overflows if the result doesn't.
+    result_t result = 1;
+    for (uint64_t i = 1; i <= k; i++) {
+        result_t factor = n - k + i;
+        result_t common = gcd<result_t>(result, i);
+        result /= common;
+        factor /= i / common;
+
+        if (result > max_value<result_t> / factor) {
+            overflow<result_t>("combination", n, k);
+        }
+        result *= factor;
+    }
+    return result;
+}
+
+
+template <>
+big_uint permutation<big_uint>(uint64_t n, uint64_t k) {
+    if (n < k) {
+        return 0;
+    }
+
+    factor_words factors;
+    for (uint64_t factor = n - k + 1; factor <= n and factor != 0; factor++) {
+        factors.add(factor);
+    }
+    return factors.product();
+}
+
+
+template <>
+big_uint combination<big_uint>(uint64_t n, uint64_t k) {
+    if (n < k) {
+        return 0;
+    }
+    k = std::min(k, n - k);
+
+    if (n > sieve_limit or k < 16) {
+        // too many primes to find: step through C(n - k + i, i) like for fixed widths
+        if (k > max_value<uint32_t>) {
+            throw std::overflow_error{"combination(" + std::to_string(n) + ", " + std::to_string(k)
+                                      + ") is too large to compute"};
+        }
+        big_uint result = 1;
+        for (uint64_t i = 1; i <= k; i++) {
+            result *= n - k + i;
+            result.divide(static_cast<uint32_t>(i));
+        }
+        return result;
+    }
+
+    // each prime occurs as often in C(n, k) as in n!, less than in k! and (n - k)!
+    factor_words factors;
+    for (uint64_t prime : primes_up_to(n)) {
+        uint64_t exponent = factorial_exponent(n, prime) - factorial_exponent(k, prime)
+                            - factorial_exponent(n - k, prime);
+        for (uint64_t i = 0; i < exponent; i++) {
+            factors.add(prime);
+        }
+    }
+    return factors.product();
+}
+
+
+template uint64_t permutation<uint64_t>(uint64_t n, uint64_t k);
+template uint64_t combination<uint64_t>(uint64_t n, uint64_t k);
+
+#ifdef __SIZEOF_INT128__
+template uint128_t permutation<uint128_t>(uint64_t n, uint64_t k);
+template uint128_t combination<uint128_t>(uint64_t n, uint64_t k);
+#endif
+
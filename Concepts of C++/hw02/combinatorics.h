@@ -1,21 +1,142 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
 #include <cstdint>
 
+#include "big_uint.h"
+
+
+#ifdef __SIZEOF_INT128__
+/**
+ * 128 bit unsigned integer, for results that don't fit 64 bits.
+ */
+__extension__ typedef unsigned __int128 uint128_t;
+#endif
+
+
+namespace detail {
+
+/**
+ * pascal's triangle for n < 64, the largest n for which all C(n, k) fit 64 bits.
+ * entries with k > n are 0.
+ */
+inline constexpr size_t binomial_rows = 64;
+
+consteval std::array<std::array<uint64_t, binomial_rows>, binomial_rows> pascal_triangle() {
+    std::array<std::array<uint64_t, binomial_rows>, binomial_rows> rows{};
+    for (size_t n = 0; n < binomial_rows; n++) {
+        rows[n][0] = 1;
+        for (size_t k = 1; k <= n; k++) {
+            rows[n][k] = rows[n - 1][k - 1] + rows[n - 1][k];
+        }
+    }
+    return rows;
+}
+
+inline constexpr auto binomials = pascal_triangle();
+
+
+/**
+ * n! for all n where it fits 64 bits.
+ */
+inline constexpr size_t factorial_count = 21;
+
+consteval std::array<uint64_t, factorial_count> factorial_table() {
+    std::array<uint64_t, factorial_count> table{1};
+    for (size_t n = 1; n < factorial_count; n++) {
+        table[n] = table[n - 1] * n;
+    }
+    return table;
+}
+
+inline constexpr auto factorials = factorial_table();
+
+} // namespace detail
+
 
 /**
  * Compute the factorial.
+ * @throw std::overflow_error if it doesn't fit 64 bits, past 20!
  */
-uint64_t factorial(uint64_t val);
+constexpr uint64_t factorial(uint64_t val);
 
 /**
  * Return the number of ways to choose k items from n items
  * without repetition and with order.
+ * @throw std::overflow_error if the result doesn't fit 64 bits.
  */
-uint64_t permutation(uint64_t val, uint64_t val2);
+constexpr uint64_t permutation(uint64_t val, uint64_t val2);
 
 /**
  * Return the number of ways to choose k items from n items
  * without repetition and without order.
+ * for n < 64, this is a lookup in a table built at compile time.
+ * @throw std::overflow_error if the result doesn't fit 64 bits.
  */
-uint64_t combination(uint64_t val, uint64_t val2);
+constexpr uint64_t combination(uint64_t val, uint64_t val2);
+
+
+/**
+ * permutations of k from n items, as `uint64_t`, `uint128_t` or `big_uint`.
+ *
+ * computed as the product n (n - 1) ... (n - k + 1), without factorials,
+ * so no intermediate value is larger than the result.
+ * for `big_uint`, the factors are multiplied in a balanced product tree.
+ *
+ * @throw std::overflow_error if the result doesn't fit the type.
+ */
+template <typename result_t>
+result_t permutation(uint64_t n, uint64_t k);
+
+/**
+ * combinations of k from n items, as `uint64_t`, `uint128_t` or `big_uint`.
+ *
+ * the fixed width versions compute C(n - k + i, i) for i = 1 ... k,
+ * reducing each step by the gcd, so no intermediate value is larger than
+ * the result. `big_uint` multiplies the prime factors of the result,
+ * whose exponents follow from legendre's formula.
+ *
+ * @throw std::overflow_error if the result doesn't fit the type.
+ */
+template <typename result_t>
+result_t combination(uint64_t n, uint64_t k);
+
+
+template <> big_uint permutation<big_uint>(uint64_t n, uint64_t k);
+template <> big_uint combination<big_uint>(uint64_t n, uint64_t k);
+
+extern template uint64_t permutation<uint64_t>(uint64_t n, uint64_t k);
+extern template uint64_t combination<uint64_t>(uint64_t n, uint64_t k);
+
+#ifdef __SIZEOF_INT128__
+extern template uint128_t permutation<uint128_t>(uint64_t n, uint64_t k);
+extern template uint128_t combination<uint128_t>(uint64_t n, uint64_t k);
+#endif
+
+
+// the table lookups are inline, so calls for small inputs are just a load.
+// everything else goes to the runtime versions.
+
+constexpr uint64_t factorial(uint64_t val) {
+    if (val < detail::factorial_count) {
+        return detail::factorials[val];
+    }
+    return permutation<uint64_t>(val, val);
+}
+
+
+constexpr uint64_t permutation(uint64_t val, uint64_t val2) {
+    if (val < detail::factorial_count) {
+        return val2 <= val ? detail::factorials[val] / detail::factorials[val - val2] : 0;
+    }
+    return permutation<uint64_t>(val, val2);
+}
+
+
+constexpr uint64_t combination(uint64_t val, uint64_t val2) {
+    if (val < detail::binomial_rows) {
+        return val2 < detail::binomial_rows ? detail::binomials[val][val2] : 0;
+    }
+    return combination<uint64_t>(val, val2);
+}
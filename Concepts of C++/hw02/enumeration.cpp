@@ -0,0 +1,443 @@
+#include "enumeration.h"
+
+#include "combinatorics.h"
+
+#include <algorithm>
+#include <bit>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+
+namespace {
+
+void check_ranks(uint64_t first, uint64_t last, uint64_t count) {
+    if (first > last or last > count) {
+        throw std::out_of_range{"ranks " + std::to_string(first) + " ... " + std::to_string(last)
+                                + " are beyond the count of " + std::to_string(count)};
+    }
+}
+
+
+void check_width(size_t width, size_t expected) {
+    if (width != expected) {
+        throw std::invalid_argument{"batch of width " + std::to_string(width)
+                                    + " for items of width " + std::to_string(expected)};
+    }
+}
+
+
+/** first and last rank of up to `parts` non-empty shares of the ranks, as even as possible */
+std::vector<std::pair<uint64_t, uint64_t>> shares(uint64_t first, uint64_t size, size_t parts) {
+    if (parts == 0) {
+        throw std::invalid_argument{"can't split into 0 parts"};
+    }
+    parts = static_cast<size_t>(std::min<uint64_t>(parts, size));
+
+    std::vector<std::pair<uint64_t, uint64_t>> ranks;
+    for (size_t i = 0; i < parts; i++) {
+        // the first size % parts shares take one more
+        uint64_t share = size / parts + (i < size % parts ? 1 : 0);
+        ranks.emplace_back(first, first + share);
+        first += share;
+    }
+    return ranks;
+}
+
+
+/** the next larger mask with as many bits set, by gosper's hack */
+uint64_t next_mask(uint64_t mask) {
+    // adding the lowest bit carries the lowest block of ones one bit up,
+    // the rest of the block moves back down to bit 0.
+    uint64_t lowest = mask & (0 - mask);
+    uint64_t ripple = mask + lowest;
+    return ripple | (((mask ^ ripple) >> 2) >> std::countr_zero(lowest));
+}
+
+
+/** the next combination in lexicographic order, which has to exist */
+void next_combination(uint32_t* indexes, uint32_t n, uint32_t k) {
+    // the last index that can still grow, every later one follows it directly
+    uint32_t i = k;
+    while (indexes[i - 1] == n - k + i - 1) {
+        i--;
+    }
+    uint32_t value = indexes[i - 1];
+    for (uint32_t j = i - 1; j < k; j++) {
+        indexes[j] = ++value;
+    }
+}
+
+
+/** the next permutation in heap's order, which has to exist */
+void next_heap_permutation(uint32_t* items, uint32_t* counters) {
+    // heap's algorithm without recursion: the lowest level that isn't done
+    // swaps an item into its last position, and the levels below start over.
+    uint32_t i = 1;
+    while (counters[i] >= i) {
+        counters[i] = 0;
+        i++;
+    }
+    std::swap(items[i % 2 == 0 ? 0 : counters[i]], items[i]);
+    counters[i]++;
+}
+
+
+/**
+ * heap's algorithm at level k runs the algorithm on the first k - 1 items,
+ * then swaps an item to position k - 1, k times. this does one such iteration,
+ * with the effect of the run below from `heap_blocks`.
+ */
+void heap_iteration(std::vector<uint32_t>& items, const std::vector<uint32_t>& block, uint32_t k, uint32_t i) {
+    std::vector<uint32_t> previous(items.begin(), items.begin() + k - 1);
+    for (uint32_t p = 0; p + 1 < k; p++) {
+        items[p] = previous[block[p]];
+    }
+    std::swap(items[k % 2 == 0 ? i : 0], items[k - 1]);
+}
+
+
+/**
+ * the effect of a full run of heap's algorithm on the first m items,
+ * for all m <= n: after it, position p holds the item from position blocks[m][p].
+ */
+std::vector<std::vector<uint32_t>> heap_blocks(uint32_t n) {
+    std::vector<std::vector<uint32_t>> blocks(n + 1);
+    for (uint32_t m = 1; m <= n; m++) {
+        std::vector<uint32_t>& block = blocks[m];
+        block.resize(m);
+        std::iota(block.begin(), block.end(), 0);
+        for (uint32_t i = 0; i + 1 < m; i++) {
+            heap_iteration(block, blocks[m - 1], m, i);
+        }
+
+        // the last run on m - 1 items isn't followed by a swap
+        std::vector<uint32_t> previous = block;
+        for (uint32_t p = 0; p + 1 < m; p++) {
+            block[p] = previous[blocks[m - 1][p]];
+        }
+    }
+    return blocks;
+}
+
+} // namespace
+
+
+combination_range::combination_range(uint32_t n, uint32_t k)
+    :
+    combination_range{n, k, 0, combination(uint64_t{n}, uint64_t{k})} {}
+
+
+combination_range::combination_range(uint32_t n, uint32_t k, uint64_t first, uint64_t last)
+    :
+    n_{n},
+    k_{k},
+    count_{combination(uint64_t{n}, uint64_t{k})},
+    position_{first},
+    remaining_{last - first} {
+
+    check_ranks(first, last, count_);
+    if (remaining_ != 0) {
+        current_ = unrank(first);
+    }
+}
+
+
+void combination_range::next() {
+    position_++;
+    if (--remaining_ != 0) {
+        next_combination(current_.data(), n_, k_);
+    }
+}
+
+
+size_t combination_range::fill(enumeration_batch<uint32_t>& batch) {
+    check_width(batch.width(), k_);
+
+    size_t count = static_cast<size_t>(std::min<uint64_t>(batch.capacity(), remaining_));
+    uint32_t* indexes = current_.data();
+    uint32_t* row = batch.values_.data();
+    for (size_t i = 0; i < count; i++) {
+        row = std::copy_n(indexes, k_, row);
+        if (i + 1 < remaining_) {
+            next_combination(indexes, n_, k_);
+        }
+    }
+    position_ += count;
+    remaining_ -= count;
+    batch.size_ = count;
+    return count;
+}
+
+
+std::vector<combination_range> combination_range::split(size_t parts) const {
+    std::vector<combination_range> ranges;
+    for (auto [first, last] : shares(position_, remaining_, parts)) {
+        ranges.emplace_back(n_, k_, first, last);
+    }
+    return ranges;
+}
+
+
+uint64_t combination_range::rank(std::span<const uint32_t> combination) const {
+    if (combination.size() != k_ or not std::is_sorted(combination.begin(), combination.end(), std::less_equal{})
+        or (k_ != 0 and combination.back() >= n_)) {
+        throw std::invalid_argument{"not " + std::to_string(k_) + " increasing indexes below " + std::to_string(n_)};
+    }
+
+    // the combinations before it have a smaller index at the first difference:
+    // C(n - start, k - i) - C(n - index, k - i) of them for position i
+    uint64_t rank = 0;
+    uint64_t start = 0;
+    for (uint32_t i = 0; i < k_; i++) {
+        rank += ::combination(n_ - start, k_ - i) - ::combination(n_ - combination[i], k_ - i);
+        start = combination[i] + uint64_t{1};
+    }
+    return rank;
+}
+
+
+std::vector<uint32_t> combination_range::unrank(uint64_t rank) const {
+    if (rank >= count_) {
+        throw std::out_of_range{"rank " + std::to_string(rank) + " is beyond the count of " + std::to_string(count_)};
+    }
+
+    std::vector<uint32_t> combination(k_);
+    uint64_t start = 0;
+    for (uint32_t i = 0; i < k_; i++) {
+        // the largest index with at most `rank` combinations before it at this position
+        uint64_t total = ::combination(n_ - start, k_ - i);
+        uint64_t low = start;
+        uint64_t high = n_ - k_ + i;
+        while (low < high) {
+            uint64_t middle = low + (high - low + 1) / 2;
+            if (total - ::combination(n_ - middle, k_ - i) <= rank) {
+                low = middle;
+            }
+            else {
+                high = middle - 1;
+            }
+        }
+        rank -= total - ::combination(n_ - low, k_ - i);
+        combination[i] = static_cast<uint32_t>(low);
+        start = low + 1;
+    }
+    return combination;
+}
+
+
+subset_mask_range::subset_mask_range(uint32_t n, uint32_t k)
+    :
+    subset_mask_range{n, k, 0, n <= 64 ? combination(uint64_t{n}, uint64_t{k}) : 0} {}
+
+
+subset_mask_range::subset_mask_range(uint32_t n, uint32_t k, uint64_t first, uint64_t last)
+    :
+    n_{n},
+    k_{k},
+    position_{first},
+    remaining_{last - first},
+    current_{0} {
+
+    if (n > 64) {
+        throw std::invalid_argument{"masks of " + std::to_string(n) + " bits don't fit 64 bits"};
+    }
+    count_ = combination(uint64_t{n}, uint64_t{k});
+    check_ranks(first, last, count_);
+    if (remaining_ != 0) {
+        current_ = unrank(first);
+    }
+}
+
+
+void subset_mask_range::next() {
+    position_++;
+    if (--remaining_ != 0) {
+        current_ = next_mask(current_);
+    }
+}
+
+
+size_t subset_mask_range::fill(enumeration_batch<uint64_t>& batch) {
+    check_width(batch.width(), 1);
+
+    size_t count = static_cast<size_t>(std::min<uint64_t>(batch.capacity(), remaining_));
+    if (count == 0) {
+        batch.size_ = 0;
+        return 0;
+    }
+
+    // the masks are steps of a few instructions, not worth a branch each
+    uint64_t* masks = batch.values_.data();
+    uint64_t mask = current_;
+    for (size_t i = 0; i + 1 < count; i++) {
+        masks[i] = mask;
+        mask = next_mask(mask);
+    }
+    masks[count - 1] = mask;
+    current_ = count < remaining_ ? next_mask(mask) : mask;
+
+    position_ += count;
+    remaining_ -= count;
+    batch.size_ = count;
+    return count;
+}
+
+
+std::vector<subset_mask_range> subset_mask_range::split(size_t parts) const {
+    std::vector<subset_mask_range> ranges;
+    for (auto [first, last] : shares(position_, remaining_, parts)) {
+        ranges.emplace_back(n_, k_, first, last);
+    }
+    return ranges;
+}
+
+
+uint64_t subset_mask_range::rank(uint64_t mask) const {
+    if (static_cast<uint32_t>(std::popcount(mask)) != k_ or (n_ < 64 and mask >> n_ != 0)) {
+        throw std::invalid_argument{"not " + std::to_string(k_) + " bits below bit " + std::to_string(n_)};
+    }
+
+    // increasing masks are the subsets in colexicographic order:
+    // the i-th lowest bit b is preceded by C(b, i + 1) subsets of the lower bits
+    uint64_t rank = 0;
+    for (uint64_t i = 1; mask != 0; i++) {
+        rank += combination(static_cast<uint64_t>(std::countr_zero(mask)), i);
+        mask &= mask - 1;
+    }
+    return rank;
+}
+
+
+uint64_t subset_mask_range::unrank(uint64_t rank) const {
+    if (rank >= count_) {
+        throw std::out_of_range{"rank " + std::to_string(rank) + " is beyond the count of " + std::to_string(count_)};
+    }
+
+    // the highest bits first, each as high as the remaining rank allows
+    uint64_t mask = 0;
+    uint64_t bit = n_;
+    for (uint64_t i = k_; i > 0; i--) {
+        do {
+            bit--;
+        } while (combination(bit, i) > rank);
+        rank -= combination(bit, i);
+        mask |= uint64_t{1} << bit;
+    }
+    return mask;
+}
+
+
+permutation_range::permutation_range(uint32_t n)
+    :
+    permutation_range{n, 0, factorial(n)} {}
+
+
+permutation_range::permutation_range(uint32_t n, uint64_t first, uint64_t last)
+    :
+    n_{n},
+    count_{factorial(n)},
+    position_{first},
+    remaining_{last - first} {
+
+    check_ranks(first, last, count_);
+    if (remaining_ != 0) {
+        current_ = unrank(first);
+
+        // the counters are the rank's digits in factorial base, counter i weighs i!
+        counters_.resize(n);
+        for (uint32_t i = n; i-- > 1;) {
+            counters_[i] = static_cast<uint32_t>(first / factorial(i));
+            first %= factorial(i);
+        }
+    }
+}
+
+
+void permutation_range::next() {
+    position_++;
+    if (--remaining_ != 0) {
+        next_heap_permutation(current_.data(), counters_.data());
+    }
+}
+
+
+size_t permutation_range::fill(enumeration_batch<uint32_t>& batch) {
+    check_width(batch.width(), n_);
+
+    size_t count = static_cast<size_t>(std::min<uint64_t>(batch.capacity(), remaining_));
+    uint32_t* items = current_.data();
+    uint32_t* counters = counters_.data();
+    uint32_t* row = batch.values_.data();
+    for (size_t i = 0; i < count; i++) {
+        row = std::copy_n(items, n_, row);
+        if (i + 1 < remaining_) {
+            next_heap_permutation(items, counters);
+        }
+    }
+    position_ += count;
+    remaining_ -= count;
+    batch.size_ = count;
+    return count;
+}
+
+
+std::vector<permutation_range> permutation_range::split(size_t parts) const {
+    std::vector<permutation_range> ranges;
+    for (auto [first, last] : shares(position_, remaining_, parts)) {
+        ranges.emplace_back(n_, first, last);
+    }
+    return ranges;
+}
+
+
+uint64_t permutation_range::rank(std::span<const uint32_t> permutation) const {
+    std::vector<bool> seen(n_);
+    for (uint32_t item : permutation) {
+        if (item >= n_ or seen[item]) {
+            break;
+        }
+        seen[item] = true;
+    }
+    if (permutation.size() != n_ or std::find(seen.begin(), seen.end(), false) != seen.end()) {
+        throw std::invalid_argument{"not a permutation of 0 ... " + std::to_string(n_) + " - 1"};
+    }
+
+    // at each level, every item comes to the last position once.
+    // the iterations until the wanted one does are the rank's digit.
+    auto blocks = heap_blocks(n_);
+    std::vector<uint32_t> items(n_);
+    std::iota(items.begin(), items.end(), 0);
+
+    uint64_t rank = 0;
+    for (uint32_t k = n_; k > 1; k--) {
+        uint32_t digit = 0;
+        while (items[k - 1] != permutation[k - 1]) {
+            heap_iteration(items, blocks[k - 1], k, digit);
+            digit++;
+        }
+        rank += digit * factorial(k - 1);
+    }
+    return rank;
+}
+
+
+std::vector<uint32_t> permutation_range::unrank(uint64_t rank) const {
+    if (rank >= count_) {
+        throw std::out_of_range{"rank " + std::to_string(rank) + " is beyond the count of " + std::to_string(count_)};
+    }
+
+    auto blocks = heap_blocks(n_);
+    std::vector<uint32_t> items(n_);
+    std::iota(items.begin(), items.end(), 0);
+
+    for (uint32_t k = n_; k > 1; k--) {
+        uint64_t digit = rank / factorial(k - 1);
+        rank %= factorial(k - 1);
+        for (uint32_t i = 0; i < digit; i++) {
+            heap_iteration(items, blocks[k - 1], k, i);
+        }
+    }
+    return items;
+}
@@ -0,0 +1,291 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <span>
+#include <utility>
+#include <vector>
+
+
+class combination_range;
+class subset_mask_range;
+class permutation_range;
+
+
+/**
+ * preallocated storage for enumerated items, filled by the ranges below.
+ *
+ * the items are stored back to back, `width` values each, so a batch
+ * can be processed as one flat array.
+ */
+template <typename value_t>
+class enumeration_batch {
+public:
+    enumeration_batch(size_t capacity, size_t width)
+        :
+        values_(capacity * width),
+        capacity_{capacity},
+        width_{width} {}
+
+    size_t capacity() const { return capacity_; }
+
+    /** values per item */
+    size_t width() const { return width_; }
+
+    /** items filled in by the last fill */
+    size_t size() const { return size_; }
+
+    bool empty() const { return size_ == 0; }
+
+    std::span<const value_t> operator[](size_t index) const {
+        return {values_.data() + index * width_, width_};
+    }
+
+    /** all values of all items, back to back */
+    std::span<const value_t> values() const {
+        return {values_.data(), size_ * width_};
+    }
+
+private:
+    friend class combination_range;
+    friend class subset_mask_range;
+    friend class permutation_range;
+
+    std::vector<value_t> values_;
+    size_t capacity_;
+    size_t width_;
+    size_t size_ = 0;
+};
+
+
+/**
+ * iterates a range by advancing it, so iterating consumes the range.
+ */
+template <typename range_t>
+class enumeration_iterator {
+public:
+    using value_type = decltype(std::declval<const range_t&>().current());
+    using difference_type = std::ptrdiff_t;
+
+    enumeration_iterator() = default;
+
+    explicit enumeration_iterator(range_t& range) : range_{&range} {}
+
+    value_type operator*() const { return range_->current(); }
+
+    enumeration_iterator& operator++() {
+        range_->next();
+        return *this;
+    }
+
+    void operator++(int) { range_->next(); }
+
+    bool operator==(std::default_sentinel_t) const { return range_->empty(); }
+
+private:
+    range_t* range_ = nullptr;
+};
+
+
+/**
+ * the k-subsets of {0, ..., n - 1} in lexicographic order, as sorted indexes.
+ *
+ * items are generated lazily, one by one or in batches. each item has
+ * a rank, its position in the order, and a range can cover any part of
+ * the ranks, which `split` uses to share the work between threads.
+ */
+class combination_range {
+public:
+    /**
+     * all C(n, k) combinations.
+     * @throw std::overflow_error if their count doesn't fit 64 bits.
+     */
+    combination_range(uint32_t n, uint32_t k);
+
+    /**
+     * the combinations with ranks first ... last - 1.
+     * @throw std::out_of_range if the ranks are beyond the count.
+     */
+    combination_range(uint32_t n, uint32_t k, uint64_t first, uint64_t last);
+
+    /** number of combinations left */
+    uint64_t size() const { return remaining_; }
+
+    bool empty() const { return remaining_ == 0; }
+
+    /** rank of the current combination */
+    uint64_t position() const { return position_; }
+
+    /** the current combination, valid until the range advances */
+    std::span<const uint32_t> current() const { return current_; }
+
+    /** advance to the next combination */
+    void next();
+
+    /**
+     * replace the batch contents with the next combinations, as many as fit.
+     * @throw std::invalid_argument if the batch width isn't k.
+     * @return the number of combinations filled in, 0 when the range is done.
+     */
+    size_t fill(enumeration_batch<uint32_t>& batch);
+
+    /** split the remaining combinations into parts of about equal size */
+    std::vector<combination_range> split(size_t parts) const;
+
+    /**
+     * position of the combination in the lexicographic order.
+     * @throw std::invalid_argument if it isn't k increasing indexes below n.
+     */
+    uint64_t rank(std::span<const uint32_t> combination) const;
+
+    /**
+     * the combination at the position.
+     * @throw std::out_of_range if the rank is beyond the count.
+     */
+    std::vector<uint32_t> unrank(uint64_t rank) const;
+
+    enumeration_iterator<combination_range> begin() { return enumeration_iterator{*this}; }
+    std::default_sentinel_t end() const { return {}; }
+
+private:
+    uint32_t n_;
+    uint32_t k_;
+    uint64_t count_;
+    uint64_t position_;
+    uint64_t remaining_;
+    std::vector<uint32_t> current_;
+};
+
+
+/**
+ * the k-subsets of {0, ..., n - 1} for n <= 64 as bitmasks, in increasing order.
+ *
+ * the next mask follows from gosper's hack with a few bit operations,
+ * which makes this the fastest way to enumerate small subsets.
+ * ranks are positions in the increasing order, like for `combination_range`.
+ */
+class subset_mask_range {
+public:
+    /**
+     * all C(n, k) masks.
+     * @throw std::invalid_argument if n is larger than 64.
+     */
+    subset_mask_range(uint32_t n, uint32_t k);
+
+    /**
+     * the masks with ranks first ... last - 1.
+     * @throw std::out_of_range if the ranks are beyond the count.
+     */
+    subset_mask_range(uint32_t n, uint32_t k, uint64_t first, uint64_t last);
+
+    uint64_t size() const { return remaining_; }
+
+    bool empty() const { return remaining_ == 0; }
+
+    uint64_t position() const { return position_; }
+
+    uint64_t current() const { return current_; }
+
+    void next();
+
+    /**
+     * replace the batch contents with the next masks, as many as fit.
+     * @throw std::invalid_argument if the batch width isn't 1.
+     * @return the number of masks filled in, 0 when the range is done.
+     */
+    size_t fill(enumeration_batch<uint64_t>& batch);
+
+    std::vector<subset_mask_range> split(size_t parts) const;
+
+    /**
+     * position of the mask in the increasing order.
+     * @throw std::invalid_argument if it doesn't have k bits below bit n.
+     */
+    uint64_t rank(uint64_t mask) const;
+
+    /**
+     * the mask at the position.
+     * @throw std::out_of_range if the rank is beyond the count.
+     */
+    uint64_t unrank(uint64_t rank) const;
+
+    enumeration_iterator<subset_mask_range> begin() { return enumeration_iterator{*this}; }
+    std::default_sentinel_t end() const { return {}; }
+
+private:
+    uint32_t n_;
+    uint32_t k_;
+    uint64_t count_;
+    uint64_t position_;
+    uint64_t remaining_;
+    uint64_t current_;
+};
+
+
+/**
+ * the permutations of {0, ..., n - 1} in the order of heap's algorithm.
+ *
+ * each permutation differs from the previous one by a single swap.
+ * ranks are the positions in this order, so they follow the algorithm's
+ * counters rather than the lexicographic order.
+ * for k-permutations, permute each of the k-subsets of a `combination_range`.
+ */
+class permutation_range {
+public:
+    /**
+     * all n! permutations.
+     * @throw std::overflow_error if n! doesn't fit 64 bits, past n = 20.
+     */
+    explicit permutation_range(uint32_t n);
+
+    /**
+     * the permutations with ranks first ... last - 1.
+     * @throw std::out_of_range if the ranks are beyond the count.
+     */
+    permutation_range(uint32_t n, uint64_t first, uint64_t last);
+
+    uint64_t size() const { return remaining_; }
+
+    bool empty() const { return remaining_ == 0; }
+
+    uint64_t position() const { return position_; }
+
+    std::span<const uint32_t> current() const { return current_; }
+
+    void next();
+
+    /**
+     * replace the batch contents with the next permutations, as many as fit.
+     * @throw std::invalid_argument if the batch width isn't n.
+     * @return the number of permutations filled in, 0 when the range is done.
+     */
+    size_t fill(enumeration_batch<uint32_t>& batch);
+
+    std::vector<permutation_range> split(size_t parts) const;
+
+    /**
+     * position of the permutation in heap's order.
+     * @throw std::invalid_argument if it isn't a permutation of 0 ... n - 1.
+     */
+    uint64_t rank(std::span<const uint32_t> permutation) const;
+
+    /**
+     * the permutation at the position.
+     * @throw std::out_of_range if the rank is beyond the count.
+     */
+    std::vector<uint32_t> unrank(uint64_t rank) const;
+
+    enumeration_iterator<permutation_range> begin() { return enumeration_iterator{*this}; }
+    std::default_sentinel_t end() const { return {}; }
+
+private:
+    uint32_t n_;
+    uint64_t count_;
+    uint64_t position_;
+    uint64_t remaining_;
+    std::vector<uint32_t> current_;
+
+    /** heap's loop counters, which are the digits of the rank in factorial base */
+    std::vector<uint32_t> counters_;
+};
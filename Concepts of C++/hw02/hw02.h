@@ -1,3 +1,5 @@
 #pragma once
 
 #include "combinatorics.h"
+#include "enumeration.h"
+#include "modular_combinatorics.h"
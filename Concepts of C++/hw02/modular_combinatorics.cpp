@@ -0,0 +1,318 @@
+#include "modular_combinatorics.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+// avx2 code is compiled for its functions only, and used if the cpu has it
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define HW02_HAVE_AVX2 1
+#endif
+
+#ifdef __GNUC__
+#define HW02_ALWAYS_INLINE [[gnu::always_inline]] inline
+#else
+#define HW02_ALWAYS_INLINE inline
+#endif
+
+
+namespace {
+
+/**
+ * the tables and constants the queries need, as plain values
+ * so the batch loops see nothing that could alias their results.
+ */
+struct tables {
+    const uint32_t* factorials;
+    const uint32_t* inverse_factorials;
+    uint32_t size;
+    uint32_t prime;
+    uint32_t negated_inverse;
+};
+
+
+/**
+ * montgomery reduction: for a product below p 2^32, the product / 2^32 mod p.
+ * adding a multiple of p makes the low 32 bits zero, so the division is a shift.
+ */
+HW02_ALWAYS_INLINE uint32_t montgomery_reduce(uint64_t product, uint32_t prime, uint32_t negated_inverse) {
+    uint32_t multiple = static_cast<uint32_t>(product) * negated_inverse;
+    uint64_t reduced = (product + uint64_t{multiple} * prime) >> 32;
+    return static_cast<uint32_t>(reduced >= prime ? reduced - prime : reduced);
+}
+
+
+/**
+ * the batch queries within the tables, without branches or divisions.
+ * other queries are masked to index 0, and answered by the caller afterwards.
+ */
+template <bool combinations>
+HW02_ALWAYS_INLINE void batch(const tables& table, const uint32_t* ns, const uint32_t* ks,
+                              uint32_t* results, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        uint32_t n = ns[i];
+        uint32_t k = ks[i];
+        uint32_t valid = 0u - static_cast<uint32_t>((k <= n) & (n < table.size));
+
+        uint32_t top = n & valid;
+        uint32_t chosen = k & valid;
+        uint32_t result = montgomery_reduce(uint64_t{table.factorials[top]} * table.inverse_factorials[top - chosen],
+                                            table.prime, table.negated_inverse);
+        if constexpr (combinations) {
+            result = montgomery_reduce(uint64_t{result} * table.inverse_factorials[chosen],
+                                       table.prime, table.negated_inverse);
+        }
+        results[i] = result & valid;
+    }
+}
+
+
+template <bool combinations>
+void batch_generic(const tables& table, const uint32_t* ns, const uint32_t* ks, uint32_t* results, size_t count) {
+    batch<combinations>(table, ns, ks, results, count);
+}
+
+
+#ifdef HW02_HAVE_AVX2
+
+/** montgomery reduction of the 64 bit products in the 4 lanes, into their low halves */
+__attribute__((target("avx2")))
+HW02_ALWAYS_INLINE __m256i montgomery_reduce_avx2(__m256i product, __m256i prime, __m256i negated_inverse) {
+    __m256i multiple = _mm256_mul_epu32(product, negated_inverse);
+    return _mm256_srli_epi64(_mm256_add_epi64(product, _mm256_mul_epu32(multiple, prime)), 32);
+}
+
+
+/**
+ * montgomery multiplication of 8 pairs of numbers.
+ * the multiplications are 32 x 32 to 64 bit, so they are done separately
+ * for the even and odd lanes, whose results are merged in the end.
+ */
+__attribute__((target("avx2")))
+HW02_ALWAYS_INLINE __m256i montgomery_multiply_avx2(__m256i a, __m256i b, __m256i prime, __m256i negated_inverse) {
+    __m256i even = montgomery_reduce_avx2(_mm256_mul_epu32(a, b), prime, negated_inverse);
+    __m256i odd = montgomery_reduce_avx2(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32)),
+                                         prime, negated_inverse);
+    __m256i reduced = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0b10101010);
+
+    // below 2p, subtracting p wraps around unless the result was too large
+    return _mm256_min_epu32(reduced, _mm256_sub_epi32(reduced, prime));
+}
+
+
+// the same loop with 8 queries at once, using gathers for the table lookups
+template <bool combinations>
+__attribute__((target("avx2")))
+void batch_avx2(const tables& table, const uint32_t* ns, const uint32_t* ks, uint32_t* results, size_t count) {
+    auto factorials = reinterpret_cast<const int*>(table.factorials);
+    auto inverse_factorials = reinterpret_cast<const int*>(table.inverse_factorials);
+    const __m256i last = _mm256_set1_epi32(static_cast<int>(table.size - 1));
+    const __m256i prime = _mm256_set1_epi32(static_cast<int>(table.prime));
+    const __m256i negated_inverse = _mm256_set1_epi32(static_cast<int>(table.negated_inverse));
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i n = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ns + i));
+        __m256i k = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ks + i));
+
+        // unsigned a <= b is min(a, b) == a
+        __m256i valid = _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_min_epu32(k, n), k),
+                                         _mm256_cmpeq_epi32(_mm256_min_epu32(n, last), n));
+        __m256i top = _mm256_and_si256(n, valid);
+        __m256i chosen = _mm256_and_si256(k, valid);
+
+        __m256i result = montgomery_multiply_avx2(
+            _mm256_i32gather_epi32(factorials, top, 4),
+            _mm256_i32gather_epi32(inverse_factorials, _mm256_sub_epi32(top, chosen), 4),
+            prime, negated_inverse);
+        if constexpr (combinations) {
+            result = montgomery_multiply_avx2(result, _mm256_i32gather_epi32(inverse_factorials, chosen, 4),
+                                              prime, negated_inverse);
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(results + i), _mm256_and_si256(result, valid));
+    }
+
+    batch<combinations>(table, ns + i, ks + i, results + i, count - i);
+}
+
+#endif
+
+
+using batch_t = void (*)(const tables&, const uint32_t*, const uint32_t*, uint32_t*, size_t);
+
+/** the fastest batch loop the cpu supports */
+template <bool combinations>
+batch_t select_batch() {
+#ifdef HW02_HAVE_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        return &batch_avx2<combinations>;
+    }
+#endif
+    return &batch_generic<combinations>;
+}
+
+
+bool is_prime(uint32_t value) {
+    if (value < 2) {
+        return false;
+    }
+    for (uint64_t divisor = 2; divisor * divisor <= value; divisor++) {
+        if (value % divisor == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+uint32_t power(uint64_t base, uint64_t exponent, uint32_t prime) {
+    uint64_t result = 1;
+    base %= prime;
+    while (exponent != 0) {
+        if (exponent & 1) {
+            result = result * base % prime;
+        }
+        base = base * base % prime;
+        exponent >>= 1;
+    }
+    return static_cast<uint32_t>(result);
+}
+
+} // namespace
+
+
+modular_combinatorics::modular_combinatorics(uint64_t max_n, uint32_t prime)
+    :
+    prime_{prime} {
+
+    // montgomery reduction needs an odd modulus, and p 2^32 + p^2 to fit 64 bits
+    if (prime % 2 == 0 or prime >= (uint32_t{1} << 31) or not is_prime(prime)) {
+        throw std::invalid_argument{std::to_string(prime) + " isn't an odd prime below 2^31"};
+    }
+
+    // newton's iteration doubles the correct low bits of 1 / p, p is correct for 3
+    uint32_t inverse = prime;
+    for (int i = 0; i < 4; i++) {
+        inverse *= 2 - prime * inverse;
+    }
+    negated_inverse_ = 0 - inverse;
+
+    // beyond p - 1, all factorials are 0 mod p
+    size_t size = static_cast<size_t>(std::min<uint64_t>(max_n, prime - 1)) + 1;
+
+    factorials_.resize(size);
+    factorials_[0] = 1;
+    for (size_t n = 1; n < size; n++) {
+        factorials_[n] = static_cast<uint32_t>(uint64_t{factorials_[n - 1]} * n % prime);
+    }
+
+    // one inverse by fermat's little theorem, the others follow from 1 / (n - 1)! = n / n!
+    inverse_factorials_.resize(size);
+    inverse_factorials_[size - 1] = power(factorials_[size - 1], prime - 2, prime);
+    for (size_t n = size - 1; n > 0; n--) {
+        inverse_factorials_[n - 1] = static_cast<uint32_t>(uint64_t{inverse_factorials_[n]} * n % prime);
+    }
+    for (uint32_t& inverse_factorial : inverse_factorials_) {
+        inverse_factorial = static_cast<uint32_t>((uint64_t{inverse_factorial} << 32) % prime);
+    }
+}
+
+
+uint32_t modular_combinatorics::reduce(uint64_t product) const {
+    return montgomery_reduce(product, prime_, negated_inverse_);
+}
+
+
+uint32_t modular_combinatorics::factorial(uint64_t n) const {
+    if (n < factorials_.size()) {
+        return factorials_[n];
+    }
+    if (n >= prime_) {
+        return 0;
+    }
+    throw std::out_of_range{std::to_string(n) + "! is beyond the tables, up to " + std::to_string(max_n())};
+}
+
+
+uint32_t modular_combinatorics::combination(uint64_t n, uint64_t k) const {
+    if (k > n) {
+        return 0;
+    }
+    if (n < factorials_.size()) {
+        return reduce(uint64_t{reduce(uint64_t{factorials_[n]} * inverse_factorials_[n - k])}
+                      * inverse_factorials_[k]);
+    }
+    if (factorials_.size() < prime_) {
+        throw std::out_of_range{"C(" + std::to_string(n) + ", " + std::to_string(k)
+                                + ") is beyond the tables, up to " + std::to_string(max_n())};
+    }
+
+    // lucas' theorem: C(n, k) is the product of the combinations of the base p digits
+    uint64_t result = 1;
+    while (n != 0 and result != 0) {
+        result = result * combination(n % prime_, k % prime_) % prime_;
+        n /= prime_;
+        k /= prime_;
+    }
+    return static_cast<uint32_t>(result);
+}
+
+
+uint32_t modular_combinatorics::permutation(uint64_t n, uint64_t k) const {
+    if (k > n) {
+        return 0;
+    }
+    if (n < factorials_.size()) {
+        return reduce(uint64_t{factorials_[n]} * inverse_factorials_[n - k]);
+    }
+    if (factorials_.size() < prime_) {
+        throw std::out_of_range{"P(" + std::to_string(n) + ", " + std::to_string(k)
+                                + ") is beyond the tables, up to " + std::to_string(max_n())};
+    }
+
+    // the factors n - k + 1 ... n include a multiple of p, or are
+    // (n - k) mod p + 1 ... n mod p, with the same residues.
+    if (n / prime_ != (n - k) / prime_) {
+        return 0;
+    }
+    return permutation(n % prime_, k);
+}
+
+
+void modular_combinatorics::combinations(std::span<const uint32_t> ns, std::span<const uint32_t> ks,
+                                         std::span<uint32_t> results) const {
+    if (ns.size() != ks.size() or ns.size() != results.size()) {
+        throw std::invalid_argument{"combinations need as many ns, ks and results"};
+    }
+
+    static const batch_t batch = select_batch<true>();
+    tables table{factorials_.data(), inverse_factorials_.data(), static_cast<uint32_t>(factorials_.size()),
+                 prime_, negated_inverse_};
+    batch(table, ns.data(), ks.data(), results.data(), ns.size());
+
+    for (size_t i = 0; i < ns.size(); i++) {
+        if (ns[i] >= factorials_.size() and ks[i] <= ns[i]) {
+            results[i] = combination(ns[i], ks[i]);
+        }
+    }
+}
+
+
+void modular_combinatorics::permutations(std::span<const uint32_t> ns, std::span<const uint32_t> ks,
+                                         std::span<uint32_t> results) const {
+    if (ns.size() != ks.size() or ns.size() != results.size()) {
+        throw std::invalid_argument{"permutations need as many ns, ks and results"};
+    }
+
+    static const batch_t batch = select_batch<false>();
+    tables table{factorials_.data(), inverse_factorials_.data(), static_cast<uint32_t>(factorials_.size()),
+                 prime_, negated_inverse_};
+    batch(table, ns.data(), ks.data(), results.data(), ns.size());
+
+    for (size_t i = 0; i < ns.size(); i++) {
+        if (ns[i] >= factorials_.size() and ks[i] <= ns[i]) {
+            results[i] = permutation(ns[i], ks[i]);
+        }
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+
+/**
+ * combinations and permutations modulo a prime, for many queries.
+ *
+ * factorials and inverse factorials mod p are computed once in O(n),
+ * then each query takes a few table loads and multiplications.
+ * multiplications use montgomery reduction instead of division by p,
+ * so the batch queries are free of branches and divisions and can be
+ * vectorized.
+ *
+ * for n >= p, lucas' theorem splits queries into base p digits. this
+ * needs tables for all residues, so it works for primes up to the
+ * table size only.
+ */
+class modular_combinatorics {
+public:
+    static constexpr uint32_t default_prime = 1'000'000'007;
+
+    /**
+     * prepare tables for queries up to max_n, or all residues if p is smaller.
+     * @throw std::invalid_argument if the modulus isn't an odd prime below 2^31.
+     */
+    explicit modular_combinatorics(uint64_t max_n, uint32_t prime = default_prime);
+
+    uint32_t prime() const { return prime_; }
+
+    /** largest n answered from the tables, all n if it is at least p - 1 */
+    uint64_t max_n() const { return factorials_.size() - 1; }
+
+    /**
+     * n! mod p.
+     * @throw std::out_of_range if n is beyond the tables and below p.
+     */
+    uint32_t factorial(uint64_t n) const;
+
+    /**
+     * C(n, k) mod p.
+     * @throw std::out_of_range if n is beyond the tables, which don't cover all residues.
+     */
+    uint32_t combination(uint64_t n, uint64_t k) const;
+
+    /**
+     * P(n, k) mod p.
+     * @throw std::out_of_range if n is beyond the tables, which don't cover all residues.
+     */
+    uint32_t permutation(uint64_t n, uint64_t k) const;
+
+    /**
+     * C(ns[i], ks[i]) mod p for all i, into the results.
+     * the inputs are 32 bit, like the table indexes, so the loop vectorizes.
+     * @throw std::invalid_argument if the spans differ in size.
+     */
+    void combinations(std::span<const uint32_t> ns, std::span<const uint32_t> ks,
+                      std::span<uint32_t> results) const;
+
+    /**
+     * P(ns[i], ks[i]) mod p for all i, into the results.
+     * @throw std::invalid_argument if the spans differ in size.
+     */
+    void permutations(std::span<const uint32_t> ns, std::span<const uint32_t> ks,
+                      std::span<uint32_t> results) const;
+
+private:
+    /** the product of a and b R, which is a b, reduced mod p */
+    uint32_t reduce(uint64_t product) const;
+
+    uint32_t prime_;
+
+    /** -1 / p mod 2^32, for montgomery reduction */
+    uint32_t negated_inverse_;
+
+    /** n! mod p */
+    std::vector<uint32_t> factorials_;
+
+    /** 1 / n! mod p, times R = 2^32, so multiplying by it and reducing divides by n! */
+    std::vector<uint32_t> inverse_factorials_;
+};
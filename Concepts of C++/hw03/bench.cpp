@@ -0,0 +1,388 @@
+#include "hw03.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+#include <malloc.h>
+#define HW03_HAVE_MALLINFO 1
+#endif
+
+
+namespace contact_list::bench {
+
+/**
+ * bytes currently allocated on the heap, 0 if unknown.
+ */
+size_t heap_in_use() {
+#ifdef HW03_HAVE_MALLINFO
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+
+/**
+ * a unique, realistic looking name for each index.
+ */
+std::string name_for(size_t index) {
+    static const char* const first[] = {
+        "Anna", "Ben", "Clara", "David", "Elif", "Felix", "Greta", "Hannes",
+        "Ida", "Jonas", "Katharina", "Lukas", "Mia", "Noah", "Olga", "Paul",
+    };
+    static const char* const last[] = {
+        "Müller", "Schmidt", "Schneider", "Fischer", "Weber", "Meyer",
+        "Wagner", "Becker", "Schulz", "Hoffmann", "Schäfer", "Koch",
+    };
+    constexpr size_t first_count = std::size(first);
+    constexpr size_t last_count = std::size(last);
+
+    return std::string{first[index % first_count]} + " "
+           + last[index / first_count % last_count] + " "
+           + std::to_string(index / (first_count * last_count));
+}
+
+
+/**
+ * the contact list as it was stored before names were pooled:
+ * a `std::string` per name, and indexes owning another copy.
+ */
+struct string_storage {
+    std::vector<number_t> numbers;
+    std::vector<std::string> names;
+    std::unordered_map<std::string, size_t> name_index;
+    std::unordered_map<number_t, number_slot> number_index;
+
+    void add(const std::string& name, number_t number) {
+        if (!name_index.try_emplace(name, names.size()).second) return;
+
+        auto [entry, inserted] = number_index.try_emplace(number, number_slot{names.size(), 1});
+        if (!inserted) entry->second.count += 1;
+
+        names.push_back(name);
+        numbers.push_back(number);
+    }
+};
+
+
+/**
+ * measure the time and heap memory for filling a storage.
+ */
+void measure(const std::string& name, size_t count, const std::function<void()>& fill) {
+    size_t heap_before = heap_in_use();
+    auto start = std::chrono::steady_clock::now();
+    fill();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    size_t heap = heap_in_use() - heap_before;
+
+    std::cout << "  " << std::left << std::setw(16) << name
+              << std::right << std::setw(8) << std::fixed << std::setprecision(2)
+              << elapsed.count() << " s"
+              << std::setw(10) << std::setprecision(1) << static_cast<double>(heap) / 1e6 << " MB"
+              << std::setw(8) << std::setprecision(1) << static_cast<double>(heap) / static_cast<double>(count)
+              << " B/contact" << std::endl;
+}
+
+
+/**
+ * memory used for a large address book, with and without the string pool.
+ */
+void name_memory(size_t count) {
+    std::vector<std::string> names;
+    names.reserve(count);
+    size_t name_bytes = 0;
+    for (size_t i = 0; i < count; i++) {
+        names.push_back(name_for(i));
+        name_bytes += names.back().size();
+    }
+
+    std::cout << "adding " << count << " contacts, "
+              << std::fixed << std::setprecision(1)
+              << static_cast<double>(name_bytes) / static_cast<double>(count)
+              << " bytes per name" << std::endl;
+#ifndef HW03_HAVE_MALLINFO
+    std::cout << "  (heap usage isn't known on this platform)" << std::endl;
+#endif
+
+    {
+        string_storage strings;
+        measure("std::string", count, [&] {
+            for (size_t i = 0; i < count; i++) {
+                strings.add(names[i], static_cast<number_t>(i));
+            }
+        });
+    }
+
+    {
+        storage pooled;
+        measure("string pool", count, [&] {
+            for (size_t i = 0; i < count; i++) {
+                add(pooled, names[i], static_cast<number_t>(i));
+            }
+        });
+        std::cout << "    of which " << std::setprecision(1)
+                  << static_cast<double>(pooled.pool->allocated()) / 1e6 << " MB pool" << std::endl;
+    }
+
+    // two address books with the same people, sharing a deduplicating pool
+    {
+        storage first;
+        storage second;
+        measure("2x shared pool", count * 2, [&] {
+            auto pool = std::make_shared<string_pool>(true);
+            use_pool(first, pool);
+            use_pool(second, pool);
+            for (size_t i = 0; i < count; i++) {
+                add(first, names[i], static_cast<number_t>(i));
+                add(second, names[i], static_cast<number_t>(i));
+            }
+        });
+        std::cout << "    of which " << std::setprecision(1)
+                  << static_cast<double>(first.pool->allocated()) / 1e6 << " MB pool" << std::endl;
+    }
+}
+
+
+/**
+ * adding contacts one by one against a bulk import,
+ * and building the listing against streaming it.
+ */
+void bulk(size_t count) {
+    std::vector<std::string> names;
+    std::vector<number_t> numbers;
+    names.reserve(count);
+    numbers.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        // every tenth name is a duplicate
+        names.push_back(name_for(i % 10 == 9 ? i / 2 : i));
+        numbers.push_back(static_cast<number_t>(i));
+    }
+
+    std::cout << "importing " << count << " contacts" << std::endl;
+
+    storage single;
+    measure("add", count, [&] {
+        for (size_t i = 0; i < count; i++) {
+            add(single, names[i], numbers[i]);
+        }
+    });
+
+    storage single_sorted;
+    keep_sorted(single_sorted);
+    measure("add sorted", count, [&] {
+        for (size_t i = 0; i < count; i++) {
+            add(single_sorted, names[i], numbers[i]);
+        }
+    });
+
+    storage bulk;
+    measure("add_all", count, [&] {
+        add_all(bulk, std::span<const std::string>{names}, numbers);
+    });
+
+    storage sorted;
+    keep_sorted(sorted);
+    measure("add_all sorted", count, [&] {
+        add_all(sorted, std::span<const std::string>{names}, numbers);
+    });
+
+    std::cout << "listing " << size(bulk) << " contacts" << std::endl;
+
+    measure("to_string", count, [&] {
+        std::ofstream out{"/dev/null"};
+        out << to_string(bulk);
+    });
+
+    measure("streamed", count, [&] {
+        std::ofstream out{"/dev/null"};
+        to_string(bulk, out);
+    });
+}
+
+
+/**
+ * a storage behind a readers-writer lock, to compare the concurrent storage with.
+ */
+struct locked_storage {
+    storage contacts;
+    mutable std::shared_mutex lock;
+
+    bool add(std::string_view name, number_t number) {
+        std::unique_lock guard{lock};
+        return contact_list::add(contacts, name, number);
+    }
+
+    bool remove(std::string_view name) {
+        std::unique_lock guard{lock};
+        return contact_list::remove(contacts, name);
+    }
+
+    number_t get_number_by_name(std::string_view name) {
+        std::shared_lock guard{lock};
+        return contact_list::get_number_by_name(contacts, name);
+    }
+};
+
+
+/**
+ * operations per second of threads that look up numbers,
+ * and add or remove a contact in every `1 / write_share` of their operations.
+ */
+template <typename storage_t>
+double throughput(storage_t& contacts, const std::vector<std::string>& names,
+                  size_t threads, size_t operations, double write_share) {
+    auto work = [&](size_t thread) {
+        size_t write_every = write_share > 0 ? static_cast<size_t>(1 / write_share) : 0;
+        size_t found = 0;
+        for (size_t i = 0; i < operations; i++) {
+            // spread the threads over the names
+            size_t index = (i * 7919 + thread * 104729) % names.size();
+            if (write_every != 0 && i % write_every == 0) {
+                // names come and go, the size stays about the same
+                if (!contacts.remove(names[index])) {
+                    contacts.add(names[index], static_cast<number_t>(index));
+                }
+            } else {
+                found += contacts.get_number_by_name(names[index]) != -1;
+            }
+        }
+        return found;
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::vector<std::jthread> workers;
+        for (size_t thread = 0; thread < threads; thread++) {
+            workers.emplace_back(work, thread);
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    return static_cast<double>(threads * operations) / elapsed.count();
+}
+
+
+/**
+ * lookups and changes from several threads, for several shares of changes.
+ */
+void concurrency(size_t count, size_t threads) {
+    // each thread does as many operations as there are contacts, up to a limit
+    size_t operations = std::min<size_t>(count, 1'000'000);
+
+    std::vector<std::string> names;
+    names.reserve(count);
+    storage initial;
+    for (size_t i = 0; i < count; i++) {
+        names.push_back(name_for(i));
+        add(initial, names.back(), static_cast<number_t>(i));
+    }
+
+    std::cout << threads << " threads on " << count << " contacts, "
+              << operations << " operations each" << std::endl;
+
+    for (double write_share : {0.0, 0.001, 0.01, 0.1, 0.5}) {
+        locked_storage locked{initial, {}};
+        concurrent_storage concurrent{initial};
+
+        double locked_rate = throughput(locked, names, threads, operations, write_share);
+        double concurrent_rate = throughput(concurrent, names, threads, operations, write_share);
+
+        std::cout << "  " << std::setw(5) << std::setprecision(1) << std::fixed << write_share * 100
+                  << "% writes: shared_mutex " << std::setw(7) << std::setprecision(2) << locked_rate / 1e6
+                  << " Mop/s, left-right " << std::setw(7) << concurrent_rate / 1e6 << " Mop/s" << std::endl;
+    }
+}
+
+
+/**
+ * starting from a snapshot file instead of adding all contacts.
+ */
+void snapshots(size_t count) {
+    std::vector<std::string> names;
+    names.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        names.push_back(name_for(i));
+    }
+    std::string path = (std::filesystem::temp_directory_path() / "benchhw03.snapshot").string();
+
+    std::cout << "snapshot of " << count << " contacts" << std::endl;
+
+    storage contacts;
+    measure("add", count, [&] {
+        for (size_t i = 0; i < count; i++) {
+            add(contacts, names[i], static_cast<number_t>(i));
+        }
+    });
+
+    measure("save", count, [&] { save(contacts, path); });
+
+    measure("load", count, [&] {
+        storage loaded = load(path);
+    });
+
+    measure("open checked", count, [&] { snapshot checked{path}; });
+
+    // lookups page in the file, the first ones are slower
+    size_t lookups = std::min<size_t>(count, 1'000'000);
+    auto lookup = [&](auto& from) {
+        size_t found = 0;
+        for (size_t i = 0; i < lookups; i++) {
+            found += from.get_number_by_name(names[(i * 7919) % count]) != -1;
+        }
+        return found;
+    };
+
+    measure("open + lookups", lookups, [&] {
+        snapshot mapped{path, false};
+        lookup(mapped);
+    });
+
+    measure("storage lookups", lookups, [&] {
+        struct {
+            storage& contacts;
+
+            number_t get_number_by_name(std::string_view name) {
+                return contact_list::get_number_by_name(contacts, name);
+            }
+        } from{contacts};
+        lookup(from);
+    });
+
+    std::filesystem::remove(path);
+}
+
+} // namespace contact_list::bench
+
+
+int main(int argc, char* argv[]) {
+    using namespace contact_list::bench;
+
+    size_t contacts = 10'000'000;
+    if (argc > 1) {
+        contacts = std::strtoull(argv[1], nullptr, 10);
+    }
+
+    name_memory(contacts);
+    bulk(contacts);
+    snapshots(contacts);
+
+    size_t threads = std::max(std::thread::hardware_concurrency(), 4u);
+    if (argc > 2) {
+        threads = std::strtoull(argv[2], nullptr, 10);
+    }
+    concurrency(contacts, threads);
+
+    return 0;
+}
@@ -0,0 +1,105 @@
+#include "concurrent.h"
+
+#include <thread>
+
+
+namespace contact_list {
+
+    namespace {
+        // wait until the readers that arrived earlier are gone
+        void wait_for(const read_indicator& indicator) {
+            while (!indicator.empty()) {
+                std::this_thread::yield();
+            }
+        }
+    } // namespace
+
+    size_t read_indicator::arrive() {
+        // each thread keeps its counter, so threads take turns on them
+        static std::atomic<size_t> next_counter{0};
+        thread_local size_t counter = next_counter.fetch_add(1, std::memory_order_relaxed) % counters;
+
+        readers[counter].count.fetch_add(1);
+        return counter;
+    }
+
+    bool read_indicator::empty() const {
+        for (const counter& reader : readers) {
+            if (reader.count.load() != 0) return false;
+        }
+        return true;
+    }
+
+    concurrent_storage::concurrent_storage(storage contacts) {
+        // the copies must not share a pool: a writer storing names would change it under readers
+        bool deduplicate = contacts.pool->deduplicating();
+        sides[0] = std::move(contacts);
+        use_pool(sides[0], std::make_shared<string_pool>(deduplicate));
+        // the new pool is its own, so the copy gets another one
+        sides[0].shared_pool = false;
+        sides[1] = sides[0];
+    }
+
+    bool concurrent_storage::write(const std::function<bool(storage&)>& change) {
+        std::lock_guard guard{writing};
+
+        // readers are on one side, change the other and move them there
+        size_t side = readable.load();
+        change(sides[1 - side]);
+        readable.store(1 - side);
+
+        // readers that arrived before the switch may still be on the old side:
+        // new readers announce themselves elsewhere, then the earlier ones are waited for
+        size_t version = current_version.load();
+        wait_for(indicators[1 - version]);
+        current_version.store(1 - version);
+        wait_for(indicators[version]);
+
+        return change(sides[side]);
+    }
+
+    bool concurrent_storage::add(std::string_view name, number_t number) {
+        return write([&](storage& contacts) { return contact_list::add(contacts, name, number); });
+    }
+
+    bool concurrent_storage::remove(std::string_view name) {
+        return write([&](storage& contacts) { return contact_list::remove(contacts, name); });
+    }
+
+    void concurrent_storage::sort() {
+        write([](storage& contacts) {
+            contact_list::sort(contacts);
+            return true;
+        });
+    }
+
+    void concurrent_storage::keep_sorted() {
+        write([](storage& contacts) {
+            contact_list::keep_sorted(contacts);
+            return true;
+        });
+    }
+
+    size_t concurrent_storage::size() const {
+        return read([](const storage& contacts) { return contact_list::size(contacts); });
+    }
+
+    // the lookups take the storage by reference, but don't modify it
+
+    number_t concurrent_storage::get_number_by_name(std::string_view name) const {
+        return read([&](const storage& contacts) {
+            return contact_list::get_number_by_name(const_cast<storage&>(contacts), name);
+        });
+    }
+
+    std::string concurrent_storage::get_name_by_number(number_t number) const {
+        return read([&](const storage& contacts) {
+            return contact_list::get_name_by_number(const_cast<storage&>(contacts), number);
+        });
+    }
+
+    std::string concurrent_storage::to_string() const {
+        return read([](const storage& contacts) { return contact_list::to_string(contacts); });
+    }
+
+} // namespace contact_list
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "contact_list.h"
+
+
+namespace contact_list {
+
+
+/**
+ * counts the readers of one side of a `concurrent_storage`.
+ *
+ * readers are spread over several counters on their own cache lines,
+ * so threads reading at the same time don't contend for one counter.
+ */
+class read_indicator {
+public:
+    static constexpr size_t counters = 16;
+
+    /** a reader starts, returns what to pass to `depart` */
+    size_t arrive();
+
+    /** the reader that got this from `arrive` is done */
+    void depart(size_t counter) {
+        readers[counter].count.fetch_sub(1, std::memory_order_release);
+    }
+
+    /** whether no reader is active */
+    bool empty() const;
+
+private:
+    struct alignas(64) counter {
+        std::atomic<size_t> count{0};
+    };
+
+    std::array<counter, counters> readers;
+};
+
+
+/**
+ * a contact list that many threads can query while others modify it.
+ *
+ * it keeps two copies of the storage (left-right concurrency control):
+ * readers use one of them without ever waiting, while writers, one at a
+ * time, modify the other, switch readers over to it, wait until no reader
+ * is left on the old copy and then repeat the change there.
+ *
+ * so lookups cost two atomic counter updates and never block,
+ * while each change is applied twice and waits for earlier readers.
+ * both copies have their own string pool, so memory use doubles.
+ */
+class concurrent_storage {
+public:
+    concurrent_storage() : concurrent_storage{storage{}} {}
+
+    /** the contacts are moved to new pools, so the storage may share its pool */
+    explicit concurrent_storage(storage contacts);
+
+    concurrent_storage(const concurrent_storage&) = delete;
+    concurrent_storage& operator=(const concurrent_storage&) = delete;
+
+    bool add(std::string_view name, number_t number);
+
+    bool remove(std::string_view name);
+
+    void sort();
+
+    void keep_sorted();
+
+    size_t size() const;
+
+    number_t get_number_by_name(std::string_view name) const;
+
+    std::string get_name_by_number(number_t number) const;
+
+    std::string to_string() const;
+
+    /**
+     * call the reader with the current contacts, which don't change while it runs.
+     * views into the storage must not be used once it returns.
+     */
+    template <typename reader_t>
+    decltype(auto) read(reader_t&& reader) const {
+        size_t version = current_version.load();
+        size_t counter = indicators[version].arrive();
+
+        struct departure {
+            read_indicator& indicator;
+            size_t counter;
+            ~departure() { indicator.depart(counter); }
+        } leave{indicators[version], counter};
+
+        return std::forward<reader_t>(reader)(std::as_const(sides[readable.load()]));
+    }
+
+    /**
+     * apply the change to both copies, and return its result.
+     * it has to have the same effect on both, so it may only depend on the storage.
+     */
+    bool write(const std::function<bool(storage&)>& change);
+
+private:
+    std::array<storage, 2> sides;
+
+    /** the copy readers use */
+    std::atomic<size_t> readable{0};
+
+    /** the indicator new readers announce themselves on */
+    std::atomic<size_t> current_version{0};
+
+    mutable std::array<read_indicator, 2> indicators;
+
+    /** held by the one writer */
+    std::mutex writing;
+};
+
+
+} // namespace contact_list
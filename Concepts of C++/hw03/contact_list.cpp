@@ -1,78 +1,478 @@
 #include "contact_list.h"
 
 #include <algorithm>
-#include <numeric>
-#include <sstream>
+#include <charconv>
+#include <stdexcept>
+#include <utility>
 
-// TODO create implementation here!
 
 namespace contact_list {
 
+    namespace {
+
+        std::string_view name_of(const storage& contacts, size_t slot) {
+            return contacts.pool->view(contacts.names[slot]);
+        }
+
+        // index the slots of all stored contacts
+        void rebuild_index(storage& contacts) {
+            contacts.name_index.clear();
+            contacts.number_index.clear();
+            contacts.name_index.reserve(contacts.names.size());
+            contacts.number_index.reserve(contacts.numbers.size());
+
+            for (size_t i = 0; i < contacts.names.size(); ++i) {
+                if (contacts.names[i].empty()) continue; // tombstone
+
+                contacts.name_index.emplace(name_of(contacts, i), i);
+
+                auto [entry, inserted] = contacts.number_index.try_emplace(contacts.numbers[i], number_slot{i, 1});
+                if (!inserted) entry->second.count += 1;
+            }
+
+            if (contacts.sorted) {
+                // the order of the names didn't change, just their slots and views
+                std::map<std::string_view, size_t> ordered;
+                for (const auto& [name, old_slot] : contacts.ordered) {
+                    auto indexed = contacts.name_index.find(name);
+                    ordered.emplace_hint(ordered.end(), indexed->first, indexed->second);
+                }
+                contacts.ordered = std::move(ordered);
+            }
+        }
+
+        // drop the tombstones, keeping the order of the contacts.
+        // an unshared pool is repacked with just the remaining names.
+        void compact(storage& contacts) {
+            bool repack = !contacts.shared_pool;
+
+            // the old pool stays alive until the index refers to the new one
+            std::shared_ptr<string_pool> previous = contacts.pool;
+            if (repack) {
+                contacts.pool = std::make_shared<string_pool>(previous->deduplicating());
+            }
+
+            size_t kept = 0;
+            for (size_t i = 0; i < contacts.names.size(); ++i) {
+                if (contacts.names[i].empty()) continue;
+
+                name_ref name = contacts.names[i];
+                if (repack) name = contacts.pool->store(previous->view(name));
+
+                contacts.names[kept] = name;
+                contacts.numbers[kept] = contacts.numbers[i];
+                kept += 1;
+            }
+
+            contacts.names.resize(kept);
+            contacts.numbers.resize(kept);
+            contacts.removed = 0;
+            rebuild_index(contacts);
+        }
+
+        // the contact in the given slot no longer has its number
+        void unindex_number(storage& contacts, size_t slot) {
+            number_t number = contacts.numbers[slot];
+            auto entry = contacts.number_index.find(number);
+
+            entry->second.count -= 1;
+            if (entry->second.count == 0) {
+                contacts.number_index.erase(entry);
+                return;
+            }
+
+            // another contact shares the number, find the next one holding it
+            if (entry->second.slot == slot) {
+                size_t next = slot + 1;
+                while (contacts.names[next].empty() || contacts.numbers[next] != number) ++next;
+                entry->second.slot = next;
+            }
+        }
+
+        // scan all contacts for those matching, then put them in name order
+        template <typename match_t>
+        std::vector<contact> find_unsorted(const storage& contacts, size_t limit, match_t matches) {
+            std::vector<contact> found;
+            for (size_t i = 0; i < contacts.names.size(); ++i) {
+                if (!contacts.names[i].empty() && matches(name_of(contacts, i))) {
+                    found.push_back({name_of(contacts, i), contacts.numbers[i]});
+                }
+            }
+
+            auto by_name = [](const contact& a, const contact& b) { return a.name < b.name; };
+            if (found.size() > limit) {
+                std::partial_sort(found.begin(), found.begin() + static_cast<ptrdiff_t>(limit), found.end(), by_name);
+                found.resize(limit);
+            } else {
+                std::sort(found.begin(), found.end(), by_name);
+            }
+            return found;
+        }
+
+        // call visit(name, number) for each contact, in the order to_string lists them
+        template <typename visit_t>
+        void for_each_contact(const storage& contacts, visit_t visit) {
+            if (contacts.sorted) {
+                for (const auto& [name, slot] : contacts.ordered) {
+                    visit(name, contacts.numbers[slot]);
+                }
+                return;
+            }
+
+            for (size_t i = 0; i < contacts.names.size(); ++i) {
+                if (contacts.names[i].empty()) continue; // tombstone
+                visit(name_of(contacts, i), contacts.numbers[i]);
+            }
+        }
+
+        // sort on up to the given number of threads:
+        // each sorts a part, then neighbouring parts are merged in parallel rounds
+        template <typename iterator_t, typename less_t>
+        void parallel_sort(iterator_t begin, iterator_t end, less_t less, size_t threads) {
+            // below this, starting threads costs more than it saves
+            constexpr size_t min_part = 16 * 1024;
+
+            size_t count = static_cast<size_t>(end - begin);
+            threads = std::clamp<size_t>(threads, 1, std::max<size_t>(count / min_part, 1));
+            if (threads == 1) {
+                std::sort(begin, end, less);
+                return;
+            }
+
+            std::vector<iterator_t> bounds;
+            for (size_t i = 0; i <= threads; ++i) {
+                bounds.push_back(begin + static_cast<ptrdiff_t>(count * i / threads));
+            }
+
+            {
+                std::vector<std::jthread> sorters;
+                for (size_t i = 0; i < threads; ++i) {
+                    sorters.emplace_back([&, i] { std::sort(bounds[i], bounds[i + 1], less); });
+                }
+            }
+
+            for (size_t width = 1; width < threads; width *= 2) {
+                std::vector<std::jthread> mergers;
+                for (size_t i = 0; i + width < threads; i += 2 * width) {
+                    iterator_t first = bounds[i];
+                    iterator_t middle = bounds[i + width];
+                    iterator_t last = bounds[std::min(i + 2 * width, threads)];
+                    mergers.emplace_back([=] { std::inplace_merge(first, middle, last, less); });
+                }
+            }
+        }
+
+        template <typename name_t>
+        size_t add_all(storage& contacts, std::span<const name_t> names, std::span<const number_t> numbers,
+                       size_t threads) {
+            if (names.size() != numbers.size()) {
+                throw std::invalid_argument{"got " + std::to_string(names.size()) + " names, but "
+                                            + std::to_string(numbers.size()) + " numbers"};
+            }
+
+            // the contacts that may be added, with their names next to them for sorting
+            struct candidate {
+                std::string_view name;
+                size_t index;
+            };
+            std::vector<candidate> candidates;
+            candidates.reserve(names.size());
+            for (size_t i = 0; i < names.size(); ++i) {
+                std::string_view name = names[i];
+                if (!name.empty() && !contacts.name_index.contains(name)) candidates.push_back({name, i});
+            }
+
+            // by name, and the first of equal names first
+            parallel_sort(candidates.begin(), candidates.end(), [](const candidate& a, const candidate& b) {
+                int order = a.name.compare(b.name);
+                return order < 0 || (order == 0 && a.index < b.index);
+            }, threads);
+
+            // the slot of each contact that is added, assigned in input order below
+            constexpr size_t skipped = std::numeric_limits<size_t>::max();
+            std::vector<size_t> slots(names.size(), skipped);
+            size_t added = 0;
+            for (size_t i = 0; i < candidates.size(); ++i) {
+                if (i == 0 || candidates[i].name != candidates[i - 1].name) {
+                    slots[candidates[i].index] = 0;
+                    added += 1;
+                }
+            }
+
+            // with the sizes known, nothing is reallocated or rehashed while adding
+            size_t first = contacts.names.size();
+            contacts.names.reserve(first + added);
+            contacts.numbers.reserve(first + added);
+            contacts.name_index.reserve(first + added);
+            contacts.number_index.reserve(first + added);
+
+            size_t slot = first;
+            for (size_t i = 0; i < names.size(); ++i) {
+                if (slots[i] == skipped) continue;
+
+                name_ref stored = contacts.pool->store(names[i]);
+                contacts.name_index.emplace(contacts.pool->view(stored), slot);
+                contacts.names.push_back(stored);
+                contacts.numbers.push_back(numbers[i]);
+
+                auto [entry, inserted] = contacts.number_index.try_emplace(numbers[i], number_slot{slot, 1});
+                if (!inserted) entry->second.count += 1;
+
+                slots[i] = slot;
+                slot += 1;
+            }
+
+            if (contacts.sorted) {
+                // in name order, most go right after the previous one
+                auto hint = contacts.ordered.end();
+                for (const candidate& added_contact : candidates) {
+                    size_t added_slot = slots[added_contact.index];
+                    if (added_slot == skipped) continue;
+
+                    std::string_view name = name_of(contacts, added_slot);
+                    bool after = hint != contacts.ordered.end() && hint->first < name;
+                    bool before = hint != contacts.ordered.begin() && std::prev(hint)->first > name;
+                    if (after || before) {
+                        hint = contacts.ordered.upper_bound(name);
+                    }
+                    hint = std::next(contacts.ordered.emplace_hint(hint, name, added_slot));
+                }
+            }
+            return added;
+        }
+    } // namespace
+
+    storage::storage(const storage& other)
+        : numbers{other.numbers},
+          names{other.names},
+          pool{other.pool},
+          shared_pool{other.shared_pool},
+          name_index{other.name_index},
+          number_index{other.number_index},
+          removed{other.removed},
+          sorted{other.sorted},
+          ordered{other.ordered} {
+        if (shared_pool) return;
+
+        // the index views still point into the other pool until it is rebuilt
+        pool = std::make_shared<string_pool>(other.pool->deduplicating());
+        for (name_ref& name : names) {
+            if (!name.empty()) name = pool->store(other.pool->view(name));
+        }
+        rebuild_index(*this);
+    }
+
+    storage& storage::operator=(const storage& other) {
+        if (this != &other) *this = storage{other};
+        return *this;
+    }
+
+    storage::storage(storage&& other)
+        : storage{} {
+        *this = std::move(other);
+    }
+
+    storage& storage::operator=(storage&& other) {
+        if (this == &other) return *this;
+
+        // the other stays usable, so it gets a pool of its own
+        std::shared_ptr<string_pool> fresh = std::make_shared<string_pool>();
+        numbers = std::exchange(other.numbers, {});
+        names = std::exchange(other.names, {});
+        pool = std::exchange(other.pool, std::move(fresh));
+        shared_pool = std::exchange(other.shared_pool, false);
+        name_index = std::exchange(other.name_index, {});
+        number_index = std::exchange(other.number_index, {});
+        removed = std::exchange(other.removed, 0);
+        sorted = std::exchange(other.sorted, false);
+        ordered = std::exchange(other.ordered, {});
+        return *this;
+    }
+
     bool add(storage& contacts, std::string_view name, number_t number) {
         if (name.empty()) return false;
 
-        auto it = std::find(contacts.names.begin(), contacts.names.end(), name);
-        if (it != contacts.names.end()) return false; // Disallow duplicate names
+        // Disallow duplicate names, before their copy takes up pool space
+        if (contacts.name_index.contains(name)) return false;
+
+        size_t slot = contacts.names.size();
+        name_ref stored = contacts.pool->store(name);
+        std::string_view pooled = contacts.pool->view(stored);
 
-        contacts.names.push_back(std::string(name));
+        contacts.name_index.emplace(pooled, slot);
+        contacts.names.push_back(stored);
         contacts.numbers.push_back(number);
+        if (contacts.sorted) contacts.ordered.emplace(pooled, slot);
+
+        auto [number_entry, new_number] = contacts.number_index.try_emplace(number, number_slot{slot, 1});
+        if (!new_number) number_entry->second.count += 1;
         return true;
     }
 
     size_t size(const storage& contacts) {
-        return contacts.names.size();
+        return contacts.names.size() - contacts.removed;
     }
 
     number_t get_number_by_name(storage& contacts, std::string_view name) {
-        auto it = std::find(contacts.names.begin(), contacts.names.end(), name);
-        if (it != contacts.names.end()) {
-            size_t index = std::distance(contacts.names.begin(), it);
-            return contacts.numbers[index];
+        auto it = contacts.name_index.find(name);
+        if (it != contacts.name_index.end()) {
+            return contacts.numbers[it->second];
         }
         return -1; // Name not found
     }
 
     std::string to_string(const storage& contacts) {
-        std::ostringstream oss;
-        for (size_t i = 0; i < contacts.names.size(); ++i) {
-            oss << contacts.names[i] << " - " << contacts.numbers[i] << "\n";
-        }
-        return oss.str();
+        std::string text;
+        to_string(contacts, [&](std::string_view chunk) { text.append(chunk); });
+        return text;
     }
 
     bool remove(storage& contacts, std::string_view name) {
-        auto it = std::find(contacts.names.begin(), contacts.names.end(), name);
-        if (it != contacts.names.end()) {
-            size_t index = std::distance(contacts.names.begin(), it);
-            contacts.names.erase(contacts.names.begin() + index);
-            contacts.numbers.erase(contacts.numbers.begin() + index);
+        auto it = contacts.name_index.find(name);
+        if (it != contacts.name_index.end()) {
+            size_t index = it->second;
+            unindex_number(contacts, index);
+            contacts.name_index.erase(it);
+            if (contacts.sorted) contacts.ordered.erase(contacts.ordered.find(name));
+
+            // leave a tombstone, so the other slots stay valid
+            contacts.names[index] = name_ref{};
+            contacts.removed += 1;
+
+            if (contacts.removed * 2 >= contacts.names.size()) {
+                compact(contacts);
+            }
             return true;
         }
         return false; // Name not found
     }
 
     void sort(storage& contacts) {
-        std::vector<std::pair<std::string, number_t>> temp;
+        if (contacts.sorted) return; // already in order
+
+        // the slots of all contacts, without tombstones
+        std::vector<size_t> order;
+        order.reserve(size(contacts));
         for (size_t i = 0; i < contacts.names.size(); ++i) {
-            temp.emplace_back(contacts.names[i], contacts.numbers[i]);
+            if (!contacts.names[i].empty()) order.push_back(i);
         }
 
-        std::sort(temp.begin(), temp.end(), [](const auto& a, const auto& b) {
-            return a.first < b.first;
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return name_of(contacts, a) < name_of(contacts, b);
         });
 
-        for (size_t i = 0; i < temp.size(); ++i) {
-            contacts.names[i] = temp[i].first;
-            contacts.numbers[i] = temp[i].second;
+        std::vector<name_ref> names;
+        std::vector<number_t> numbers;
+        names.reserve(order.size());
+        numbers.reserve(order.size());
+        for (size_t i : order) {
+            names.push_back(contacts.names[i]);
+            numbers.push_back(contacts.numbers[i]);
         }
+
+        contacts.names = std::move(names);
+        contacts.numbers = std::move(numbers);
+        contacts.removed = 0;
+        rebuild_index(contacts);
     }
 
     std::string get_name_by_number(storage& contacts, number_t number) {
-        auto it = std::find(contacts.numbers.begin(), contacts.numbers.end(), number);
-        if (it != contacts.numbers.end()) {
-            size_t index = std::distance(contacts.numbers.begin(), it);
-            return contacts.names[index];
+        auto it = contacts.number_index.find(number);
+        if (it != contacts.number_index.end()) {
+            return std::string(name_of(contacts, it->second.slot));
         }
         return ""; // Number not found
     }
+
+    void use_pool(storage& contacts, std::shared_ptr<string_pool> pool) {
+        std::shared_ptr<string_pool> previous = std::exchange(contacts.pool, std::move(pool));
+        contacts.shared_pool = true;
+        for (name_ref& name : contacts.names) {
+            if (!name.empty()) name = contacts.pool->store(previous->view(name));
+        }
+        rebuild_index(contacts);
+    }
+
+    void keep_sorted(storage& contacts) {
+        if (contacts.sorted) return;
+
+        contacts.sorted = true;
+        contacts.ordered.clear();
+        for (const auto& [name, slot] : contacts.name_index) {
+            contacts.ordered.emplace(name, slot);
+        }
+    }
+
+    std::vector<contact> find_prefix(const storage& contacts, std::string_view prefix, size_t limit) {
+        if (!contacts.sorted) {
+            return find_unsorted(contacts, limit, [&](std::string_view name) {
+                return name.starts_with(prefix);
+            });
+        }
+
+        // names with the prefix follow each other, starting at the prefix itself
+        std::vector<contact> found;
+        for (auto it = contacts.ordered.lower_bound(prefix);
+             it != contacts.ordered.end() && found.size() < limit && it->first.starts_with(prefix); ++it) {
+            found.push_back({it->first, contacts.numbers[it->second]});
+        }
+        return found;
+    }
+
+    std::vector<contact> find_range(const storage& contacts, std::string_view first, std::string_view last,
+                                    size_t limit) {
+        if (!contacts.sorted) {
+            return find_unsorted(contacts, limit, [&](std::string_view name) {
+                return first <= name && name < last;
+            });
+        }
+
+        std::vector<contact> found;
+        for (auto it = contacts.ordered.lower_bound(first);
+             it != contacts.ordered.end() && found.size() < limit && it->first < last; ++it) {
+            found.push_back({it->first, contacts.numbers[it->second]});
+        }
+        return found;
+    }
+
+    size_t add_all(storage& contacts, std::span<const std::string_view> names, std::span<const number_t> numbers,
+                   size_t threads) {
+        return add_all<std::string_view>(contacts, names, numbers, threads);
+    }
+
+    size_t add_all(storage& contacts, std::span<const std::string> names, std::span<const number_t> numbers,
+                   size_t threads) {
+        return add_all<std::string>(contacts, names, numbers, threads);
+    }
+
+    void to_string(const storage& contacts, const writer_t& writer, size_t chunk_size) {
+        // longest number with its separators
+        constexpr size_t number_size = 24;
+
+        std::string chunk;
+        chunk.reserve(chunk_size + number_size);
+
+        for_each_contact(contacts, [&](std::string_view name, number_t number) {
+            chunk.append(name);
+            chunk.append(" - ");
+
+            char digits[number_size];
+            auto [end, error] = std::to_chars(std::begin(digits), std::end(digits), number);
+            chunk.append(digits, end);
+            chunk.push_back('\n');
+
+            if (chunk.size() >= chunk_size) {
+                writer(chunk);
+                chunk.clear();
+            }
+        });
+
+        if (!chunk.empty()) writer(chunk);
+    }
+
+    void to_string(const storage& contacts, std::ostream& out) {
+        to_string(contacts, [&](std::string_view chunk) {
+            out.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+        });
+    }
 } // namespace contact_list
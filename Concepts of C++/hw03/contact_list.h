@@ -1,10 +1,20 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <span>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
+#include "string_pool.h"
+
 
 /**
  * this namespace contains all contact list features and internal types.
@@ -18,16 +28,85 @@ namespace contact_list {
 using number_t = int64_t;
 
 
+/**
+ * where a number is stored. numbers may be shared by several contacts,
+ * the index then refers to the first of them.
+ */
+struct number_slot {
+    size_t slot;
+    size_t count;
+};
+
+
 /**
  * stores contacts by saving names and numbers.
  * be careful - these vectors have to be kept in sync!
  *
  * you may adjust this struct to store the data differently, or add index structures, ...
  * this is fine as long as the API of the functions below remains the same.
+ *
+ * the names are kept in a `string_pool`, the indexes refer to them by
+ * views into the pool. a copy of the storage gets a pool of its own, so
+ * copies can be modified independently, e.g. on different threads.
+ * a pool is only shared if it was given to several storages with `use_pool`,
+ * and copies of these keep sharing it.
+ *
+ * removed contacts leave a tombstone, an empty name, so the slots of the
+ * others stay valid and their order is kept. once tombstones make up half
+ * of the slots, the vectors are compacted, and so is the pool, unless it is
+ * shared.
+ *
+ * a storage can be switched to keep its contacts sorted, see `keep_sorted`.
  */
 struct storage {
+    storage() = default;
+
+    /** copies the names to a new pool, unless the pool is shared */
+    storage(const storage& other);
+    storage& operator=(const storage& other);
+
+    /** takes the contacts and pool, and leaves the other empty with a new pool */
+    storage(storage&& other);
+    storage& operator=(storage&& other);
+
     std::vector<number_t> numbers;
-    std::vector<std::string> names;
+    std::vector<name_ref> names;
+
+    /** where the names are stored */
+    std::shared_ptr<string_pool> pool = std::make_shared<string_pool>();
+
+    /** whether the pool was given with `use_pool`, so other storages may use it too */
+    bool shared_pool = false;
+
+    /** slot of each stored name */
+    std::unordered_map<std::string_view, size_t> name_index;
+
+    /** first slot of each stored number */
+    std::unordered_map<number_t, number_slot> number_index;
+
+    /** number of tombstones in the vectors */
+    size_t removed = 0;
+
+    /** whether the contacts are kept in name order, in `ordered` */
+    bool sorted = false;
+
+    /** slot of each stored name, in name order. only kept when sorted. */
+    std::map<std::string_view, size_t> ordered;
+};
+
+
+/**
+ * receives the text of `to_string` piece by piece.
+ */
+using writer_t = std::function<void(std::string_view)>;
+
+
+/**
+ * a contact found by a query, valid until the storage is modified.
+ */
+struct contact {
+    std::string_view name;
+    number_t number;
 };
 
 
@@ -77,4 +156,82 @@ void sort(storage& contacts);
 std::string get_name_by_number(storage& contacts, number_t number);
 
 
+/**
+ * move the names of the contacts to the given pool, e.g. one shared by
+ * several storages, which then store common names only once if the pool
+ * deduplicates.
+ *
+ * the pool counts as shared from then on: copies of the storage use it too,
+ * and it isn't repacked on compaction. storages sharing a pool must not be
+ * modified on different threads at the same time.
+ */
+void use_pool(storage& contacts, std::shared_ptr<string_pool> pool);
+
+
+/**
+ * keep the contacts sorted by name from now on.
+ *
+ * contacts are then inserted at their place in name order, so `to_string`
+ * lists them sorted, `sort` has nothing left to do, and queries by name
+ * take O(log n + k) for k results.
+ * of several contacts sharing a number, `get_name_by_number` still finds
+ * the one added first, not the first in name order.
+ */
+void keep_sorted(storage& contacts);
+
+
+/**
+ * all contacts whose name starts with the given prefix, in name order.
+ * names are compared bytewise, so UTF-8 prefixes like "Mü" work.
+ *
+ * unless the storage is kept sorted, this scans all contacts.
+ *
+ * @param limit: return at most this many contacts
+ */
+std::vector<contact> find_prefix(const storage& contacts, std::string_view prefix,
+                                 size_t limit = std::numeric_limits<size_t>::max());
+
+
+/**
+ * all contacts with names in [first, last), in name order.
+ *
+ * unless the storage is kept sorted, this scans all contacts.
+ */
+std::vector<contact> find_range(const storage& contacts, std::string_view first, std::string_view last,
+                                size_t limit = std::numeric_limits<size_t>::max());
+
+
+
+
+/**
+ * add many contacts at once, like calling `add` for each of them in order:
+ * empty names and names already stored are skipped, and of several
+ * contacts with the same name, only the first is added.
+ *
+ * the duplicates are found by sorting the names on several threads, then
+ * the contacts are appended and indexed with the final sizes known.
+ *
+ * @return the number of contacts added
+ * @throw std::invalid_argument if there aren't as many names as numbers
+ */
+size_t add_all(storage& contacts, std::span<const std::string_view> names, std::span<const number_t> numbers,
+               size_t threads = std::thread::hardware_concurrency());
+
+size_t add_all(storage& contacts, std::span<const std::string> names, std::span<const number_t> numbers,
+               size_t threads = std::thread::hardware_concurrency());
+
+
+/**
+ * write the text of `to_string` to the writer, in chunks of about the given size,
+ * without building the whole text.
+ */
+void to_string(const storage& contacts, const writer_t& writer, size_t chunk_size = 64 * 1024);
+
+
+/**
+ * write the text of `to_string` to the stream, chunk by chunk.
+ */
+void to_string(const storage& contacts, std::ostream& out);
+
+
 } // namespace contact_list
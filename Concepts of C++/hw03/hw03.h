@@ -1,3 +1,6 @@
 #pragma once
 
+#include "concurrent.h"
 #include "contact_list.h"
+#include "snapshot.h"
+#include "string_pool.h"
@@ -0,0 +1,412 @@
+#include "snapshot.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <system_error>
+#include <type_traits>
+
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HW03_HAVE_MMAP 1
+#endif
+
+
+namespace contact_list {
+
+    namespace {
+        // numbers are used in place, as the 64 bit values they are written as
+        static_assert(std::is_same_v<number_t, int64_t>);
+
+        constexpr std::array<char, 8> magic{'C', 'O', 'N', 'T', 'A', 'C', 'T', 'S'};
+        constexpr uint32_t format_version = 1;
+
+        // stored in native byte order, so reading it tells whether that matches ours
+        constexpr uint32_t byte_order_mark = 0x01020304;
+
+        // marks an empty hash table bucket, the others hold a slot
+        constexpr uint64_t empty_bucket = std::numeric_limits<uint64_t>::max();
+
+        // start of each snapshot file
+        struct header {
+            std::array<char, 8> magic;
+            uint32_t version;
+            uint32_t byte_order;
+
+            uint64_t count;
+            uint64_t sorted;
+
+            // sizes of the hash tables, powers of two
+            uint64_t name_buckets;
+            uint64_t number_buckets;
+
+            uint64_t text_size;
+
+            // FNV-1a hash of all bytes after the header
+            uint64_t checksum;
+        };
+
+        uint64_t fnv1a(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325) {
+            auto bytes = static_cast<const unsigned char*>(data);
+            for (size_t i = 0; i < size; ++i) {
+                hash ^= bytes[i];
+                hash *= 0x100000001b3;
+            }
+            return hash;
+        }
+
+        // the hashes are part of the format, so they can't be std::hash
+
+        uint64_t hash_name(std::string_view name) {
+            return fnv1a(name.data(), name.size());
+        }
+
+        uint64_t hash_number(number_t number) {
+            // splitmix64 finalizer, spreads consecutive numbers over the table
+            auto hash = static_cast<uint64_t>(number);
+            hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9;
+            hash = (hash ^ (hash >> 27)) * 0x94d049bb133111eb;
+            return hash ^ (hash >> 31);
+        }
+
+        // at most half of the buckets are used, so probe sequences stay short
+        uint64_t bucket_count(size_t count) {
+            return std::bit_ceil(std::max<uint64_t>(2 * count, 1));
+        }
+
+        // put the slot in the first free bucket after the hash
+        void insert(std::vector<uint64_t>& table, uint64_t hash, uint64_t slot) {
+            uint64_t mask = table.size() - 1;
+            uint64_t bucket = hash & mask;
+            while (table[bucket] != empty_bucket) {
+                bucket = (bucket + 1) & mask;
+            }
+            table[bucket] = slot;
+        }
+
+        template <typename value_t>
+        void write_values(std::ostream& output, const std::vector<value_t>& values) {
+            output.write(reinterpret_cast<const char*>(values.data()),
+                         static_cast<std::streamsize>(values.size() * sizeof(value_t)));
+        }
+
+        // a table the lookups can probe: slots of stored contacts, and an empty bucket ending each probe
+        bool valid_table(std::span<const uint64_t> table, uint64_t count) {
+            bool empty = false;
+            for (uint64_t slot : table) {
+                if (slot == empty_bucket) {
+                    empty = true;
+                } else if (slot >= count) {
+                    return false;
+                }
+            }
+            return empty;
+        }
+
+        template <typename value_t>
+        uint64_t hash_values(const std::vector<value_t>& values, uint64_t hash) {
+            return fnv1a(values.data(), values.size() * sizeof(value_t), hash);
+        }
+    } // namespace
+
+    void save(const storage& contacts, std::ostream& output) {
+        // the slot of each contact in the snapshot, where tombstones are dropped
+        std::vector<uint64_t> slots(contacts.names.size(), empty_bucket);
+
+        std::vector<uint64_t> name_ends;
+        std::vector<number_t> numbers;
+        std::string text;
+        name_ends.reserve(size(contacts));
+        numbers.reserve(size(contacts));
+
+        for (size_t i = 0; i < contacts.names.size(); ++i) {
+            if (contacts.names[i].empty()) continue; // tombstone
+
+            slots[i] = numbers.size();
+            text.append(contacts.pool->view(contacts.names[i]));
+            name_ends.push_back(text.size());
+            numbers.push_back(contacts.numbers[i]);
+        }
+
+        std::vector<uint64_t> name_table(bucket_count(numbers.size()), empty_bucket);
+        std::vector<uint64_t> number_table(bucket_count(numbers.size()), empty_bucket);
+        for (size_t slot = 0; slot < numbers.size(); ++slot) {
+            size_t start = slot == 0 ? 0 : name_ends[slot - 1];
+            insert(name_table, hash_name(std::string_view{text}.substr(start, name_ends[slot] - start)), slot);
+        }
+        for (const auto& [number, first] : contacts.number_index) {
+            insert(number_table, hash_number(number), slots[first.slot]);
+        }
+
+        std::vector<uint64_t> order;
+        if (contacts.sorted) {
+            order.reserve(numbers.size());
+            for (const auto& [name, slot] : contacts.ordered) {
+                order.push_back(slots[slot]);
+            }
+        }
+
+        uint64_t checksum = fnv1a(text.data(), text.size(),
+            hash_values(order, hash_values(number_table, hash_values(name_table,
+                hash_values(numbers, hash_values(name_ends, 0xcbf29ce484222325))))));
+
+        header head{
+            magic,
+            format_version,
+            byte_order_mark,
+            numbers.size(),
+            contacts.sorted,
+            name_table.size(),
+            number_table.size(),
+            text.size(),
+            checksum,
+        };
+
+        output.write(reinterpret_cast<const char*>(&head), sizeof(head));
+        write_values(output, name_ends);
+        write_values(output, numbers);
+        write_values(output, name_table);
+        write_values(output, number_table);
+        write_values(output, order);
+        output.write(text.data(), static_cast<std::streamsize>(text.size()));
+    }
+
+    void save(const storage& contacts, const std::string& path) {
+        std::ofstream output{path, std::ios::binary};
+        save(contacts, output);
+        if (!output) {
+            throw std::runtime_error{"failed to write snapshot to " + path};
+        }
+    }
+
+#ifdef HW03_HAVE_MMAP
+
+    mapped_file::mapped_file(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::system_error{errno, std::generic_category(), "open " + path};
+        }
+
+        struct stat info;
+        if (::fstat(fd, &info) < 0) {
+            int error = errno;
+            ::close(fd);
+            throw std::system_error{error, std::generic_category(), "stat " + path};
+        }
+
+        size_ = static_cast<size_t>(info.st_size);
+
+        // empty files can't be mapped, but there's nothing to map anyway
+        if (size_ > 0) {
+            void* address = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+            if (address == MAP_FAILED) {
+                int error = errno;
+                ::close(fd);
+                throw std::system_error{error, std::generic_category(), "mmap " + path};
+            }
+            data_ = static_cast<const std::byte*>(address);
+        }
+
+        // the mapping stays valid after closing
+        ::close(fd);
+    }
+
+    mapped_file::~mapped_file() {
+        if (data_ != nullptr) {
+            ::munmap(const_cast<std::byte*>(data_), size_);
+        }
+    }
+
+#else
+
+    mapped_file::mapped_file(const std::string& path) {
+        std::ifstream file{path, std::ios::binary | std::ios::ate};
+        if (!file) {
+            throw std::system_error{ENOENT, std::generic_category(), "open " + path};
+        }
+
+        size_ = static_cast<size_t>(file.tellg());
+        fallback_.resize((size_ + 7) / 8);
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(fallback_.data()), static_cast<std::streamsize>(size_));
+
+        data_ = reinterpret_cast<const std::byte*>(fallback_.data());
+    }
+
+    mapped_file::~mapped_file() = default;
+
+#endif
+
+    snapshot::snapshot(const std::string& path, bool verify_checksum) : file_{path} {
+        if (file_.size() < sizeof(header)) {
+            throw invalid_snapshot{path + " is no snapshot file"};
+        }
+        header head;
+        std::memcpy(&head, file_.data(), sizeof(head));
+
+        if (head.magic != magic) {
+            throw invalid_snapshot{path + " is no snapshot file"};
+        }
+        if (head.version != format_version) {
+            throw invalid_snapshot{"unsupported snapshot version " + std::to_string(head.version)};
+        }
+        if (head.byte_order != byte_order_mark) {
+            throw invalid_snapshot{"snapshot was written on a machine with different byte order"};
+        }
+
+        // compared one by one, so huge values in a broken header can't overflow the sum
+        size_t values = (file_.size() - sizeof(header)) / sizeof(uint64_t);
+        uint64_t order_count = head.sorted ? head.count : 0;
+        if (head.count > values || head.name_buckets > values || head.number_buckets > values ||
+            head.text_size > file_.size() ||
+            !std::has_single_bit(head.name_buckets) || !std::has_single_bit(head.number_buckets) ||
+            sizeof(header) + (2 * head.count + head.name_buckets + head.number_buckets + order_count)
+                             * sizeof(uint64_t) + head.text_size != file_.size()) {
+            throw invalid_snapshot{"snapshot file size doesn't match its header"};
+        }
+
+        if (verify_checksum &&
+            head.checksum != fnv1a(file_.data() + sizeof(header), file_.size() - sizeof(header))) {
+            throw invalid_snapshot{"snapshot checksum mismatch"};
+        }
+
+        // the mapping is page aligned and the header a multiple of 8 bytes,
+        // so all the tables are aligned for their values
+        static_assert(sizeof(header) % alignof(uint64_t) == 0);
+        auto values_at = reinterpret_cast<const uint64_t*>(file_.data() + sizeof(header));
+
+        name_ends_ = {values_at, head.count};
+        values_at += head.count;
+        numbers_ = {reinterpret_cast<const number_t*>(values_at), head.count};
+        values_at += head.count;
+        name_table_ = {values_at, head.name_buckets};
+        values_at += head.name_buckets;
+        number_table_ = {values_at, head.number_buckets};
+        values_at += head.number_buckets;
+        order_ = {values_at, order_count};
+        values_at += order_count;
+        text_ = {reinterpret_cast<const char*>(values_at), head.text_size};
+
+        sorted_ = head.sorted != 0;
+
+        // the lookups use the tables without checks, so they are checked once here.
+        // a matching checksum doesn't mean the file was written by `save`.
+        uint64_t previous_end = 0;
+        for (uint64_t end : name_ends_) {
+            if (end < previous_end) {
+                throw invalid_snapshot{"snapshot names overlap"};
+            }
+            previous_end = end;
+        }
+        if (previous_end != head.text_size) {
+            throw invalid_snapshot{"snapshot names don't match their text"};
+        }
+        if (!valid_table(name_table_, head.count) || !valid_table(number_table_, head.count)) {
+            throw invalid_snapshot{"snapshot hash table is broken"};
+        }
+        if (std::any_of(order_.begin(), order_.end(), [&](uint64_t slot) { return slot >= head.count; })) {
+            throw invalid_snapshot{"snapshot name order is broken"};
+        }
+    }
+
+    std::string_view snapshot::name(size_t slot) const {
+        size_t start = slot == 0 ? 0 : name_ends_[slot - 1];
+        return text_.substr(start, name_ends_[slot] - start);
+    }
+
+    number_t snapshot::get_number_by_name(std::string_view name) const {
+        uint64_t mask = name_table_.size() - 1;
+        for (uint64_t bucket = hash_name(name) & mask; name_table_[bucket] != empty_bucket;
+             bucket = (bucket + 1) & mask) {
+            uint64_t slot = name_table_[bucket];
+            if (this->name(slot) == name) return numbers_[slot];
+        }
+        return -1; // Name not found
+    }
+
+    std::string_view snapshot::get_name_by_number(number_t number) const {
+        uint64_t mask = number_table_.size() - 1;
+        for (uint64_t bucket = hash_number(number) & mask; number_table_[bucket] != empty_bucket;
+             bucket = (bucket + 1) & mask) {
+            uint64_t slot = number_table_[bucket];
+            if (numbers_[slot] == number) return name(slot);
+        }
+        return {}; // Number not found
+    }
+
+    std::string snapshot::to_string() const {
+        std::string text;
+        to_string([&](std::string_view chunk) { text.append(chunk); });
+        return text;
+    }
+
+    void snapshot::to_string(const writer_t& writer, size_t chunk_size) const {
+        // longest number with its separators
+        constexpr size_t number_size = 24;
+
+        std::string chunk;
+        chunk.reserve(chunk_size + number_size);
+
+        auto append = [&](size_t slot) {
+            chunk.append(name(slot));
+            chunk.append(" - ");
+
+            char digits[number_size];
+            auto [end, error] = std::to_chars(std::begin(digits), std::end(digits), numbers_[slot]);
+            chunk.append(digits, end);
+            chunk.push_back('\n');
+
+            if (chunk.size() >= chunk_size) {
+                writer(chunk);
+                chunk.clear();
+            }
+        };
+
+        if (sorted_) {
+            for (uint64_t slot : order_) append(slot);
+        } else {
+            for (size_t slot = 0; slot < size(); ++slot) append(slot);
+        }
+
+        if (!chunk.empty()) writer(chunk);
+    }
+
+    storage snapshot::load() const {
+        storage contacts;
+        contacts.names.reserve(size());
+        contacts.numbers.assign(numbers_.begin(), numbers_.end());
+        contacts.name_index.reserve(size());
+        contacts.number_index.reserve(size());
+
+        // the names are unique, so they go into the index without checks
+        for (size_t slot = 0; slot < size(); ++slot) {
+            name_ref stored = contacts.pool->store(name(slot));
+            contacts.names.push_back(stored);
+            contacts.name_index.emplace(contacts.pool->view(stored), slot);
+
+            auto [entry, inserted] = contacts.number_index.try_emplace(numbers_[slot], number_slot{slot, 1});
+            if (!inserted) entry->second.count += 1;
+        }
+
+        if (sorted_) {
+            contacts.sorted = true;
+            for (uint64_t slot : order_) {
+                contacts.ordered.emplace_hint(contacts.ordered.end(), contacts.pool->view(contacts.names[slot]), slot);
+            }
+        }
+        return contacts;
+    }
+
+    storage load(const std::string& path) {
+        return snapshot{path}.load();
+    }
+
+} // namespace contact_list
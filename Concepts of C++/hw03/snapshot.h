@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "contact_list.h"
+
+
+namespace contact_list {
+
+
+/**
+ * exception thrown when a snapshot file is malformed.
+ */
+struct invalid_snapshot : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+
+/**
+ * store the contacts in the binary snapshot format.
+ *
+ * the file starts with a header, followed by the end offset of each name,
+ * the numbers, open addressing hash tables from names and numbers to
+ * contacts, the contacts in name order if the storage is kept sorted,
+ * and finally all names back to back. everything but the names is
+ * stored as 64 bit values in native byte order, so it can be used right
+ * from a memory mapping. removed contacts aren't stored.
+ */
+void save(const storage& contacts, std::ostream& output);
+
+
+/**
+ * store the contacts in the given snapshot file.
+ */
+void save(const storage& contacts, const std::string& path);
+
+
+/**
+ * read-only memory mapping of a whole file.
+ * where mmap is unavailable, the file is read into memory instead.
+ */
+class mapped_file {
+public:
+    explicit mapped_file(const std::string& path);
+    ~mapped_file();
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    const std::byte* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const std::byte* data_ = nullptr;
+    size_t size_ = 0;
+
+    /** file contents when they couldn't be mapped, aligned like a mapping */
+    std::vector<uint64_t> fallback_;
+};
+
+
+/**
+ * a memory-mapped snapshot file, answering queries without loading it.
+ *
+ * opening it checks the header and that the tables only refer to stored
+ * contacts. the lookups use the hash tables in the file, so processes using
+ * the same snapshot share its pages.
+ * call `load` for a storage that can be modified.
+ */
+class snapshot {
+public:
+    /**
+     * map the file and check it.
+     * checksum verification hashes the whole file again - skip it for trusted files.
+     * @throw invalid_snapshot if the file is malformed, checked or not.
+     */
+    explicit snapshot(const std::string& path, bool verify_checksum = true);
+
+    size_t size() const { return numbers_.size(); }
+
+    /** whether the contacts were kept sorted when saved */
+    bool sorted() const { return sorted_; }
+
+    /** number of the contact with the given name, -1 if there is none */
+    number_t get_number_by_name(std::string_view name) const;
+
+    /** name of the first contact with the given number, empty if there is none */
+    std::string_view get_name_by_number(number_t number) const;
+
+    /** same text as `to_string` of the saved storage */
+    std::string to_string() const;
+
+    void to_string(const writer_t& writer, size_t chunk_size = 64 * 1024) const;
+
+    /** a storage with the contacts, kept sorted if the saved one was */
+    storage load() const;
+
+private:
+    std::string_view name(size_t slot) const;
+
+    mapped_file file_;
+
+    std::span<const uint64_t> name_ends_;
+    std::span<const number_t> numbers_;
+    std::span<const uint64_t> name_table_;
+    std::span<const uint64_t> number_table_;
+    std::span<const uint64_t> order_;
+    std::string_view text_;
+
+    bool sorted_ = false;
+};
+
+
+/**
+ * a storage with the contacts of the given snapshot file.
+ */
+storage load(const std::string& path);
+
+
+} // namespace contact_list
@@ -0,0 +1,67 @@
+#include "string_pool.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+
+namespace contact_list {
+
+    namespace {
+
+        // offsets have the bits of a name_ref left by its length
+        constexpr uint64_t max_offset = (uint64_t{1} << (64 - name_ref::length_bits)) - 1;
+    } // namespace
+
+    string_pool::string_pool(bool deduplicate)
+        : deduplicate{deduplicate} {}
+
+    name_ref string_pool::store(std::string_view text) {
+        if (text.empty()) return {};
+        if (text.size() > name_ref::max_length) {
+            throw std::length_error{"string of " + std::to_string(text.size()) + " bytes is too long for the pool"};
+        }
+
+        if (deduplicate) {
+            auto existing = stored.find(text);
+            if (existing != stored.end()) return existing->second;
+        }
+
+        uint64_t length = text.size();
+        size_t block;
+        uint64_t offset_in_block;
+
+        if (length > block_size) {
+            // too long to share a block, the current one stays in use
+            block = blocks.size();
+            offset_in_block = 0;
+            blocks.push_back(std::make_unique_for_overwrite<char[]>(length));
+            allocated_bytes += length;
+        } else {
+            if (current_used + length > block_size) {
+                current = blocks.size();
+                current_used = 0;
+                blocks.push_back(std::make_unique_for_overwrite<char[]>(block_size));
+                allocated_bytes += block_size;
+            }
+            block = current;
+            offset_in_block = current_used;
+            current_used += length;
+        }
+
+        uint64_t offset = (uint64_t{block} << block_bits) | offset_in_block;
+        if (offset > max_offset) {
+            throw std::length_error{"string pool is full"};
+        }
+
+        char* destination = blocks[block].get() + offset_in_block;
+        std::memcpy(destination, text.data(), length);
+        used_bytes += length;
+
+        name_ref ref{offset, length};
+        if (deduplicate) {
+            stored.emplace(std::string_view{destination, length}, ref);
+        }
+        return ref;
+    }
+} // namespace contact_list
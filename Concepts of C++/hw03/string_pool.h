@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+namespace contact_list {
+
+
+/**
+ * where a string is stored in a `string_pool`, packed into 8 bytes.
+ * the empty reference, with length 0, refers to no string.
+ */
+class name_ref {
+public:
+    static constexpr int length_bits = 24;
+    static constexpr uint64_t max_length = (uint64_t{1} << length_bits) - 1;
+
+    name_ref() = default;
+
+    name_ref(uint64_t offset, uint64_t length)
+        : bits{(offset << length_bits) | length} {}
+
+    /** position of the first byte in the pool */
+    uint64_t offset() const { return bits >> length_bits; }
+
+    uint64_t length() const { return bits & max_length; }
+
+    bool empty() const { return length() == 0; }
+
+private:
+    uint64_t bits = 0;
+};
+
+
+/**
+ * an arena for strings that are never freed individually.
+ *
+ * strings are copied back to back into large blocks, which never move,
+ * so views of stored strings stay valid as long as the pool exists.
+ * strings longer than a block get a block of their own.
+ *
+ * when deduplicating, storing a string that is already in the pool
+ * returns the existing copy instead. this costs a hash table entry per
+ * string, so it pays off for pools shared by storages with common names.
+ */
+class string_pool {
+public:
+    /** size of the blocks strings are stored in */
+    static constexpr int block_bits = 20;
+    static constexpr uint64_t block_size = uint64_t{1} << block_bits;
+
+    explicit string_pool(bool deduplicate = false);
+
+    string_pool(const string_pool&) = delete;
+    string_pool& operator=(const string_pool&) = delete;
+
+    /**
+     * copy a string into the pool.
+     * @throw std::length_error for strings of more than `name_ref::max_length` bytes.
+     */
+    name_ref store(std::string_view text);
+
+    /** the stored string, or an empty one for the empty reference */
+    std::string_view view(name_ref ref) const {
+        if (ref.empty()) return {};
+        const char* block = blocks[ref.offset() >> block_bits].get();
+        return {block + (ref.offset() & (block_size - 1)), ref.length()};
+    }
+
+    bool deduplicating() const { return deduplicate; }
+
+    /** bytes of all stored strings */
+    size_t used() const { return used_bytes; }
+
+    /** bytes allocated for blocks, including unused space at their ends */
+    size_t allocated() const { return allocated_bytes; }
+
+private:
+    bool deduplicate;
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+
+    /** the block strings are currently added to, and how much of it is used */
+    size_t current = 0;
+    uint64_t current_used = block_size;
+
+    size_t used_bytes = 0;
+    size_t allocated_bytes = 0;
+
+    /** the strings stored so far, when deduplicating */
+    std::unordered_map<std::string_view, name_ref> stored;
+};
+
+
+} // namespace contact_list
@@ -0,0 +1,149 @@
+#include "assembler.h"
+
+#include <array>
+#include <cctype>
+#include <charconv>
+
+#include "superinstructions.h"
+#include "util.h"
+
+
+namespace vm {
+
+namespace {
+
+/**
+ * parse an instruction argument like `std::stoll` does: leading whitespace
+ * and a plus sign are allowed, anything after the number is ignored.
+ */
+item_t parse_argument(std::string_view word) {
+    auto begin = word.data();
+    auto end = word.data() + word.size();
+
+    while (begin != end and std::isspace(static_cast<unsigned char>(*begin))) {
+        ++begin;
+    }
+    if (begin != end and *begin == '+') {
+        ++begin;
+        if (begin == end or *begin == '-') {
+            throw invalid_instruction{"invalid instruction argument: " + std::string{word}};
+        }
+    }
+
+    item_t value;
+    auto [ptr, error] = std::from_chars(begin, end, value);
+    if (error != std::errc{}) {
+        throw invalid_instruction{"invalid instruction argument: " + std::string{word}};
+    }
+    return value;
+}
+
+} // namespace
+
+
+assembler::assembler(const vm_state& vm)
+    :
+    vm{vm} {}
+
+
+void assembler::feed(std::string_view text) {
+    util::delimiter_scanner newlines{text, '\n'};
+
+    for (size_t start = 0; start < text.size();) {
+        size_t newline = newlines.next();
+        if (newline == text.size()) {
+            partial.append(text.substr(start));
+            return;
+        }
+
+        if (partial.empty()) {
+            assemble_line(text.substr(start, newline - start));
+        } else {
+            partial.append(text.substr(start, newline - start));
+            assemble_line(partial);
+            partial.clear();
+        }
+
+        start = newline + 1;
+    }
+}
+
+
+code_t assembler::finish() {
+    // like std::getline, a last line without newline counts if it's not empty
+    if (not partial.empty()) {
+        assemble_line(partial);
+        partial.clear();
+    }
+
+    if (vm.superinstructions) {
+        return fuse_superinstructions(vm, code);
+    }
+    return std::move(code);
+}
+
+
+void assembler::assemble_line(std::string_view line) {
+    if (line.empty()) {
+        throw invalid_instruction{"empty line"};
+    }
+
+    // split at each space. like std::getline, an empty word after the last
+    // space doesn't count, but empty words between spaces do.
+    std::array<std::string_view, 2> words;
+    size_t word_count = 0;
+
+    for (size_t start = 0; start < line.size();) {
+        size_t space = line.find(' ', start);
+        if (space == std::string_view::npos) {
+            space = line.size();
+        }
+
+        // only support instruction and one argument
+        if (word_count == words.size()) {
+            throw invalid_instruction{std::string{"more than one instruction argument: "} + std::string{line}};
+        }
+        words[word_count++] = line.substr(start, space - start);
+
+        start = space + 1;
+    }
+
+    // look up instruction id
+    auto op_name = words[0];
+    auto find_op_id = vm.instructions->instruction_ids.find(op_name);
+    if (find_op_id == std::end(vm.instructions->instruction_ids)) {
+        throw invalid_instruction{std::string{"unknown instruction: "} + std::string{op_name}};
+    }
+    op_id_t op_id = find_op_id->second;
+
+    // parse the argument
+    item_t argument{0};
+    if (word_count == 2) {
+        argument = parse_argument(words[1]);
+    }
+
+    // and save the instruction to the code store
+    code.emplace_back(op_id, argument);
+}
+
+
+code_t assemble(const vm_state& vm, std::istream& input) {
+    assembler asm_state{vm};
+
+    std::array<char, 64 * 1024> chunk;
+    while (input) {
+        input.read(chunk.data(), chunk.size());
+        asm_state.feed({chunk.data(), static_cast<size_t>(input.gcount())});
+    }
+
+    return asm_state.finish();
+}
+
+
+code_t assemble_file(const vm_state& vm, const std::string& path) {
+    util::mapped_file file{path};
+    return assemble(vm, file.view());
+}
+
+
+} // namespace vm
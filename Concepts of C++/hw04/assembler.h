@@ -0,0 +1,61 @@
+#pragma once
+
+#include <istream>
+#include <string>
+#include <string_view>
+
+#include "vm.h"
+
+
+namespace vm {
+
+/**
+ * incremental assembler.
+ *
+ * the program text can be fed in arbitrary pieces. complete lines are
+ * assembled right away, working on views into the given text, so only the
+ * resulting code allocates. only a line that is cut between two pieces is
+ * buffered until its rest arrives.
+ *
+ * produces the same code and `invalid_instruction` errors as `assemble`.
+ */
+class assembler {
+public:
+    explicit assembler(const vm_state& vm);
+
+    /**
+     * assemble all complete lines of the given text,
+     * keeping an unterminated last line for the next call.
+     */
+    void feed(std::string_view text);
+
+    /**
+     * assemble the remaining unterminated line, if any,
+     * and return the code of the whole program.
+     */
+    code_t finish();
+
+private:
+    void assemble_line(std::string_view line);
+
+    const vm_state& vm;
+    code_t code;
+
+    /** begin of a line that was cut at the end of the previous piece */
+    std::string partial;
+};
+
+
+/**
+ * assemble a program read from the given stream, chunk by chunk.
+ */
+code_t assemble(const vm_state& vm, std::istream& input);
+
+
+/**
+ * assemble a program file by memory-mapping it.
+ */
+code_t assemble_file(const vm_state& vm, const std::string& path);
+
+
+} // namespace vm
@@ -0,0 +1,141 @@
+#include "batch.h"
+
+#include <algorithm>
+#include <utility>
+
+
+namespace vm {
+
+batch_runner::batch_runner(size_t threads) {
+    threads = std::max<size_t>(threads, 1);
+
+    queues_.reserve(threads);
+    for (size_t i = 0; i < threads; i++) {
+        queues_.push_back(std::make_unique<work_queue>());
+    }
+
+    workers_.reserve(threads);
+    for (size_t i = 0; i < threads; i++) {
+        workers_.emplace_back(&batch_runner::work, this, i);
+    }
+}
+
+
+batch_runner::~batch_runner() {
+    {
+        std::lock_guard guard{state_lock_};
+        stop_ = true;
+    }
+    work_available_.notify_all();
+
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+
+std::vector<batch_result> batch_runner::run(const vm_state& vm, std::span<const code_t> programs) {
+    std::lock_guard run_guard{run_lock_};
+
+    std::vector<batch_result> results(programs.size());
+    if (programs.empty()) {
+        return results;
+    }
+
+    // hand each worker a contiguous share, neighbouring programs
+    // are likely of similar length
+    size_t threads = workers_.size();
+    for (size_t i = 0; i < threads; i++) {
+        std::lock_guard guard{queues_[i]->lock};
+        for (size_t program = programs.size() * i / threads;
+             program < programs.size() * (i + 1) / threads; program++) {
+            queues_[i]->programs.push_back(program);
+        }
+    }
+
+    std::unique_lock state_guard{state_lock_};
+    current_ = {&vm, programs, &results};
+    generation_ += 1;
+    busy_ = threads;
+    work_available_.notify_all();
+
+    work_done_.wait(state_guard, [this] { return busy_ == 0; });
+    current_ = {};
+
+    return results;
+}
+
+
+void batch_runner::work(size_t worker) {
+    uint64_t seen_generation = 0;
+
+    while (true) {
+        batch job;
+        {
+            std::unique_lock guard{state_lock_};
+            work_available_.wait(guard, [&] { return stop_ or generation_ != seen_generation; });
+            if (stop_) {
+                return;
+            }
+            seen_generation = generation_;
+            job = current_;
+        }
+
+        // the per-execution state, reused for all programs of this batch
+        vm_state vm = copy_settings(*job.vm);
+
+        size_t program;
+        while (next_program(worker, program)) {
+            batch_result& outcome = (*job.results)[program];
+            try {
+                outcome.result = vm::run(vm, job.programs[program]);
+            }
+            catch (...) {
+                outcome.error = std::current_exception();
+            }
+        }
+
+        {
+            std::lock_guard guard{state_lock_};
+            busy_ -= 1;
+            if (busy_ == 0) {
+                work_done_.notify_one();
+            }
+        }
+    }
+}
+
+
+bool batch_runner::next_program(size_t worker, size_t& program) {
+    {
+        work_queue& own = *queues_[worker];
+        std::lock_guard guard{own.lock};
+        if (not own.programs.empty()) {
+            program = own.programs.front();
+            own.programs.pop_front();
+            return true;
+        }
+    }
+
+    // steal from the back, away from where the owner is taking programs
+    for (size_t i = 1; i < queues_.size(); i++) {
+        work_queue& victim = *queues_[(worker + i) % queues_.size()];
+        std::lock_guard guard{victim.lock};
+        if (not victim.programs.empty()) {
+            program = victim.programs.back();
+            victim.programs.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+
+std::vector<batch_result> run_batch(const vm_state& vm, std::span<const code_t> programs,
+                                    size_t threads) {
+    batch_runner runner{threads};
+    return runner.run(vm, programs);
+}
+
+
+} // namespace vm
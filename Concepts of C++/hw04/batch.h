@@ -0,0 +1,117 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "vm.h"
+
+
+namespace vm {
+
+/**
+ * outcome of one program of a batch.
+ */
+struct batch_result {
+    /** what `run` returned, if it didn't throw */
+    std::tuple<item_t, std::string> result;
+
+    /** what `run` threw, otherwise nullptr */
+    std::exception_ptr error;
+
+    bool ok() const { return error == nullptr; }
+
+    /**
+     * the run results, or rethrow the error of the program.
+     */
+    const std::tuple<item_t, std::string>& get() const {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return result;
+    }
+};
+
+
+/**
+ * executes many independent programs on a pool of worker threads.
+ *
+ * each worker runs the programs with its own vm state, which shares the
+ * instruction table of the given vm, so the programs don't copy the
+ * instruction maps. the programs are distributed over per-worker queues,
+ * and workers that run out of programs steal from the others.
+ *
+ * custom instruction actions are called from several threads at once,
+ * so they must not modify shared data without synchronization.
+ */
+class batch_runner {
+public:
+    /** start the given number of workers, by default one per core */
+    explicit batch_runner(size_t threads = std::thread::hardware_concurrency());
+    ~batch_runner();
+
+    batch_runner(const batch_runner&) = delete;
+    batch_runner& operator=(const batch_runner&) = delete;
+
+    size_t threads() const { return workers_.size(); }
+
+    /**
+     * run all programs with the instructions and settings of the given vm.
+     *
+     * @return one result per program, in the order of the programs.
+     */
+    std::vector<batch_result> run(const vm_state& vm, std::span<const code_t> programs);
+
+private:
+    /** programs waiting for a worker, as indices into the batch */
+    struct work_queue {
+        std::mutex lock;
+        std::deque<size_t> programs;
+    };
+
+    /** the batch currently being executed */
+    struct batch {
+        const vm_state* vm;
+        std::span<const code_t> programs;
+        std::vector<batch_result>* results;
+    };
+
+    void work(size_t worker);
+
+    /** take the next program from the own queue, or steal one from another */
+    bool next_program(size_t worker, size_t& program);
+
+    std::vector<std::thread> workers_;
+    std::vector<std::unique_ptr<work_queue>> queues_;
+
+    /** only one batch is executed at a time */
+    std::mutex run_lock_;
+
+    std::mutex state_lock_;
+    std::condition_variable work_available_;
+    std::condition_variable work_done_;
+    batch current_{};
+    /** counts the batches started, so workers notice a new one */
+    uint64_t generation_ = 0;
+    /** workers still executing the current batch */
+    size_t busy_ = 0;
+    bool stop_ = false;
+};
+
+
+/**
+ * run all programs on a temporary `batch_runner`.
+ */
+std::vector<batch_result> run_batch(const vm_state& vm, std::span<const code_t> programs,
+                                    size_t threads = std::thread::hardware_concurrency());
+
+
+} // namespace vm
@@ -0,0 +1,420 @@
+#include "hw04.h"
+#include "jit.h"
+#include "threaded.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+namespace vm::bench {
+
+/**
+ * a program to measure, and how many instructions one run of it executes.
+ */
+struct program {
+    std::string name;
+    std::string text;
+    size_t executed;
+};
+
+
+/**
+ * count down from the given value to zero in a JMP/JMPZ loop.
+ */
+program countdown(item_t iterations) {
+    return {
+        "countdown " + std::to_string(iterations),
+        "LOAD_CONST " + std::to_string(iterations) + "\n"
+        "DUP\n"
+        "JMPZ 6\n"
+        "LOAD_CONST -1\n"
+        "ADD\n"
+        "JMP 1\n"
+        "EXIT\n",
+        static_cast<size_t>(iterations) * 5 + 4,
+    };
+}
+
+
+/**
+ * the jump programs of the hw04 tests.
+ */
+std::vector<program> test_programs() {
+    return {
+        {
+            "test jmp_3",
+            "JMP 5\n"
+            "LOAD_CONST 123\n"
+            "LOAD_CONST 912\n"
+            "JMP 7\n"
+            "LOAD_CONST 852\n"
+            "JMP 2\n"
+            "LOAD_CONST 601\n"
+            "EXIT\n",
+            6,
+        },
+        {
+            "test jmpz_2",
+            "LOAD_CONST 701\n"
+            "LOAD_CONST 20\n"
+            "EQ\n"
+            "JMPZ 6\n"
+            "LOAD_CONST 8001\n"
+            "JMP 7\n"
+            "LOAD_CONST 6231\n"
+            "EXIT\n",
+            6,
+        },
+        {
+            "test jmpz_3",
+            "LOAD_CONST 701\n"
+            "LOAD_CONST 701\n"
+            "EQ\n"
+            "JMPZ 6\n"
+            "LOAD_CONST 8001\n"
+            "JMP 7\n"
+            "LOAD_CONST 6231\n"
+            "EXIT\n",
+            7,
+        },
+    };
+}
+
+
+/**
+ * run the given function repeatedly until enough instructions were executed,
+ * and return the achieved instructions per second.
+ */
+double measure(const std::function<void()>& run_once, size_t executed_per_run) {
+    constexpr size_t min_instructions = 50'000'000;
+    size_t repetitions = std::max<size_t>(1, min_instructions / executed_per_run);
+
+    // warm up caches and branch predictors
+    run_once();
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < repetitions; i++) {
+        run_once();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    return static_cast<double>(repetitions * executed_per_run) / elapsed.count();
+}
+
+
+void report(const std::string& engine, double ips, double baseline) {
+    std::cout << "  " << std::left << std::setw(12) << engine
+              << std::right << std::setw(10) << std::fixed << std::setprecision(1)
+              << ips / 1e6 << " Minstr/s"
+              << std::setw(8) << std::setprecision(2) << ips / baseline << "x"
+              << std::endl;
+}
+
+
+void dispatch_engines(const program& prog) {
+    vm_state state = create_vm();
+    code_t code = assemble(state, prog.text);
+
+    state.superinstructions = true;
+    code_t fused = assemble(state, prog.text);
+
+    // rates are given in instructions of the unfused program per second
+    std::cout << prog.name << " (" << prog.executed << " instructions per run, "
+              << code.size() << " -> " << fused.size() << " when fused)" << std::endl;
+
+    state.dispatch = dispatch_mode::table;
+    double table = measure([&] { run(state, code); }, prog.executed);
+    report("table", table, table);
+
+    double table_fused = measure([&] { run(state, fused); }, prog.executed);
+    report("table+fused", table_fused, table);
+
+    profiler profile;
+    state.profile = &profile;
+    double profiled = measure([&] { run(state, code); }, prog.executed);
+    report("table+prof", profiled, table);
+    state.profile = nullptr;
+
+    threaded_code_t threaded = thread_code(state, code);
+    double direct = measure([&] { run_threaded(state, threaded); }, prog.executed);
+    report("threaded", direct, table);
+
+    threaded_code_t threaded_fused = thread_code(state, fused);
+    double direct_fused = measure([&] { run_threaded(state, threaded_fused); }, prog.executed);
+    report("thr+fused", direct_fused, table);
+
+    // verified programs run without per-instruction checks
+    if (verify(state, fused).verified) {
+        threaded_code_t unchecked = thread_code(state, fused, false);
+        double direct_verified = measure([&] { run_threaded(state, unchecked); }, prog.executed);
+        report("thr+verif", direct_verified, table);
+    }
+
+    register_program translated{state, fused};
+    double registers = measure([&] { translated.run(state); }, prog.executed);
+    report(translated.translated() ? "registers" : "registers (n/a)", registers, table);
+
+    jit_program compiled{state, code};
+    double native = measure([&] { compiled.run(state); }, prog.executed);
+    report(compiled.compiled() ? "jit" : "jit (n/a)", native, table);
+
+    jit_program compiled_fused{state, fused};
+    double native_fused = measure([&] { compiled_fused.run(state); }, prog.executed);
+    report(compiled_fused.compiled() ? "jit+fused" : "jit+fused (n/a)", native_fused, table);
+
+    if (verify(state, fused).verified) {
+        jit_program compiled_verified{state, fused, false};
+        double native_verified = measure([&] { compiled_verified.run(state); }, prog.executed);
+        report(compiled_verified.compiled() ? "jit+verif" : "jit+verif (n/a)", native_verified, table);
+    }
+}
+
+
+/**
+ * a program writing every counter value, collected into the result string
+ * and streamed to /dev/null.
+ */
+void output_streaming(item_t iterations) {
+    program prog{
+        "write " + std::to_string(iterations),
+        "LOAD_CONST " + std::to_string(iterations) + "\n"
+        "DUP\n"
+        "JMPZ 7\n"
+        "WRITE\n"
+        "LOAD_CONST -1\n"
+        "ADD\n"
+        "JMP 1\n"
+        "EXIT\n",
+        static_cast<size_t>(iterations) * 6 + 4,
+    };
+
+    vm_state state = create_vm();
+    code_t code = assemble(state, prog.text);
+
+    std::cout << prog.name << " (" << prog.executed << " instructions per run)" << std::endl;
+
+    double collected = measure([&] { run(state, code); }, prog.executed);
+    report("collected", collected, collected);
+
+    std::FILE* null = std::fopen("/dev/null", "w");
+    if (null != nullptr) {
+        state.output.set_sink(fd_sink(fileno(null)));
+        double streamed = measure([&] { run(state, code); }, prog.executed);
+        report("streamed", streamed, collected);
+        state.output.set_sink({});
+        std::fclose(null);
+    }
+}
+
+
+/**
+ * decrement the top of stack, as custom instruction.
+ */
+bool decrement(vm_state& vm, const item_t /*arg*/) {
+    vm.stack.top() -= 1;
+    return true;
+}
+
+
+/**
+ * a countdown using a custom instruction, called through `std::function`
+ * by the other engines and inlined by an `instruction_set`.
+ */
+void custom_instructions(item_t iterations) {
+    using decrement_set = instruction_set<instruction<"DEC", decrement>>;
+
+    program prog{
+        "custom countdown " + std::to_string(iterations),
+        "LOAD_CONST " + std::to_string(iterations) + "\n"
+        "DUP\n"
+        "JMPZ 5\n"
+        "DEC\n"
+        "JMP 1\n"
+        "EXIT\n",
+        static_cast<size_t>(iterations) * 4 + 4,
+    };
+
+    vm_state state = create_vm();
+    decrement_set::register_to(state);
+    code_t code = assemble(state, prog.text);
+
+    std::cout << prog.name << " (" << prog.executed << " instructions per run)" << std::endl;
+
+    state.dispatch = dispatch_mode::table;
+    double table = measure([&] { run(state, code); }, prog.executed);
+    report("table", table, table);
+
+    threaded_code_t threaded = thread_code(state, code);
+    double direct = measure([&] { run_threaded(state, threaded); }, prog.executed);
+    report("threaded", direct, table);
+
+    typed_code_t typed = decrement_set::translate(state, code);
+    double inlined = measure([&] { decrement_set::run(state, typed); }, prog.executed);
+    report("typed set", inlined, table);
+}
+
+
+/**
+ * run many small programs one after another, and with the batch runner.
+ */
+void batch_execution(size_t count) {
+    vm_state state = create_vm();
+
+    std::vector<code_t> programs;
+    programs.reserve(count);
+    size_t executed = 0;
+    for (size_t i = 0; i < count; i++) {
+        program prog = countdown(static_cast<item_t>(100 + i % 100));
+        programs.push_back(assemble(state, prog.text));
+        executed += prog.executed;
+    }
+
+    std::cout << "batch of " << count << " countdown programs" << std::endl;
+
+    double sequential = measure([&] {
+        for (const auto& code : programs) {
+            run(state, code);
+        }
+    }, executed);
+    report("sequential", sequential, sequential);
+
+    batch_runner runner;
+    double batched = measure([&] { runner.run(state, programs); }, executed);
+    report(std::to_string(runner.threads()) + " threads", batched, sequential);
+}
+
+
+/**
+ * measure loading a large generated program: assembling it from memory,
+ * a stream or a file, and mapping it as bytecode.
+ */
+void program_loading(size_t lines) {
+    std::string text;
+    for (size_t i = 0; i < lines; i++) {
+        text += "LOAD_CONST " + std::to_string(i * 7919 % 100'003) + "\n";
+        text += (i % 2) ? "ADD\n" : "DUP\n";
+    }
+
+    std::string text_path = "benchhw04_program.txt";
+    std::string bytecode_path = "benchhw04_program.vmc";
+    std::ofstream{text_path} << text;
+
+    vm_state state = create_vm();
+    save_bytecode(state, assemble(state, text), bytecode_path);
+
+    double megabytes = static_cast<double>(text.size()) / 1e6;
+    std::cout << "loading a " << std::fixed << std::setprecision(1)
+              << megabytes << " MB program" << std::endl;
+
+    // returns the number of instructions loaded
+    auto time = [&](const std::string& name, const std::function<size_t()>& load_once) {
+        auto start = std::chrono::steady_clock::now();
+        size_t instructions = load_once();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "  " << std::left << std::setw(16) << name
+                  << std::right << std::setw(10) << std::setprecision(3)
+                  << elapsed.count() * 1e3 << " ms  ("
+                  << instructions << " instructions)" << std::endl;
+    };
+
+    time("assemble string", [&] { return assemble(state, text).size(); });
+    time("assemble stream", [&] {
+        std::istringstream input{text};
+        return assemble(state, input).size();
+    });
+    time("assemble mmap", [&] { return assemble_file(state, text_path).size(); });
+    time("bytecode", [&] { return bytecode_file{state, bytecode_path}.code().size(); });
+    time("bytecode no-sum", [&] { return bytecode_file{state, bytecode_path, false}.code().size(); });
+
+    std::remove(text_path.c_str());
+    std::remove(bytecode_path.c_str());
+}
+
+
+/**
+ * split a large newline-delimited text in different ways.
+ */
+void text_splitting(size_t lines) {
+    std::string text;
+    for (size_t i = 0; i < lines; i++) {
+        text += "  LOAD_CONST " + std::to_string(i * 7919 % 100'003) + " \n";
+    }
+
+    double megabytes = static_cast<double>(text.size()) / 1e6;
+    std::cout << "splitting " << std::fixed << std::setprecision(1)
+              << megabytes << " MB into " << lines << " lines" << std::endl;
+
+    // returns the number of parts, so the work isn't optimized away
+    auto time = [&](const std::string& name, const std::function<size_t()>& split_once) {
+        split_once();
+        auto start = std::chrono::steady_clock::now();
+        size_t parts = split_once();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "  " << std::left << std::setw(16) << name
+                  << std::right << std::setw(10) << std::setprecision(1)
+                  << megabytes / elapsed.count() << " MB/s  ("
+                  << parts << " parts)" << std::endl;
+    };
+
+    // how `split` used to work
+    time("getline", [&] {
+        std::stringstream splitter{text};
+        std::string part;
+        std::vector<std::string> parts;
+        while (std::getline(splitter, part, '\n')) {
+            parts.push_back(part);
+        }
+        return parts.size();
+    });
+    time("find", [&] {
+        size_t parts = 0;
+        size_t newline = text.find('\n');
+        while (newline != std::string::npos) {
+            parts += 1;
+            newline = text.find('\n', newline + 1);
+        }
+        return parts;
+    });
+    time("split", [&] { return util::split(text, '\n').size(); });
+    time("split_views", [&] { return util::split_views(text, '\n').size(); });
+    time("split_view", [&] {
+        size_t parts = 0;
+        for (std::string_view line : util::split_view{text, '\n'}) {
+            parts += not line.empty();
+        }
+        return parts;
+    });
+    time("split+strip", [&] {
+        size_t parts = 0;
+        for (std::string_view line : util::split_view{text, '\n'}) {
+            parts += not util::strip_view(line).empty();
+        }
+        return parts;
+    });
+}
+
+} // namespace vm::bench
+
+
+int main() {
+    using namespace vm::bench;
+
+    for (const auto& prog : test_programs()) {
+        dispatch_engines(prog);
+    }
+    dispatch_engines(countdown(1'000'000));
+    custom_instructions(1'000'000);
+    output_streaming(1'000'000);
+    batch_execution(10'000);
+    program_loading(1'000'000);
+    text_splitting(1'000'000);
+
+    return 0;
+}
@@ -0,0 +1,218 @@
+#include "bytecode.h"
+
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+
+namespace vm {
+
+namespace {
+
+// the code section is used in place, so op_t has to be the plain
+// {op id, argument} pair of 64 bit numbers it is written as.
+static_assert(std::is_standard_layout_v<op_t>);
+static_assert(sizeof(op_t) == 16 and alignof(op_t) == 8);
+
+constexpr std::array<char, 8> magic{'V', 'M', 'C', 'O', 'D', 'E', '\0', '\0'};
+constexpr uint32_t format_version = 1;
+
+/** stored in native byte order, so reading it tells whether that matches ours */
+constexpr uint32_t byte_order_mark = 0x01020304;
+
+
+/**
+ * start of each bytecode file.
+ */
+struct header {
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t byte_order;
+
+    /** entries in the name table, which starts right after the header */
+    uint64_t name_count;
+
+    /** where the instructions start, aligned for op_t */
+    uint64_t code_offset;
+    uint64_t instruction_count;
+
+    /** FNV-1a hash of all bytes after the header */
+    uint64_t checksum;
+};
+
+
+/**
+ * name table entry, followed by the name and padding to 8 bytes.
+ */
+struct name_entry {
+    uint64_t op_id;
+    uint64_t length;
+};
+
+
+constexpr size_t padded(size_t size) {
+    return (size + 7) / 8 * 8;
+}
+
+
+uint64_t fnv1a(const std::byte* data, size_t size, uint64_t hash = 0xcbf29ce484222325) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= static_cast<uint64_t>(data[i]);
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+
+/** copy a trivial struct out of the mapping, which may not be aligned for it */
+template <typename T>
+T read_at(const util::mapped_file& file, size_t offset) {
+    if (offset + sizeof(T) > file.size()) {
+        throw invalid_bytecode{"bytecode file truncated"};
+    }
+    T value;
+    std::memcpy(&value, file.data() + offset, sizeof(T));
+    return value;
+}
+
+} // namespace
+
+
+void save_bytecode(const vm_state& vm, const code_t& code, std::ostream& output) {
+    // name table for all op ids used by the code
+    std::vector<std::byte> names;
+    std::unordered_map<op_id_t, bool> listed;
+    uint64_t name_count = 0;
+
+    for (const auto& [op_id, arg] : code) {
+        if (listed[op_id]) {
+            continue;
+        }
+        listed[op_id] = true;
+
+        auto name = vm.instructions->instruction_names.find(op_id);
+        if (name == std::end(vm.instructions->instruction_names)) {
+            throw invalid_instruction{"unknown op id: " + std::to_string(op_id)};
+        }
+
+        name_entry entry{op_id, name->second.size()};
+        size_t start = names.size();
+        names.resize(start + sizeof(entry) + padded(entry.length));
+        std::memcpy(names.data() + start, &entry, sizeof(entry));
+        std::memcpy(names.data() + start + sizeof(entry), name->second.data(), entry.length);
+        name_count += 1;
+    }
+
+    auto code_bytes = reinterpret_cast<const std::byte*>(code.data());
+    size_t code_size = code.size() * sizeof(op_t);
+
+    header head{
+        magic,
+        format_version,
+        byte_order_mark,
+        name_count,
+        sizeof(header) + names.size(),
+        code.size(),
+        fnv1a(code_bytes, code_size, fnv1a(names.data(), names.size())),
+    };
+
+    output.write(reinterpret_cast<const char*>(&head), sizeof(head));
+    output.write(reinterpret_cast<const char*>(names.data()),
+                 static_cast<std::streamsize>(names.size()));
+    output.write(reinterpret_cast<const char*>(code_bytes),
+                 static_cast<std::streamsize>(code_size));
+}
+
+
+void save_bytecode(const vm_state& vm, const code_t& code, const std::string& path) {
+    std::ofstream output{path, std::ios::binary};
+    save_bytecode(vm, code, output);
+    if (not output) {
+        throw std::runtime_error{"failed to write bytecode to " + path};
+    }
+}
+
+
+bytecode_file::bytecode_file(const vm_state& vm, const std::string& path, bool verify_checksum)
+    :
+    file_{path} {
+
+    auto head = read_at<header>(file_, 0);
+
+    if (head.magic != magic) {
+        throw invalid_bytecode{path + " is no bytecode file"};
+    }
+    if (head.version != format_version) {
+        throw invalid_bytecode{"unsupported bytecode version " + std::to_string(head.version)};
+    }
+    if (head.byte_order != byte_order_mark) {
+        throw invalid_bytecode{"bytecode was written on a machine with different byte order"};
+    }
+    if (head.code_offset % alignof(op_t) != 0 or
+        head.code_offset < sizeof(header) or
+        head.code_offset > file_.size() or
+        head.instruction_count != (file_.size() - head.code_offset) / sizeof(op_t) or
+        (file_.size() - head.code_offset) % sizeof(op_t) != 0) {
+        throw invalid_bytecode{"bytecode file size doesn't match its header"};
+    }
+
+    if (verify_checksum and
+        head.checksum != fnv1a(file_.data() + sizeof(header), file_.size() - sizeof(header))) {
+        throw invalid_bytecode{"bytecode checksum mismatch"};
+    }
+
+    // translate the file's op ids to the ones of this vm
+    std::unordered_map<op_id_t, op_id_t> op_ids;
+    bool same_ids = true;
+
+    size_t offset = sizeof(header);
+    for (uint64_t i = 0; i < head.name_count; i++) {
+        auto entry = read_at<name_entry>(file_, offset);
+        offset += sizeof(entry);
+        // compare without adding to the length from the file, which may wrap
+        if (offset > head.code_offset or entry.length > head.code_offset - offset) {
+            throw invalid_bytecode{"bytecode name table truncated"};
+        }
+
+        std::string_view name{reinterpret_cast<const char*>(file_.data() + offset), entry.length};
+        auto find_id = vm.instructions->instruction_ids.find(name);
+        if (find_id == std::end(vm.instructions->instruction_ids)) {
+            throw invalid_instruction{"unknown instruction: " + std::string{name}};
+        }
+
+        op_ids[entry.op_id] = find_id->second;
+        same_ids = same_ids and (entry.op_id == find_id->second);
+        offset += padded(entry.length);
+    }
+
+    code_ = {reinterpret_cast<const op_t*>(file_.data() + head.code_offset), head.instruction_count};
+
+    if (same_ids) {
+        // all ids used by valid files are listed. this needs to read all
+        // pages, so it's part of the verification.
+        if (verify_checksum) {
+            for (const auto& [op_id, arg] : code_) {
+                if (not op_ids.contains(op_id)) {
+                    throw invalid_bytecode{"op id without name in bytecode: " + std::to_string(op_id)};
+                }
+            }
+        }
+        return;
+    }
+
+    remapped_.reserve(code_.size());
+    for (const auto& [op_id, arg] : code_) {
+        auto vm_id = op_ids.find(op_id);
+        if (vm_id == std::end(op_ids)) {
+            throw invalid_bytecode{"op id without name in bytecode: " + std::to_string(op_id)};
+        }
+        remapped_.emplace_back(vm_id->second, arg);
+    }
+    code_ = remapped_;
+}
+
+
+} // namespace vm
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+
+#include "util.h"
+#include "vm.h"
+
+
+namespace vm {
+
+/**
+ * store assembled code in the binary bytecode format.
+ *
+ * the file starts with a header, followed by a table with the names of all
+ * instructions the code uses, and then the instructions exactly as they are
+ * laid out in memory. a checksum covers everything after the header.
+ */
+void save_bytecode(const vm_state& vm, const code_t& code, std::ostream& output);
+
+
+/**
+ * store assembled code in the given bytecode file.
+ */
+void save_bytecode(const vm_state& vm, const code_t& code, const std::string& path);
+
+
+/**
+ * a memory-mapped bytecode file, ready to be executed by a vm.
+ *
+ * if the file's op ids match the ones of the vm, which is the case when it was
+ * written by a vm with the same instructions, the code is executed right from
+ * the mapping - so loading doesn't copy anything, and processes running the
+ * same file share its pages. otherwise the op ids are translated into a copy.
+ */
+class bytecode_file {
+public:
+    /**
+     * map the file and check it.
+     * checksum verification reads the whole file - skip it for trusted files
+     * so only the pages the program touches are loaded.
+     */
+    bytecode_file(const vm_state& vm, const std::string& path, bool verify_checksum = true);
+
+    /** the loaded instructions, pass them to `run` */
+    std::span<const op_t> code() const { return code_; }
+
+    /** whether the code is used in-place from the mapping */
+    bool mapped() const { return remapped_.empty(); }
+
+private:
+    util::mapped_file file_;
+
+    /** code with op ids translated for the vm, if needed */
+    code_t remapped_;
+
+    std::span<const op_t> code_;
+};
+
+
+/**
+ * exception thrown when a bytecode file is malformed or was not made for this vm.
+ */
+struct invalid_bytecode : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+
+} // namespace vm
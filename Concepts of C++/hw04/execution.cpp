@@ -0,0 +1,180 @@
+#include "execution.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+
+namespace vm {
+
+execution::execution(vm_state& vm, std::span<const op_t> code)
+    :
+    vm_{vm},
+    code_{thread_code(vm, code)} {
+
+    vm.pc = 0;
+    vm.stack.clear();
+    vm.output.clear();
+}
+
+
+bool execution::resume(size_t budget, bool stop_on_write) {
+    if (finished_) {
+        return true;
+    }
+
+    run_limit limit{budget, stop_on_write};
+    try {
+        finished_ = run_threaded_for(vm_, code_, limit);
+    }
+    catch (...) {
+        finished_ = true;
+        error_ = std::current_exception();
+        executed_ += budget - limit.remaining;
+        throw;
+    }
+    executed_ += budget - limit.remaining;
+    return finished_;
+}
+
+
+std::tuple<item_t, std::string> execution::result() {
+    if (not finished_) {
+        throw std::logic_error{"the execution hasn't finished yet"};
+    }
+    if (error_) {
+        std::rethrow_exception(error_);
+    }
+    return {vm_.stack.top(), vm_.output.take()};
+}
+
+
+namespace {
+
+/**
+ * the coroutine behind `write_stream`. it only starts when the output is
+ * first consumed, so the execution it owns must not refer to the caller's code.
+ */
+output_generator write_slices(vm_state& vm, execution program) {
+    // each slice ends after a write, or after this many instructions
+    constexpr size_t slice = 100'000;
+
+    while (true) {
+        bool finished = program.resume(slice, true);
+
+        std::string text = vm.output.take();
+        if (not text.empty()) {
+            co_yield std::move(text);
+        }
+        if (finished) {
+            program.result();
+            co_return;
+        }
+    }
+}
+
+} // namespace
+
+
+output_generator write_stream(vm_state& vm, std::span<const op_t> code) {
+    // threaded right away, while the code still exists
+    return write_slices(vm, execution{vm, code});
+}
+
+
+std::vector<batch_result> run_interleaved(const vm_state& vm, std::span<const code_t> programs,
+                                          size_t slice, size_t max_instructions, size_t threads) {
+    // a program's own vm, and its execution once started
+    struct task {
+        vm_state vm;
+        std::optional<execution> running;
+    };
+
+    std::vector<batch_result> results(programs.size());
+    std::vector<std::unique_ptr<task>> tasks(programs.size());
+
+    std::mutex lock;
+    std::condition_variable ready;
+    std::deque<size_t> queue;
+    size_t unfinished = programs.size();
+
+    for (size_t program = 0; program < programs.size(); program++) {
+        queue.push_back(program);
+    }
+
+    auto work = [&] {
+        std::unique_lock guard{lock};
+        while (true) {
+            ready.wait(guard, [&] { return not queue.empty() or unfinished == 0; });
+            if (unfinished == 0) {
+                return;
+            }
+            size_t program = queue.front();
+            queue.pop_front();
+            guard.unlock();
+
+            bool done = true;
+            try {
+                std::unique_ptr<task>& state = tasks[program];
+                if (not state) {
+                    // programs only get a vm once they are scheduled
+                    state = std::make_unique<task>();
+                    state->vm = copy_settings(vm);
+                    state->running.emplace(state->vm, programs[program]);
+                }
+
+                execution& running = *state->running;
+                size_t budget = slice;
+                if (max_instructions != 0) {
+                    budget = std::min(budget, max_instructions - running.executed());
+                }
+
+                done = running.resume(budget);
+                if (done) {
+                    results[program].result = running.result();
+                } else if (max_instructions != 0 and running.executed() >= max_instructions) {
+                    throw instruction_limit_exceeded{
+                        "program exceeded " + std::to_string(max_instructions) + " instructions"};
+                }
+            }
+            catch (...) {
+                results[program].error = std::current_exception();
+                done = true;
+            }
+
+            if (done) {
+                // free the stack of finished programs early
+                tasks[program].reset();
+            }
+
+            guard.lock();
+            if (done) {
+                unfinished -= 1;
+                if (unfinished == 0) {
+                    ready.notify_all();
+                }
+            } else {
+                queue.push_back(program);
+                ready.notify_one();
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    threads = std::clamp<size_t>(threads, 1, std::max<size_t>(programs.size(), 1));
+    for (size_t i = 1; i < threads; i++) {
+        workers.emplace_back(work);
+    }
+    // the caller works too
+    work();
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    return results;
+}
+
+
+} // namespace vm
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "batch.h"
+#include "threaded.h"
+#include "vm.h"
+
+
+namespace vm {
+
+/**
+ * thrown when a program exceeds the instructions it was allowed to execute.
+ */
+struct instruction_limit_exceeded : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+
+/**
+ * a program run on a vm in slices.
+ *
+ * each `resume` executes at most a given number of instructions and then
+ * returns, so a program that loops forever can't block its caller.
+ * between slices, the vm keeps the program's state, so it must not be
+ * used for anything else until the execution finished.
+ */
+class execution {
+public:
+    /** prepare running the code, resetting the vm like `run` */
+    execution(vm_state& vm, std::span<const op_t> code);
+
+    /**
+     * continue executing for at most `budget` instructions.
+     *
+     * @param stop_on_write: also return right after each WRITE and WRITE_CHAR
+     * @return whether the program finished
+     * @throw whatever `run` would throw, then the execution is finished.
+     */
+    bool resume(size_t budget, bool stop_on_write = false);
+
+    bool finished() const { return finished_; }
+
+    /** number of instructions executed so far */
+    size_t executed() const { return executed_; }
+
+    /**
+     * the results of the finished program, as returned by `run`.
+     * rethrows the error the program failed with.
+     */
+    std::tuple<item_t, std::string> result();
+
+private:
+    vm_state& vm_;
+    threaded_code_t code_;
+    size_t executed_ = 0;
+    bool finished_ = false;
+    std::exception_ptr error_;
+};
+
+
+/**
+ * a coroutine producing the output of a program, see `write_stream`.
+ */
+class output_generator {
+public:
+    struct promise_type {
+        std::string current;
+        std::exception_ptr error;
+
+        output_generator get_return_object() {
+            return output_generator{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+
+        std::suspend_always yield_value(std::string text) {
+            current = std::move(text);
+            return {};
+        }
+
+        void return_void() {}
+        void unhandled_exception() { error = std::current_exception(); }
+    };
+
+    using handle_t = std::coroutine_handle<promise_type>;
+
+    class iterator {
+    public:
+        using value_type = std::string;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() = default;
+        explicit iterator(handle_t coroutine) : coroutine_{coroutine} {}
+
+        const std::string& operator*() const { return coroutine_.promise().current; }
+
+        iterator& operator++() {
+            advance(coroutine_);
+            return *this;
+        }
+
+        void operator++(int) { ++*this; }
+
+        bool operator==(std::default_sentinel_t) const {
+            return not coroutine_ or coroutine_.done();
+        }
+
+    private:
+        handle_t coroutine_;
+    };
+
+    output_generator(output_generator&& other) noexcept
+        :
+        coroutine_{std::exchange(other.coroutine_, {})} {}
+
+    output_generator& operator=(output_generator&& other) noexcept {
+        if (this != &other) {
+            destroy();
+            coroutine_ = std::exchange(other.coroutine_, {});
+        }
+        return *this;
+    }
+
+    ~output_generator() { destroy(); }
+
+    /** runs the program up to its first output */
+    iterator begin() {
+        advance(coroutine_);
+        return iterator{coroutine_};
+    }
+
+    std::default_sentinel_t end() { return {}; }
+
+private:
+    explicit output_generator(handle_t coroutine) : coroutine_{coroutine} {}
+
+    /** run to the next output, and pass on errors of the program */
+    static void advance(handle_t coroutine) {
+        coroutine.resume();
+        if (coroutine.done() and coroutine.promise().error) {
+            std::rethrow_exception(std::exchange(coroutine.promise().error, {}));
+        }
+    }
+
+    void destroy() {
+        if (coroutine_) {
+            coroutine_.destroy();
+        }
+    }
+
+    handle_t coroutine_;
+};
+
+
+/**
+ * run a program lazily, producing the text of each WRITE and WRITE_CHAR
+ * as it is written. the program only runs while the output is consumed.
+ *
+ * the code is prepared right away, so it may be a temporary. the vm is
+ * reset then too, it must not have an output sink, and must outlive the
+ * generator. errors of the program are thrown when advancing to the next output.
+ */
+output_generator write_stream(vm_state& vm, std::span<const op_t> code);
+
+
+/**
+ * run many programs interleaved on a pool of threads.
+ *
+ * each program runs on its own vm state, which shares the instructions
+ * and settings of the given vm. workers take the next program from a
+ * round-robin queue, run it for `slice` instructions, then put it back
+ * at the end, so long-running programs can't starve short ones.
+ *
+ * @param max_instructions: fail programs with `instruction_limit_exceeded`
+ *                          after this many instructions, 0 for no limit.
+ * @return one result per program, in the order of the programs.
+ */
+std::vector<batch_result> run_interleaved(const vm_state& vm, std::span<const code_t> programs,
+                                          size_t slice = 10'000, size_t max_instructions = 0,
+                                          size_t threads = std::thread::hardware_concurrency());
+
+
+} // namespace vm
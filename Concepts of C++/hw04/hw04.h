@@ -1,4 +1,16 @@
 #pragma once
 
 #include "vm.h"
+#include "assembler.h"
+#include "batch.h"
+#include "bytecode.h"
+#include "execution.h"
+#include "jit.h"
+#include "output.h"
+#include "profiler.h"
+#include "registers.h"
+#include "superinstructions.h"
+#include "threaded.h"
+#include "typed.h"
 #include "util.h"
+#include "verifier.h"
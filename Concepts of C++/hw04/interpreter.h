@@ -0,0 +1,446 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <utility>
+
+#include "threaded.h"
+
+
+// labels as values are a GNU extension, which gcc and clang both provide.
+// other compilers dispatch with a switch over the opcode instead.
+#if defined(__GNUC__)
+#define VM_COMPUTED_GOTO 1
+#endif
+
+
+namespace vm {
+
+/** the interpreter loop shared by the threaded engine and `instruction_set` */
+namespace detail {
+
+/**
+ * the operand stack as the handlers see it.
+ * unchecked, all accesses are assumed valid, as proven by `verify`.
+ */
+template <bool checked>
+class stack_view {
+public:
+    explicit stack_view(operand_stack& stack) : stack_{stack} {}
+
+    void push(item_t item) {
+        if constexpr (checked) {
+            stack_.push(item);
+        } else {
+            stack_.push_unchecked(item);
+        }
+    }
+
+    void pop() {
+        if constexpr (checked) {
+            stack_.pop();
+        } else {
+            stack_.pop_unchecked();
+        }
+    }
+
+    item_t take() {
+        if constexpr (checked) {
+            return stack_.take();
+        } else {
+            return stack_.take_unchecked();
+        }
+    }
+
+    item_t& top() {
+        if constexpr (checked) {
+            return stack_.top();
+        } else {
+            return stack_.top_unchecked();
+        }
+    }
+
+    /** fail like a push would if the stack is full */
+    void reserve() {
+        if constexpr (checked) {
+            if (stack_.full()) {
+                stack_.overflow();
+            }
+        }
+    }
+
+private:
+    operand_stack& stack_;
+};
+
+
+/** `threaded_op::op` of the first statically known instruction, the others follow it */
+constexpr size_t first_static_op = static_cast<size_t>(opcode::end) + 1;
+
+
+/**
+ * execute the statically known instruction at the given position.
+ * the comparisons are compiled to a jump table, like a `switch`.
+ */
+template <typename... Instructions, size_t... I>
+bool execute_static(size_t position, vm_state& vm, const item_t arg, std::index_sequence<I...>) {
+    bool proceed = true;
+    static_cast<void>(((position == I and (proceed = Instructions::execute(vm, arg), true)) or ...));
+    return proceed;
+}
+
+
+/**
+ * the threaded interpreter loop, starting at the vm's pc.
+ *
+ * label addresses only exist within this function, so when called without a
+ * program, it just returns its handler table (indexed by opcode) for
+ * `thread_code`. each instantiation has its own handlers.
+ *
+ * limited, it counts the instructions down and stops when the limit is used
+ * up. the code's handlers belong to the unlimited instantiation then, so it
+ * looks up its own by opcode.
+ *
+ * the instructions, types with a static `execute` like an `op_action_t`, are
+ * known at compile time, so their calls can be inlined. they get the ops
+ * following `first_static_op`, in their order, see `instruction_set`.
+ */
+#ifdef VM_COMPUTED_GOTO
+#pragma GCC diagnostic push
+// unlimited runs never suspend
+#pragma GCC diagnostic ignored "-Wunused-label"
+#endif
+template <bool checked, bool limited = false, typename... Instructions>
+const void* const* interpret(vm_state* vm, const threaded_op* code, size_t size,
+                             run_limit* limit = nullptr) {
+#ifdef VM_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+    static const void* const handlers[] = {
+        &&op_custom,
+        &&op_load_const,
+        &&op_exit,
+        &&op_pop,
+        &&op_add,
+        &&op_div,
+        &&op_eq,
+        &&op_neq,
+        &&op_dup,
+        &&op_jmp,
+        &&op_jmpz,
+        &&op_write,
+        &&op_write_char,
+        &&op_load_const_add,
+        &&op_load_const_eq,
+        &&op_load_const_neq,
+        &&op_load_const_add_dup,
+        &&op_dup_jmpz,
+        &&op_eq_jmpz,
+        &&op_neq_jmpz,
+        &&op_end,
+        // one entry per statically known instruction
+        (static_cast<void>(sizeof(Instructions*)), &&op_static)...,
+    };
+    static_assert(std::size(handlers) == first_static_op + sizeof...(Instructions));
+
+#define VM_DISPATCH()                                          \
+    do {                                                       \
+        if constexpr (limited) {                               \
+            VM_COUNT();                                        \
+            goto *handlers[static_cast<size_t>(ip->op)];       \
+        } else {                                               \
+            goto *ip->handler;                                 \
+        }                                                      \
+    } while (false)
+#define VM_HANDLER(name) op_##name
+#else
+    static const void* const handlers[first_static_op + sizeof...(Instructions)] = {};
+
+#define VM_DISPATCH()            \
+    do {                         \
+        if constexpr (limited) { \
+            VM_COUNT();          \
+        }                        \
+        goto dispatch;           \
+    } while (false)
+#define VM_HANDLER(name) case opcode::name
+#endif
+
+#define VM_COUNT()                       \
+    do {                                 \
+        if (limit->remaining == 0) {     \
+            goto suspend;                \
+        }                                \
+        limit->remaining -= 1;           \
+    } while (false)
+
+    if (code == nullptr) {
+        return handlers;
+    }
+
+    stack_view<checked> stack{vm->stack};
+    const threaded_op* ip = code + vm->pc;
+    bool proceed = true;
+
+#define VM_JUMP(target)                                       \
+    do {                                                      \
+        size_t dest = static_cast<size_t>(target);            \
+        if (checked and dest >= size) {                       \
+            vm->pc = dest;                                    \
+            throw vm_segfault{"jump out of program bounds"};  \
+        }                                                     \
+        ip = code + dest;                                     \
+    } while (false)
+
+// the write was counted already, so the slice ends without touching the count
+#define VM_YIELD_ON_WRITE()                          \
+    do {                                             \
+        if constexpr (limited) {                     \
+            if (limit->stop_on_write) {              \
+                goto suspend;                        \
+            }                                        \
+        }                                            \
+    } while (false)
+
+    // the stack reports its own under- and overflows.
+    // all handlers run in this try block, which costs nothing until something
+    // throws, and then tells the vm where it happened.
+    try {
+        VM_DISPATCH();
+
+#ifndef VM_COMPUTED_GOTO
+    dispatch:
+        switch (ip->op) {
+#endif
+
+        VM_HANDLER(custom): {
+            vm->pc = static_cast<size_t>(ip - code) + 1;
+            proceed = (*ip->action)(*vm, ip->arg);
+            goto continue_custom;
+        }
+
+#ifdef VM_COMPUTED_GOTO
+        op_static:
+#else
+        default:
+#endif
+        {
+            vm->pc = static_cast<size_t>(ip - code) + 1;
+            if constexpr (sizeof...(Instructions) > 0) {
+                proceed = execute_static<Instructions...>(static_cast<size_t>(ip->op) - first_static_op,
+                                                          *vm, ip->arg, std::index_sequence_for<Instructions...>{});
+            }
+            goto continue_custom;
+        }
+
+        continue_custom: {
+            if (not proceed) {
+                goto done;
+            }
+            // the instruction may have changed the pc, e.g. by jumping.
+            // the end guard at index `size` is fine to jump to.
+            if (vm->pc > size) {
+                throw vm_segfault{"jump out of program bounds"};
+            }
+            ip = code + vm->pc;
+            VM_DISPATCH();
+        }
+
+        VM_HANDLER(load_const): {
+            stack.push(ip->arg);
+            ++ip;
+            VM_DISPATCH();
+        }
+
+        VM_HANDLER(exit): {
+            stack.top();
+            goto done;
+        }
+
+        VM_HANDLER(pop): {
+            stack.pop();
+            ++ip;
+            VM_DISPATCH();
+        }
+
+        VM_HANDLER(add): {
+            item_t b = stack.take();
+            stack.top() += b;
+            ++ip;
+            VM_DISPATCH();
+        }
+
+        VM_HANDLER(div): {
+            item_t b = stack.take();
+            item_t& a = stack.top();
+            if (b == 0) {
+                throw div_by_zero{"division by zero"};
+            }
+            a /= b;
+            ++ip;
+            VM_DISPATCH();
+        }
+
+        VM_HANDLER(eq): {
+            item_t b = stack.take();
+            item_t& a = stack.top();
+            a = (a == b) ? 1 : 0;
+            ++ip;
+            VM_DISPATCH();
+        }
+
+        VM_HANDLER(neq): {
+            item_t b = stack.take();
+            item_t& a = stack.top();
+            a = (a != b) ? 1 : 0;
+            ++ip;
+            VM_DISPATCH();
+        }
+
+        VM_HANDLER(dup): {
+            stack.push(stack.top());
+            ++ip;
+            VM_DISPATCH();
+        }
+
+        VM_HANDLER(jmp): {
+            VM_JUMP(ip->arg);
+            VM_DISPATCH();
+        }
+
+        VM_HANDLER(jmpz): {
+            if (stack.take() == 0) {
+                VM_JUMP(ip->arg);
+            } else {
+                ++ip;
+            }
+            VM_DISPATCH();
+        }
+
+        VM_HANDLER(write): {
+            vm->output.write_number(stack.top());
+            ++ip;
+            VM_YIELD_ON_WRITE();
+            VM_DISPATCH();
+        }
+
+        VM_HANDLER(write_char): {
+            vm->output.write_char(static_cast<char>(stack.top()));
+            ++ip;
+            VM_YIELD_ON_WRITE();
+            VM_DISPATCH();
+        }
+
+        VM_HANDLER(load_const_add): {
+            stack.reserve();
+            stack.top() += ip->arg;
+            ++ip;
+            VM_DISPATCH();
+        }
+
+        VM_HANDLER(load_const_eq): {
+            stack.reserve();
+            item_t& a = stack.top();
+            a = (a == ip->arg) ? 1 : 0;
+            ++ip;
+            VM_DISPATCH();
+        }
+
+        VM_HANDLER(load_const_neq): {
+            stack.reserve();
+            item_t& a = stack.top();
+            a = (a != ip->arg) ? 1 : 0;
+            ++ip;
+            VM_DISPATCH();
+        }
+
+        VM_HANDLER(load_const_add_dup): {
+            stack.reserve();
+            item_t a = (stack.top() += ip->arg);
+            stack.push(a);
+            ++ip;
+            VM_DISPATCH();
+        }
+
+        VM_HANDLER(dup_jmpz): {
+            stack.reserve();
+            if (stack.top() == 0) {
+                VM_JUMP(ip->arg);
+            } else {
+                ++ip;
+            }
+            VM_DISPATCH();
+        }
+
+        VM_HANDLER(eq_jmpz): {
+            item_t b = stack.take();
+            item_t a = stack.take();
+            if (a != b) {
+                VM_JUMP(ip->arg);
+            } else {
+                ++ip;
+            }
+            VM_DISPATCH();
+        }
+
+        VM_HANDLER(neq_jmpz): {
+            item_t b = stack.take();
+            item_t a = stack.take();
+            if (a == b) {
+                VM_JUMP(ip->arg);
+            } else {
+                ++ip;
+            }
+            VM_DISPATCH();
+        }
+
+        VM_HANDLER(end): {
+            vm->pc = size;
+            throw vm_segfault{"program counter out of bounds"};
+        }
+
+#ifndef VM_COMPUTED_GOTO
+        }
+#endif
+    }
+    catch (vm_segfault&) {
+        // the pc was already set to the invalid address
+        throw;
+    }
+    catch (...) {
+        vm->pc = static_cast<size_t>(ip - code);
+        throw;
+    }
+
+done:
+    vm->pc = static_cast<size_t>(ip - code);
+    if constexpr (limited) {
+        limit->finished = true;
+    }
+    return nullptr;
+
+suspend:
+    // the pc is where to continue
+    vm->pc = static_cast<size_t>(ip - code);
+    return nullptr;
+
+#undef VM_YIELD_ON_WRITE
+#undef VM_COUNT
+#undef VM_JUMP
+#undef VM_HANDLER
+#undef VM_DISPATCH
+
+#ifdef VM_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+}
+#ifdef VM_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+
+} // namespace detail
+
+} // namespace vm
+
+
+#undef VM_COMPUTED_GOTO
@@ -0,0 +1,571 @@
+#include "jit.h"
+
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <optional>
+#include <utility>
+
+#include "threaded.h"
+
+
+// the templates are x86-64 machine code for the System V calling convention,
+// and need a way to get executable memory.
+#if defined(__x86_64__) && not defined(_WIN32) && __has_include(<sys/mman.h>)
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define VM_HAVE_JIT 1
+#endif
+
+
+namespace vm {
+
+enum class jit_program::exit_status : uint32_t {
+    /** EXIT was executed */
+    done,
+    /** an instruction accessed the empty stack */
+    underflow,
+    /** an instruction pushed onto the full stack */
+    overflow,
+    /** DIV with a zero divisor */
+    division_by_zero,
+    /** a jump left the program */
+    bad_jump,
+    /** execution ran past the last instruction */
+    end,
+    /** the instruction has to be executed by the interpreter */
+    fallback,
+};
+
+
+struct jit_program::context {
+    item_t* sp;
+    item_t* base;
+    item_t* high_water;
+    item_t* limit;
+
+    /** native code address for each pc */
+    const void* const* entries;
+
+    /** pc to start executing at */
+    uint64_t start;
+
+    /** pc where the native code was left, set on exit */
+    uint64_t pc;
+};
+
+
+#ifdef VM_HAVE_JIT
+
+namespace {
+
+/**
+ * machine code under construction.
+ *
+ * jumps refer to numbered labels, which are resolved once all code is emitted.
+ */
+class code_buffer {
+public:
+    void bytes(std::initializer_list<uint8_t> values) {
+        code_.insert(std::end(code_), values);
+    }
+
+    void imm32(int32_t value) {
+        append(&value, sizeof(value));
+    }
+
+    void imm64(int64_t value) {
+        append(&value, sizeof(value));
+    }
+
+    /** a byte displacement into the context */
+    void disp8(size_t offset) {
+        code_.push_back(static_cast<uint8_t>(offset));
+    }
+
+    size_t new_label() {
+        labels_.push_back(unbound);
+        return labels_.size() - 1;
+    }
+
+    void bind(size_t label) {
+        labels_[label] = code_.size();
+    }
+
+    /** a 32 bit displacement to the given label, patched in `finish` */
+    void rel32(size_t label) {
+        patches_.emplace_back(code_.size(), label);
+        imm32(0);
+    }
+
+    size_t size() const { return code_.size(); }
+
+    size_t offset(size_t label) const { return labels_[label]; }
+
+    std::vector<uint8_t> finish() {
+        for (auto [position, label] : patches_) {
+            auto displacement = static_cast<int32_t>(
+                static_cast<int64_t>(labels_[label]) - static_cast<int64_t>(position + 4));
+            std::memcpy(code_.data() + position, &displacement, sizeof(displacement));
+        }
+        return std::move(code_);
+    }
+
+private:
+    static constexpr size_t unbound = std::numeric_limits<size_t>::max();
+
+    void append(const void* data, size_t size) {
+        auto bytes = static_cast<const uint8_t*>(data);
+        code_.insert(std::end(code_), bytes, bytes + size);
+    }
+
+    std::vector<uint8_t> code_;
+    std::vector<size_t> labels_;
+
+    /** code offsets of rel32 fields and the label they point to */
+    std::vector<std::pair<size_t, size_t>> patches_;
+};
+
+
+bool fits_imm32(item_t value) {
+    return value >= std::numeric_limits<int32_t>::min()
+           and value <= std::numeric_limits<int32_t>::max();
+}
+
+} // namespace
+
+#endif
+
+
+jit_program::jit_program(const vm_state& vm, std::span<const op_t> code, bool checked)
+    :
+    code_{std::begin(code), std::end(code)},
+    checked_{checked},
+    instructions_{vm.instructions},
+    fallbacks_(code.size(), nullptr) {
+
+    std::vector<opcode> ops;
+    ops.reserve(code.size());
+
+    for (size_t pc = 0; pc < code.size(); pc++) {
+        op_id_t op_id = code[pc].first;
+
+        auto builtin = instructions_->instruction_opcodes.find(op_id);
+        opcode op = (builtin != std::end(instructions_->instruction_opcodes)) ? builtin->second : opcode::custom;
+
+        if (op == opcode::custom or op == opcode::write or op == opcode::write_char) {
+            auto action = instructions_->instruction_actions.find(op_id);
+            if (action == std::end(instructions_->instruction_actions)) {
+                throw invalid_instruction{"unknown op id: " + std::to_string(op_id)};
+            }
+            fallbacks_[pc] = &action->second;
+            fallback_count_ += 1;
+        }
+        ops.push_back(op);
+    }
+
+#ifdef VM_HAVE_JIT
+    // register assignment:
+    //   rbx: stack pointer, one past the top item
+    //   r12: stack base
+    //   r13: high-water mark
+    //   r14: stack limit
+    //   r15: the context
+    // rax and rcx are scratch registers.
+
+    const size_t size = code.size();
+    code_buffer out;
+
+    // one label per pc, plus the one past the end
+    for (size_t pc = 0; pc <= size; pc++) {
+        out.new_label();
+    }
+
+    // exit stubs, each setting the status and pc before leaving
+    std::map<std::pair<exit_status, uint64_t>, size_t> stubs;
+    auto exit_to = [&](exit_status status, uint64_t pc) {
+        auto [stub, inserted] = stubs.try_emplace({status, pc}, 0);
+        if (inserted) {
+            stub->second = out.new_label();
+        }
+        return stub->second;
+    };
+
+    // jcc rel32 to an exit stub
+    auto exit_if = [&](uint8_t condition, exit_status status, uint64_t pc) {
+        out.bytes({0x0F, condition});
+        out.rel32(exit_to(status, pc));
+    };
+
+    constexpr uint8_t jb = 0x82;
+    constexpr uint8_t je = 0x84;
+    constexpr uint8_t jne = 0x85;
+
+    // jcc (or jmp, without condition) rel32 to the given jump target
+    auto jump = [&](std::optional<uint8_t> condition, item_t target) {
+        size_t label = (static_cast<size_t>(target) < size)
+            ? static_cast<size_t>(target)
+            : exit_to(exit_status::bad_jump, static_cast<uint64_t>(target));
+        if (condition) {
+            out.bytes({0x0F, *condition});
+        } else {
+            out.bytes({0xE9});
+        }
+        out.rel32(label);
+    };
+
+    // the stack checks the interpreter does in `operand_stack`,
+    // left out for verified code
+    auto need_items = [&](size_t count, size_t pc) {
+        if (not checked) {
+            return;
+        }
+        if (count == 1) {
+            out.bytes({0x4C, 0x39, 0xE3});               // cmp rbx, r12
+            exit_if(je, exit_status::underflow, pc);
+        } else {
+            out.bytes({0x49, 0x8D, 0x44, 0x24,           // lea rax, [r12 + 8 * count]
+                       static_cast<uint8_t>(8 * count)});
+            out.bytes({0x48, 0x39, 0xC3});               // cmp rbx, rax
+            exit_if(jb, exit_status::underflow, pc);
+        }
+    };
+    auto need_space = [&](size_t pc) {
+        if (not checked) {
+            return;
+        }
+        out.bytes({0x4C, 0x39, 0xF3});                   // cmp rbx, r14
+        exit_if(je, exit_status::overflow, pc);
+    };
+    auto pushed = [&] {
+        out.bytes({0x48, 0x83, 0xC3, 0x08});             // add rbx, 8
+        out.bytes({0x4C, 0x39, 0xEB});                   // cmp rbx, r13
+        out.bytes({0x4C, 0x0F, 0x47, 0xEB});             // cmova r13, rbx
+    };
+    auto load_rax = [&](item_t value) {
+        out.bytes({0x48, 0xB8});                         // mov rax, imm64
+        out.imm64(value);
+    };
+
+    // entry: save callee-saved registers, load the context and jump to the start pc
+    out.bytes({0x53});                                   // push rbx
+    out.bytes({0x41, 0x54});                             // push r12
+    out.bytes({0x41, 0x55});                             // push r13
+    out.bytes({0x41, 0x56});                             // push r14
+    out.bytes({0x41, 0x57});                             // push r15
+    out.bytes({0x49, 0x89, 0xFF});                       // mov r15, rdi
+    out.bytes({0x49, 0x8B, 0x5F});                       // mov rbx, [r15 + sp]
+    out.disp8(offsetof(context, sp));
+    out.bytes({0x4D, 0x8B, 0x67});                       // mov r12, [r15 + base]
+    out.disp8(offsetof(context, base));
+    out.bytes({0x4D, 0x8B, 0x6F});                       // mov r13, [r15 + high_water]
+    out.disp8(offsetof(context, high_water));
+    out.bytes({0x4D, 0x8B, 0x77});                       // mov r14, [r15 + limit]
+    out.disp8(offsetof(context, limit));
+    out.bytes({0x49, 0x8B, 0x47});                       // mov rax, [r15 + start]
+    out.disp8(offsetof(context, start));
+    out.bytes({0x49, 0x8B, 0x4F});                       // mov rcx, [r15 + entries]
+    out.disp8(offsetof(context, entries));
+    out.bytes({0xFF, 0x24, 0xC1});                       // jmp [rcx + rax * 8]
+
+    for (size_t pc = 0; pc < size; pc++) {
+        out.bind(pc);
+        item_t arg = code[pc].second;
+
+        switch (ops[pc]) {
+        case opcode::custom:
+        case opcode::write:
+        case opcode::write_char:
+            out.bytes({0xE9});                           // jmp fallback
+            out.rel32(exit_to(exit_status::fallback, pc));
+            break;
+
+        case opcode::end:
+            out.bytes({0xE9});                           // jmp end
+            out.rel32(exit_to(exit_status::end, pc));
+            break;
+
+        case opcode::load_const:
+            need_space(pc);
+            if (fits_imm32(arg)) {
+                out.bytes({0x48, 0xC7, 0x03});           // mov qword [rbx], imm32
+                out.imm32(static_cast<int32_t>(arg));
+            } else {
+                load_rax(arg);
+                out.bytes({0x48, 0x89, 0x03});           // mov [rbx], rax
+            }
+            pushed();
+            break;
+
+        case opcode::exit:
+            need_items(1, pc);
+            out.bytes({0xE9});                           // jmp done
+            out.rel32(exit_to(exit_status::done, pc));
+            break;
+
+        case opcode::pop:
+            need_items(1, pc);
+            out.bytes({0x48, 0x83, 0xEB, 0x08});         // sub rbx, 8
+            break;
+
+        case opcode::add:
+            need_items(2, pc);
+            out.bytes({0x48, 0x8B, 0x43, 0xF8});         // mov rax, [rbx - 8]
+            out.bytes({0x48, 0x83, 0xEB, 0x08});         // sub rbx, 8
+            out.bytes({0x48, 0x01, 0x43, 0xF8});         // add [rbx - 8], rax
+            break;
+
+        case opcode::div:
+            need_items(2, pc);
+            out.bytes({0x48, 0x8B, 0x4B, 0xF8});         // mov rcx, [rbx - 8]
+            out.bytes({0x48, 0x85, 0xC9});               // test rcx, rcx
+            exit_if(je, exit_status::division_by_zero, pc);
+            out.bytes({0x48, 0x8B, 0x43, 0xF0});         // mov rax, [rbx - 16]
+            out.bytes({0x48, 0x99});                     // cqo
+            out.bytes({0x48, 0xF7, 0xF9});               // idiv rcx
+            out.bytes({0x48, 0x89, 0x43, 0xF0});         // mov [rbx - 16], rax
+            out.bytes({0x48, 0x83, 0xEB, 0x08});         // sub rbx, 8
+            break;
+
+        case opcode::eq:
+        case opcode::neq:
+            need_items(2, pc);
+            out.bytes({0x48, 0x8B, 0x43, 0xF8});         // mov rax, [rbx - 8]
+            out.bytes({0x48, 0x83, 0xEB, 0x08});         // sub rbx, 8
+            out.bytes({0x48, 0x39, 0x43, 0xF8});         // cmp [rbx - 8], rax
+            out.bytes({0x0F, static_cast<uint8_t>(      // sete/setne al
+                ops[pc] == opcode::eq ? 0x94 : 0x95), 0xC0});
+            out.bytes({0x0F, 0xB6, 0xC0});               // movzx eax, al
+            out.bytes({0x48, 0x89, 0x43, 0xF8});         // mov [rbx - 8], rax
+            break;
+
+        case opcode::dup:
+            need_items(1, pc);
+            need_space(pc);
+            out.bytes({0x48, 0x8B, 0x43, 0xF8});         // mov rax, [rbx - 8]
+            out.bytes({0x48, 0x89, 0x03});               // mov [rbx], rax
+            pushed();
+            break;
+
+        case opcode::jmp:
+            jump(std::nullopt, arg);
+            break;
+
+        case opcode::jmpz:
+            need_items(1, pc);
+            out.bytes({0x48, 0x83, 0xEB, 0x08});         // sub rbx, 8
+            out.bytes({0x48, 0x83, 0x3B, 0x00});         // cmp qword [rbx], 0
+            jump(je, arg);
+            break;
+
+        case opcode::load_const_add:
+            need_space(pc);
+            need_items(1, pc);
+            if (fits_imm32(arg)) {
+                out.bytes({0x48, 0x81, 0x43, 0xF8});     // add qword [rbx - 8], imm32
+                out.imm32(static_cast<int32_t>(arg));
+            } else {
+                load_rax(arg);
+                out.bytes({0x48, 0x01, 0x43, 0xF8});     // add [rbx - 8], rax
+            }
+            break;
+
+        case opcode::load_const_eq:
+        case opcode::load_const_neq:
+            need_space(pc);
+            need_items(1, pc);
+            load_rax(arg);
+            out.bytes({0x48, 0x39, 0x43, 0xF8});         // cmp [rbx - 8], rax
+            out.bytes({0x0F, static_cast<uint8_t>(      // sete/setne al
+                ops[pc] == opcode::load_const_eq ? 0x94 : 0x95), 0xC0});
+            out.bytes({0x0F, 0xB6, 0xC0});               // movzx eax, al
+            out.bytes({0x48, 0x89, 0x43, 0xF8});         // mov [rbx - 8], rax
+            break;
+
+        case opcode::load_const_add_dup:
+            need_space(pc);
+            need_items(1, pc);
+            load_rax(arg);
+            out.bytes({0x48, 0x03, 0x43, 0xF8});         // add rax, [rbx - 8]
+            out.bytes({0x48, 0x89, 0x43, 0xF8});         // mov [rbx - 8], rax
+            out.bytes({0x48, 0x89, 0x03});               // mov [rbx], rax
+            pushed();
+            break;
+
+        case opcode::dup_jmpz:
+            need_space(pc);
+            need_items(1, pc);
+            out.bytes({0x48, 0x83, 0x7B, 0xF8, 0x00});   // cmp qword [rbx - 8], 0
+            jump(je, arg);
+            break;
+
+        case opcode::eq_jmpz:
+        case opcode::neq_jmpz:
+            need_items(2, pc);
+            out.bytes({0x48, 0x8B, 0x43, 0xF8});         // mov rax, [rbx - 8]
+            out.bytes({0x48, 0x8B, 0x4B, 0xF0});         // mov rcx, [rbx - 16]
+            out.bytes({0x48, 0x83, 0xEB, 0x10});         // sub rbx, 16
+            out.bytes({0x48, 0x39, 0xC1});               // cmp rcx, rax
+            jump(ops[pc] == opcode::eq_jmpz ? jne : je, arg);
+            break;
+        }
+    }
+
+    // running past the last instruction
+    out.bind(size);
+    out.bytes({0xE9});
+    out.rel32(exit_to(exit_status::end, size));
+
+    // the exits store the pc, then share the epilogue
+    size_t epilogue = out.new_label();
+    for (auto [exit, label] : stubs) {
+        auto [status, pc] = exit;
+        out.bind(label);
+        load_rax(static_cast<item_t>(pc));
+        out.bytes({0x49, 0x89, 0x47});                   // mov [r15 + pc], rax
+        out.disp8(offsetof(context, pc));
+        out.bytes({0xB8});                               // mov eax, status
+        out.imm32(static_cast<int32_t>(status));
+        out.bytes({0xE9});                               // jmp epilogue
+        out.rel32(epilogue);
+    }
+
+    out.bind(epilogue);
+    out.bytes({0x49, 0x89, 0x5F});                       // mov [r15 + sp], rbx
+    out.disp8(offsetof(context, sp));
+    out.bytes({0x4D, 0x89, 0x6F});                       // mov [r15 + high_water], r13
+    out.disp8(offsetof(context, high_water));
+    out.bytes({0x41, 0x5F});                             // pop r15
+    out.bytes({0x41, 0x5E});                             // pop r14
+    out.bytes({0x41, 0x5D});                             // pop r13
+    out.bytes({0x41, 0x5C});                             // pop r12
+    out.bytes({0x5B});                                   // pop rbx
+    out.bytes({0xC3});                                   // ret
+
+    // rel32 displacements can't reach further, leave such programs to the interpreter
+    if (out.size() > static_cast<size_t>(std::numeric_limits<int32_t>::max())) {
+        return;
+    }
+
+    std::vector<size_t> offsets;
+    offsets.reserve(size + 1);
+    for (size_t pc = 0; pc <= size; pc++) {
+        offsets.push_back(out.offset(pc));
+    }
+    std::vector<uint8_t> machine_code = out.finish();
+
+    // write the code, then make it executable, but never both at once
+    size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    size_t memory_size = (machine_code.size() + page - 1) / page * page;
+    void* memory = ::mmap(nullptr, memory_size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return;
+    }
+    std::memcpy(memory, machine_code.data(), machine_code.size());
+    if (::mprotect(memory, memory_size, PROT_READ | PROT_EXEC) != 0) {
+        ::munmap(memory, memory_size);
+        return;
+    }
+
+    memory_ = memory;
+    memory_size_ = memory_size;
+
+    auto base = static_cast<const uint8_t*>(memory);
+    entries_.reserve(offsets.size());
+    for (size_t offset : offsets) {
+        entries_.push_back(base + offset);
+    }
+    entry_ = reinterpret_cast<entry_t>(memory);
+#endif
+}
+
+
+jit_program::~jit_program() {
+#ifdef VM_HAVE_JIT
+    if (memory_ != nullptr) {
+        ::munmap(memory_, memory_size_);
+    }
+#endif
+}
+
+
+std::tuple<item_t, std::string> jit_program::run(vm_state& vm) const {
+    if (not compiled()) {
+        return run_threaded(vm, thread_code(vm, code_, checked_));
+    }
+
+    vm.pc = 0;
+    vm.stack.clear();
+    vm.output.clear();
+
+    operand_stack& stack = vm.stack;
+    context ctx{};
+    ctx.entries = entries_.data();
+
+    while (true) {
+        // fallback actions may have changed the stack, so reload it each time
+        ctx.sp = stack.sp_;
+        ctx.base = stack.base();
+        ctx.high_water = stack.high_water_;
+        ctx.limit = stack.limit_;
+        ctx.start = vm.pc;
+
+        auto status = static_cast<exit_status>(entry_(&ctx));
+
+        stack.sp_ = ctx.sp;
+        stack.high_water_ = ctx.high_water;
+        vm.pc = static_cast<size_t>(ctx.pc);
+
+        switch (status) {
+        case exit_status::done:
+            return {stack.top(), vm.output.take()};
+        case exit_status::underflow:
+            stack.underflow();
+        case exit_status::overflow:
+            stack.overflow();
+        case exit_status::division_by_zero:
+            throw div_by_zero{"division by zero"};
+        case exit_status::bad_jump:
+            throw vm_segfault{"jump out of program bounds"};
+        case exit_status::end:
+            throw vm_segfault{"program counter out of bounds"};
+        case exit_status::fallback:
+            break;
+        }
+
+        size_t pc = vm.pc;
+        vm.pc = pc + 1;
+        try {
+            if (not (*fallbacks_[pc])(vm, code_[pc].second)) {
+                vm.pc = pc;
+                return {stack.top(), vm.output.take()};
+            }
+        }
+        catch (vm_segfault&) {
+            throw;
+        }
+        catch (...) {
+            vm.pc = pc;
+            throw;
+        }
+
+        // the pc past the end is fine, its code raises the segfault
+        if (vm.pc > code_.size()) {
+            throw vm_segfault{"jump out of program bounds"};
+        }
+    }
+}
+
+
+std::tuple<item_t, std::string> run_jit(vm_state& vm, std::span<const op_t> code,
+                                        bool checked) {
+    return jit_program{vm, code, checked}.run(vm);
+}
+
+
+} // namespace vm
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "vm.h"
+
+
+namespace vm {
+
+/**
+ * a program compiled to native x86-64 code.
+ *
+ * each built-in instruction is translated by a fixed machine code template,
+ * with the stack pointer held in a register and jumps going directly to the
+ * target's code. errors leave the native code and are thrown like `run` does.
+ *
+ * instructions without template (custom ones, WRITE, WRITE_CHAR) return to
+ * the interpreter, which executes their action and re-enters the native code
+ * at the following pc.
+ *
+ * on other platforms nothing is compiled, and `run` uses the threaded engine.
+ */
+class jit_program {
+public:
+    /**
+     * unchecked code must have been verified with `verify`, then no stack
+     * or jump checks are compiled in.
+     */
+    jit_program(const vm_state& vm, std::span<const op_t> code, bool checked = true);
+    ~jit_program();
+
+    jit_program(const jit_program&) = delete;
+    jit_program& operator=(const jit_program&) = delete;
+
+    /** whether native code was generated */
+    bool compiled() const { return entry_ != nullptr; }
+
+    /** number of instructions that have to run in the interpreter */
+    size_t fallback_count() const { return fallback_count_; }
+
+    /**
+     * execute the program.
+     *
+     * @return the same results as `run`.
+     */
+    std::tuple<item_t, std::string> run(vm_state& vm) const;
+
+private:
+    /** how the native code was left */
+    enum class exit_status : uint32_t;
+
+    /** registers the native code loads and stores, layout known to the templates */
+    struct context;
+
+    using entry_t = uint32_t (*)(context*);
+
+    std::vector<op_t> code_;
+    bool checked_;
+
+    /** the table the fallback actions are referenced from */
+    std::shared_ptr<const instruction_table> instructions_;
+
+    /** actions for instructions without template, by pc */
+    std::vector<const op_action_t*> fallbacks_;
+    size_t fallback_count_ = 0;
+
+    /** executable memory holding the native code */
+    void* memory_ = nullptr;
+    size_t memory_size_ = 0;
+
+    /** native code address for each pc, the one past the last raises a segfault */
+    std::vector<const void*> entries_;
+
+    entry_t entry_ = nullptr;
+};
+
+
+/**
+ * compile the code and run it.
+ */
+std::tuple<item_t, std::string> run_jit(vm_state& vm, std::span<const op_t> code,
+                                        bool checked = true);
+
+
+} // namespace vm
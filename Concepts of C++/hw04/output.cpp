@@ -0,0 +1,107 @@
+#include "output.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <system_error>
+
+#if __has_include(<unistd.h>)
+#include <unistd.h>
+#define VM_HAVE_POSIX_WRITE 1
+#else
+#include <io.h>
+#endif
+
+
+namespace vm {
+
+output_buffer::output_buffer(size_t capacity)
+    :
+    buffer_(std::max(capacity, max_number_length)) {}
+
+
+void output_buffer::set_sink(sink_t sink) {
+    flush();
+    sink_ = std::move(sink);
+}
+
+
+std::string output_buffer::take() {
+    flush();
+    return std::exchange(collected_, {});
+}
+
+
+void output_buffer::clear() {
+    used_ = 0;
+    collected_.clear();
+}
+
+
+void output_buffer::spill() {
+    if (used_ == 0) {
+        return;
+    }
+
+    std::string_view text{buffer_.data(), used_};
+    used_ = 0;
+    if (sink_) {
+        sink_(text);
+    } else {
+        collected_ += text;
+    }
+}
+
+
+output_buffer::sink_t fd_sink(int fd) {
+    return [fd](std::string_view text) {
+        while (not text.empty()) {
+#ifdef VM_HAVE_POSIX_WRITE
+            auto written = ::write(fd, text.data(), text.size());
+#else
+            auto written = ::_write(fd, text.data(), static_cast<unsigned>(text.size()));
+#endif
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error{errno, std::generic_category(), "failed to write vm output"};
+            }
+            text.remove_prefix(static_cast<size_t>(written));
+        }
+    };
+}
+
+
+output_ring::output_ring(size_t capacity)
+    :
+    ring_(std::max<size_t>(capacity, 1), '\0') {}
+
+
+void output_ring::write(std::string_view text) {
+    const size_t capacity = ring_.size();
+
+    // only the end of long texts fits
+    if (text.size() > capacity) {
+        total_ += text.size() - capacity;
+        text.remove_prefix(text.size() - capacity);
+    }
+
+    size_t start = static_cast<size_t>(total_ % capacity);
+    size_t first = std::min(text.size(), capacity - start);
+    ring_.replace(start, first, text.substr(0, first));
+    ring_.replace(0, text.size() - first, text.substr(first));
+    total_ += text.size();
+}
+
+
+std::string output_ring::contents() const {
+    const size_t capacity = ring_.size();
+    if (total_ <= capacity) {
+        return ring_.substr(0, static_cast<size_t>(total_));
+    }
+    size_t start = static_cast<size_t>(total_ % capacity);
+    return ring_.substr(start) + ring_.substr(0, start);
+}
+
+
+} // namespace vm
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "vm.h"
+
+
+namespace vm {
+
+/**
+ * a sink writing the output to a file descriptor, e.g. 1 for stdout.
+ *
+ * @throw std::system_error if writing fails.
+ */
+output_buffer::sink_t fd_sink(int fd);
+
+
+/**
+ * keeps the most recent output in a fixed amount of memory.
+ *
+ * use it through `sink()`, which refers to the ring, so it must outlive the
+ * vm's use of the sink.
+ */
+class output_ring {
+public:
+    explicit output_ring(size_t capacity);
+
+    void write(std::string_view text);
+
+    output_buffer::sink_t sink() {
+        return [this](std::string_view text) { write(text); };
+    }
+
+    /** the last written text, at most `capacity` bytes, oldest first */
+    std::string contents() const;
+
+    /** number of bytes ever written */
+    uint64_t total() const { return total_; }
+
+private:
+    std::string ring_;
+    uint64_t total_ = 0;
+};
+
+
+} // namespace vm
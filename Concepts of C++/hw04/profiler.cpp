@@ -0,0 +1,188 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <ios>
+#include <ostream>
+
+
+namespace vm {
+
+namespace {
+
+constexpr char trace_magic[8] = {'V', 'M', 'T', 'R', 'A', 'C', 'E', '\0'};
+
+
+/**
+ * whether the instruction is a conditional jump, for which the report
+ * shows how often it was taken.
+ */
+bool is_branch(const instruction_table& table, op_id_t op_id) {
+    auto builtin = table.instruction_opcodes.find(op_id);
+    if (builtin == std::end(table.instruction_opcodes)) {
+        return false;
+    }
+    switch (builtin->second) {
+    case opcode::jmpz:
+    case opcode::dup_jmpz:
+    case opcode::eq_jmpz:
+    case opcode::neq_jmpz:
+        return true;
+    default:
+        return false;
+    }
+}
+
+
+std::string name_of(const instruction_table& table, op_id_t op_id) {
+    auto name = table.instruction_names.find(op_id);
+    if (name == std::end(table.instruction_names)) {
+        return "<op " + std::to_string(op_id) + ">";
+    }
+    return name->second;
+}
+
+
+/**
+ * indices of the counters that were executed, most cycles first.
+ */
+std::vector<size_t> hottest(const std::vector<profiler::counters>& counters, size_t limit) {
+    std::vector<size_t> order;
+    for (size_t i = 0; i < counters.size(); i++) {
+        if (counters[i].executions > 0) {
+            order.push_back(i);
+        }
+    }
+
+    auto by_cycles = [&](size_t a, size_t b) {
+        if (counters[a].cycles != counters[b].cycles) {
+            return counters[a].cycles > counters[b].cycles;
+        }
+        return a < b;
+    };
+    size_t shown = std::min(limit, order.size());
+    std::partial_sort(std::begin(order), std::begin(order) + static_cast<ptrdiff_t>(shown),
+                      std::end(order), by_cycles);
+    order.resize(shown);
+    return order;
+}
+
+} // namespace
+
+
+profiler::profiler(size_t trace_capacity)
+    :
+    trace_(trace_capacity) {}
+
+
+void profiler::begin(size_t code_size, size_t op_id_count) {
+    if (by_pc_.size() < code_size) {
+        by_pc_.resize(code_size);
+        op_at_pc_.resize(code_size);
+    }
+    if (by_op_.size() < op_id_count) {
+        by_op_.resize(op_id_count);
+    }
+}
+
+
+std::vector<profiler::trace_entry> profiler::trace() const {
+    std::vector<trace_entry> entries;
+    if (trace_.empty()) {
+        return entries;
+    }
+
+    size_t count = static_cast<size_t>(std::min<uint64_t>(trace_next_, trace_.size()));
+    size_t oldest = static_cast<size_t>((trace_next_ - count) % trace_.size());
+    entries.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        entries.push_back(trace_[(oldest + i) % trace_.size()]);
+    }
+    return entries;
+}
+
+
+void profiler::save_trace(std::ostream& output) const {
+    std::vector<trace_entry> entries = trace();
+    uint64_t count = entries.size();
+
+    output.write(trace_magic, sizeof(trace_magic));
+    output.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    output.write(reinterpret_cast<const char*>(entries.data()),
+                 static_cast<std::streamsize>(entries.size() * sizeof(trace_entry)));
+}
+
+
+void profiler::report(std::ostream& output, const vm_state& vm, size_t limit) const {
+    const instruction_table& table = *vm.instructions;
+
+    // the table sets alignment and precision, the caller's are restored afterwards
+    const std::ios_base::fmtflags flags = output.flags();
+    const std::streamsize precision = output.precision();
+
+    uint64_t total_cycles = 0;
+    uint64_t total_executions = 0;
+    for (const auto& counter : by_op_) {
+        total_cycles += counter.cycles;
+        total_executions += counter.executions;
+    }
+
+    auto share = [&](uint64_t cycles) {
+        return total_cycles == 0 ? 0.0 : 100.0 * static_cast<double>(cycles) / static_cast<double>(total_cycles);
+    };
+
+    output << total_executions << " instructions executed in " << total_cycles << " cycles\n";
+
+    output << "\nhottest instructions:\n"
+           << std::left << std::setw(20) << "  instruction"
+           << std::right << std::setw(14) << "executions"
+           << std::setw(14) << "cycles"
+           << std::setw(10) << "cyc/exec"
+           << std::setw(8) << "share" << "\n";
+    for (size_t op_id : hottest(by_op_, limit)) {
+        const counters& counter = by_op_[op_id];
+        output << "  " << std::left << std::setw(18) << name_of(table, op_id)
+               << std::right << std::setw(14) << counter.executions
+               << std::setw(14) << counter.cycles
+               << std::setw(10) << std::fixed << std::setprecision(1)
+               << static_cast<double>(counter.cycles) / static_cast<double>(counter.executions)
+               << std::setw(7) << share(counter.cycles) << "%\n";
+    }
+
+    output << "\nhottest pcs:\n"
+           << std::right << std::setw(8) << "pc"
+           << std::left << "  " << std::setw(18) << "instruction"
+           << std::right << std::setw(14) << "executions"
+           << std::setw(14) << "cycles"
+           << std::setw(8) << "share"
+           << std::setw(8) << "taken" << "\n";
+    for (size_t pc : hottest(by_pc_, limit)) {
+        const counters& counter = by_pc_[pc];
+        op_id_t op_id = op_at_pc_[pc];
+        output << std::right << std::setw(8) << pc
+               << "  " << std::left << std::setw(18) << name_of(table, op_id)
+               << std::right << std::setw(14) << counter.executions
+               << std::setw(14) << counter.cycles
+               << std::setw(7) << std::fixed << std::setprecision(1) << share(counter.cycles) << "%";
+        if (is_branch(table, op_id)) {
+            output << std::setw(7)
+                   << 100.0 * static_cast<double>(counter.jumps) / static_cast<double>(counter.executions)
+                   << "%";
+        }
+        output << "\n";
+    }
+    output.flags(flags);
+    output.precision(precision);
+    output.flush();
+}
+
+
+void profiler::reset() {
+    by_pc_.clear();
+    op_at_pc_.clear();
+    by_op_.clear();
+    trace_next_ = 0;
+}
+
+
+} // namespace vm
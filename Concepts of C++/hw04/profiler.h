@@ -0,0 +1,136 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "vm.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define VM_HAVE_RDTSC 1
+#endif
+
+
+namespace vm {
+
+/**
+ * collects an execution profile of the programs a vm runs.
+ *
+ * attach it with `vm_state::profile`, then each executed instruction is
+ * counted and timed, per pc and per instruction. for instructions that can
+ * jump, how often they did is recorded, which gives the taken ratio of JMPZ.
+ * with a trace capacity, the last executed instructions are also kept in a
+ * ring buffer.
+ *
+ * counts accumulate over all runs until `reset`.
+ * time is measured in cycles of the time stamp counter where available,
+ * otherwise in nanoseconds.
+ */
+class profiler {
+public:
+    /** what was measured for one pc or instruction */
+    struct counters {
+        uint64_t executions = 0;
+        uint64_t cycles = 0;
+        /** executions that continued elsewhere than at the next pc */
+        uint64_t jumps = 0;
+    };
+
+    /** one executed instruction in the trace */
+    struct trace_entry {
+        /** clock value before the instruction executed */
+        uint64_t time;
+        uint64_t pc;
+        op_id_t op_id;
+        /** stack size after the instruction executed */
+        uint64_t stack_size;
+    };
+
+    /**
+     * @param trace_capacity: how many of the last executed instructions to
+     *                        keep in the trace, 0 disables tracing.
+     */
+    explicit profiler(size_t trace_capacity = 0);
+
+    /** read the clock used for timing instructions */
+    static uint64_t now() {
+#ifdef VM_HAVE_RDTSC
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    /**
+     * make room for counting a program of the given size,
+     * called by `run` before executing it.
+     */
+    void begin(size_t code_size, size_t op_id_count);
+
+    /**
+     * count one execution of the instruction at pc.
+     * `begin` must have been called with a large enough program.
+     */
+    void record(size_t pc, op_id_t op_id, size_t next_pc, size_t stack_size,
+                uint64_t start, uint64_t end) {
+        uint64_t cycles = end - start;
+        bool jumped = next_pc != pc + 1;
+
+        counters& at_pc = by_pc_[pc];
+        at_pc.executions += 1;
+        at_pc.cycles += cycles;
+        at_pc.jumps += jumped;
+        op_at_pc_[pc] = op_id;
+
+        counters& of_op = by_op_[op_id];
+        of_op.executions += 1;
+        of_op.cycles += cycles;
+        of_op.jumps += jumped;
+
+        if (not trace_.empty()) {
+            trace_[trace_next_ % trace_.size()] = {start, pc, op_id, stack_size};
+            trace_next_ += 1;
+        }
+    }
+
+    /** counters indexed by pc */
+    const std::vector<counters>& by_pc() const { return by_pc_; }
+
+    /** counters indexed by op id */
+    const std::vector<counters>& by_op() const { return by_op_; }
+
+    /** the traced instructions, oldest first */
+    std::vector<trace_entry> trace() const;
+
+    /**
+     * write the trace in binary form: the magic bytes "VMTRACE\0", the
+     * number of entries as uint64_t, then the `trace_entry`s, oldest first,
+     * all in native byte order.
+     */
+    void save_trace(std::ostream& output) const;
+
+    /**
+     * print the instructions and pcs that took the most time,
+     * at most `limit` of each.
+     */
+    void report(std::ostream& output, const vm_state& vm, size_t limit = 20) const;
+
+    /** forget everything recorded so far */
+    void reset();
+
+private:
+    std::vector<counters> by_pc_;
+    std::vector<op_id_t> op_at_pc_;
+    std::vector<counters> by_op_;
+
+    std::vector<trace_entry> trace_;
+    /** total number of entries ever traced, the next slot modulo the capacity */
+    uint64_t trace_next_ = 0;
+};
+
+
+} // namespace vm
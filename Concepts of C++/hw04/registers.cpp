@@ -0,0 +1,565 @@
+#include "registers.h"
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+#include "threaded.h"
+#include "verifier.h"
+
+
+// see threaded.cpp, the register machine dispatches the same way.
+#if defined(__GNUC__)
+#define VM_COMPUTED_GOTO 1
+#endif
+
+
+namespace vm {
+
+namespace {
+
+/**
+ * what a stack slot holds during translation: a register or a constant.
+ */
+struct operand {
+    bool constant;
+    item_t value;
+    uint32_t reg;
+
+    static operand of_register(size_t reg) { return {false, 0, static_cast<uint32_t>(reg)}; }
+    static operand of_constant(item_t value) { return {true, value, 0}; }
+};
+
+
+/**
+ * two's complement arithmetic for folding constants, which never overflows.
+ */
+item_t wrapping_add(item_t a, item_t b) {
+    return static_cast<item_t>(static_cast<uint64_t>(a) + static_cast<uint64_t>(b));
+}
+
+
+/**
+ * translates verified stack code into register code.
+ *
+ * slot i of the stack belongs to register i. within a basic block the slots
+ * are tracked symbolically, and slot i may hold a constant or refer to a
+ * register j < i holding the same value. a slot only refers to register j
+ * if slot j is still in register j, so writing a slot's own register never
+ * clobbers a value another slot refers to.
+ */
+class translator {
+public:
+    translator(const instruction_table& table, std::span<const op_t> code,
+               const verification& proof)
+        :
+        table_{table},
+        code_{code},
+        proof_{proof} {}
+
+    std::vector<register_op> translate() {
+        find_jump_targets();
+
+        std::vector<size_t> op_of_pc(code_.size(), 0);
+        bool live = false;
+
+        for (pc_ = 0; pc_ < code_.size(); pc_++) {
+            size_t depth = proof_.depth[pc_];
+            if (depth == verification::unreachable) {
+                live = false;
+                continue;
+            }
+
+            // blocks start with all slots in their own registers
+            if (jump_target_[pc_] or not live) {
+                if (live) {
+                    materialize();
+                }
+                slots_.clear();
+                for (size_t slot = 0; slot < depth; slot++) {
+                    slots_.push_back(operand::of_register(slot));
+                }
+            }
+            op_of_pc[pc_] = ops_.size();
+
+            live = translate(table_.instruction_opcodes.at(code_[pc_].first), code_[pc_].second);
+        }
+
+        // jumps were emitted with their target pc
+        for (auto& op : ops_) {
+            switch (op.op) {
+            case register_opcode::jump:
+            case register_opcode::jump_zero:
+            case register_opcode::jump_eq:
+            case register_opcode::jump_neq:
+                op.imm = static_cast<item_t>(op_of_pc[static_cast<size_t>(op.imm)]);
+                break;
+            default:
+                break;
+            }
+        }
+
+        return std::move(ops_);
+    }
+
+private:
+    void find_jump_targets() {
+        jump_target_.assign(code_.size(), false);
+        for (size_t pc = 0; pc < code_.size(); pc++) {
+            if (proof_.depth[pc] == verification::unreachable) {
+                continue;
+            }
+            switch (table_.instruction_opcodes.at(code_[pc].first)) {
+            case opcode::jmp:
+            case opcode::jmpz:
+            case opcode::dup_jmpz:
+            case opcode::eq_jmpz:
+            case opcode::neq_jmpz:
+                // verified, so the target is within the program
+                jump_target_[static_cast<size_t>(code_[pc].second)] = true;
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    /**
+     * translate one instruction.
+     * @return whether execution can continue with the next one.
+     */
+    bool translate(opcode op, item_t arg) {
+        switch (op) {
+        case opcode::load_const:
+            slots_.push_back(operand::of_constant(arg));
+            return true;
+
+        case opcode::pop:
+            slots_.pop_back();
+            return true;
+
+        case opcode::dup:
+            slots_.push_back(slots_.back());
+            return true;
+
+        case opcode::add:
+        case opcode::eq:
+        case opcode::neq: {
+            operand b = take();
+            operand a = take();
+            commutative(op, a, b);
+            return true;
+        }
+
+        case opcode::div: {
+            operand b = take();
+            operand a = take();
+            divide(a, b);
+            return true;
+        }
+
+        case opcode::load_const_add:
+        case opcode::load_const_eq:
+        case opcode::load_const_neq: {
+            operand a = take();
+            opcode base = (op == opcode::load_const_add) ? opcode::add
+                        : (op == opcode::load_const_eq) ? opcode::eq
+                        : opcode::neq;
+            commutative(base, a, operand::of_constant(arg));
+            return true;
+        }
+
+        case opcode::load_const_add_dup: {
+            operand a = take();
+            commutative(opcode::add, a, operand::of_constant(arg));
+            slots_.push_back(slots_.back());
+            return true;
+        }
+
+        case opcode::jmp:
+            materialize();
+            emit(register_opcode::jump, 0, 0, 0, arg);
+            return false;
+
+        case opcode::jmpz: {
+            operand condition = take();
+            materialize();
+            return jump_if_zero(condition, arg);
+        }
+
+        case opcode::dup_jmpz:
+            materialize();
+            return jump_if_zero(slots_.back(), arg);
+
+        case opcode::eq_jmpz:
+        case opcode::neq_jmpz: {
+            operand b = take();
+            operand a = take();
+            materialize();
+            // EQ_JMPZ jumps if the values differ
+            bool jump_if_equal = (op == opcode::neq_jmpz);
+            if (a.constant and b.constant) {
+                if ((a.value == b.value) == jump_if_equal) {
+                    emit(register_opcode::jump, 0, 0, 0, arg);
+                    return false;
+                }
+                return true;
+            }
+            if (a.constant) {
+                std::swap(a, b);
+            }
+            // the jump target takes the constant's place, so compare with
+            // a scratch register instead
+            uint32_t compared = b.reg;
+            if (b.constant) {
+                compared = scratch();
+                emit(register_opcode::load, compared, 0, 0, b.value);
+            }
+            emit(jump_if_equal ? register_opcode::jump_eq : register_opcode::jump_neq,
+                 0, a.reg, compared, arg);
+            return true;
+        }
+
+        case opcode::write:
+        case opcode::write_char: {
+            const operand& top = slots_.back();
+            bool number = (op == opcode::write);
+            if (top.constant) {
+                emit(number ? register_opcode::write_i : register_opcode::write_char_i,
+                     0, 0, 0, top.value);
+            } else {
+                emit(number ? register_opcode::write_r : register_opcode::write_char_r,
+                     0, top.reg, 0, 0);
+            }
+            return true;
+        }
+
+        case opcode::exit:
+            materialize();
+            emit(register_opcode::exit, 0, static_cast<uint32_t>(slots_.size()), 0, 0);
+            return false;
+
+        case opcode::custom:
+        case opcode::end:
+            break;
+        }
+        throw std::logic_error{"can't translate opcode " + std::to_string(static_cast<int>(op))};
+    }
+
+    operand take() {
+        operand top = slots_.back();
+        slots_.pop_back();
+        return top;
+    }
+
+    /** the position the next pushed slot gets */
+    uint32_t next_slot() const { return static_cast<uint32_t>(slots_.size()); }
+
+    /**
+     * the register holding the operand, loading constants into the
+     * register of the given slot.
+     */
+    uint32_t in_register(const operand& value, uint32_t slot) {
+        if (not value.constant) {
+            return value.reg;
+        }
+        emit(register_opcode::load, slot, 0, 0, value.value);
+        return slot;
+    }
+
+    /** ADD, EQ or NEQ of two operands, pushing the result */
+    void commutative(opcode op, operand a, operand b) {
+        if (a.constant and b.constant) {
+            item_t result = (op == opcode::add) ? wrapping_add(a.value, b.value)
+                          : (op == opcode::eq) ? (a.value == b.value ? 1 : 0)
+                          : (a.value != b.value ? 1 : 0);
+            slots_.push_back(operand::of_constant(result));
+            return;
+        }
+
+        if (a.constant) {
+            std::swap(a, b);
+        }
+
+        uint32_t dst = next_slot();
+        if (b.constant) {
+            register_opcode ri = (op == opcode::add) ? register_opcode::add_ri
+                               : (op == opcode::eq) ? register_opcode::eq_ri
+                               : register_opcode::neq_ri;
+            emit(ri, dst, a.reg, 0, b.value);
+        } else {
+            register_opcode rr = (op == opcode::add) ? register_opcode::add_rr
+                               : (op == opcode::eq) ? register_opcode::eq_rr
+                               : register_opcode::neq_rr;
+            emit(rr, dst, a.reg, b.reg, 0);
+        }
+        slots_.push_back(operand::of_register(dst));
+    }
+
+    void divide(const operand& a, const operand& b) {
+        constexpr item_t min = std::numeric_limits<item_t>::min();
+
+        if (b.constant and b.value == 0) {
+            emit(register_opcode::div_zero, 0, 0, 0, 0);
+            slots_.push_back(operand::of_constant(0));
+            return;
+        }
+        if (a.constant and b.constant and not (a.value == min and b.value == -1)) {
+            slots_.push_back(operand::of_constant(a.value / b.value));
+            return;
+        }
+
+        uint32_t dst = next_slot();
+        uint32_t dividend = in_register(a, dst);
+        if (b.constant) {
+            emit(register_opcode::div_ri, dst, dividend, 0, b.value);
+        } else {
+            emit(register_opcode::div_rr, dst, dividend, b.reg, 0);
+        }
+        slots_.push_back(operand::of_register(dst));
+    }
+
+    /** conditional jump on an operand, returns whether execution may fall through */
+    bool jump_if_zero(const operand& condition, item_t target) {
+        if (condition.constant) {
+            if (condition.value == 0) {
+                emit(register_opcode::jump, 0, 0, 0, target);
+                return false;
+            }
+            return true;
+        }
+        emit(register_opcode::jump_zero, 0, condition.reg, 0, target);
+        return true;
+    }
+
+    /** write all slots to their own registers */
+    void materialize() {
+        for (size_t slot = 0; slot < slots_.size(); slot++) {
+            operand& value = slots_[slot];
+            if (value.constant) {
+                emit(register_opcode::load, static_cast<uint32_t>(slot), 0, 0, value.value);
+            } else if (value.reg != slot) {
+                emit(register_opcode::move, static_cast<uint32_t>(slot), value.reg, 0, 0);
+            } else {
+                continue;
+            }
+            value = operand::of_register(slot);
+        }
+    }
+
+    void emit(register_opcode op, uint32_t dst, uint32_t a, uint32_t b, item_t imm) {
+        ops_.push_back({op, dst, a, b, imm, pc_});
+    }
+
+    /** a register past all stack slots, for temporary values */
+    uint32_t scratch() const { return static_cast<uint32_t>(proof_.max_depth); }
+
+    const instruction_table& table_;
+    std::span<const op_t> code_;
+    const verification& proof_;
+
+    std::vector<bool> jump_target_;
+    std::vector<operand> slots_;
+    std::vector<register_op> ops_;
+    size_t pc_ = 0;
+};
+
+} // namespace
+
+
+register_program::register_program(const vm_state& vm, std::span<const op_t> code)
+    :
+    code_{std::begin(code), std::end(code)} {
+
+    if (code.size() > std::numeric_limits<uint32_t>::max()) {
+        return;
+    }
+
+    // programs that may fail still run, to fail like
+    // with the other engines when they get there
+    verification proof = verify(vm, code);
+    if (not proof.verified) {
+        return;
+    }
+
+    ops_ = translator{*vm.instructions, code, proof}.translate();
+    registers_ = proof.max_depth + 1;
+}
+
+
+std::tuple<item_t, std::string> register_program::run(vm_state& vm) const {
+    if (not translated()) {
+        return run_threaded(vm, code_);
+    }
+
+    vm.pc = 0;
+    vm.stack.clear();
+    vm.output.clear();
+
+    std::vector<item_t> registers(registers_);
+    item_t* r = registers.data();
+    const register_op* code = ops_.data();
+    const register_op* ip = code;
+
+#ifdef VM_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+    static const void* const handlers[] = {
+        &&op_load,
+        &&op_move,
+        &&op_add_rr,
+        &&op_add_ri,
+        &&op_div_rr,
+        &&op_div_ri,
+        &&op_eq_rr,
+        &&op_eq_ri,
+        &&op_neq_rr,
+        &&op_neq_ri,
+        &&op_jump,
+        &&op_jump_zero,
+        &&op_jump_eq,
+        &&op_jump_neq,
+        &&op_write_r,
+        &&op_write_i,
+        &&op_write_char_r,
+        &&op_write_char_i,
+        &&op_div_zero,
+        &&op_exit,
+    };
+    static_assert(std::size(handlers) == static_cast<size_t>(register_opcode::exit) + 1);
+
+#define VM_DISPATCH() goto *handlers[static_cast<size_t>(ip->op)]
+#define VM_HANDLER(name) op_##name
+#else
+#define VM_DISPATCH() goto dispatch
+#define VM_HANDLER(name) case register_opcode::name
+#endif
+
+#define VM_NEXT() \
+    do {          \
+        ++ip;     \
+        VM_DISPATCH(); \
+    } while (false)
+
+#define VM_JUMP_IF(condition)          \
+    do {                               \
+        if (condition) {               \
+            ip = code + ip->imm;       \
+            VM_DISPATCH();             \
+        }                              \
+        VM_NEXT();                     \
+    } while (false)
+
+    VM_DISPATCH();
+
+#ifndef VM_COMPUTED_GOTO
+dispatch:
+    switch (ip->op) {
+#endif
+
+    VM_HANDLER(load):
+        r[ip->dst] = ip->imm;
+        VM_NEXT();
+
+    VM_HANDLER(move):
+        r[ip->dst] = r[ip->a];
+        VM_NEXT();
+
+    VM_HANDLER(add_rr):
+        r[ip->dst] = r[ip->a] + r[ip->b];
+        VM_NEXT();
+
+    VM_HANDLER(add_ri):
+        r[ip->dst] = r[ip->a] + ip->imm;
+        VM_NEXT();
+
+    VM_HANDLER(div_rr):
+        if (r[ip->b] == 0) {
+            vm.pc = ip->pc;
+            throw div_by_zero{"division by zero"};
+        }
+        r[ip->dst] = r[ip->a] / r[ip->b];
+        VM_NEXT();
+
+    VM_HANDLER(div_ri):
+        r[ip->dst] = r[ip->a] / ip->imm;
+        VM_NEXT();
+
+    VM_HANDLER(eq_rr):
+        r[ip->dst] = (r[ip->a] == r[ip->b]) ? 1 : 0;
+        VM_NEXT();
+
+    VM_HANDLER(eq_ri):
+        r[ip->dst] = (r[ip->a] == ip->imm) ? 1 : 0;
+        VM_NEXT();
+
+    VM_HANDLER(neq_rr):
+        r[ip->dst] = (r[ip->a] != r[ip->b]) ? 1 : 0;
+        VM_NEXT();
+
+    VM_HANDLER(neq_ri):
+        r[ip->dst] = (r[ip->a] != ip->imm) ? 1 : 0;
+        VM_NEXT();
+
+    VM_HANDLER(jump):
+        ip = code + ip->imm;
+        VM_DISPATCH();
+
+    VM_HANDLER(jump_zero):
+        VM_JUMP_IF(r[ip->a] == 0);
+
+    VM_HANDLER(jump_eq):
+        VM_JUMP_IF(r[ip->a] == r[ip->b]);
+
+    VM_HANDLER(jump_neq):
+        VM_JUMP_IF(r[ip->a] != r[ip->b]);
+
+    VM_HANDLER(write_r):
+        vm.output.write_number(r[ip->a]);
+        VM_NEXT();
+
+    VM_HANDLER(write_i):
+        vm.output.write_number(ip->imm);
+        VM_NEXT();
+
+    VM_HANDLER(write_char_r):
+        vm.output.write_char(static_cast<char>(r[ip->a]));
+        VM_NEXT();
+
+    VM_HANDLER(write_char_i):
+        vm.output.write_char(static_cast<char>(ip->imm));
+        VM_NEXT();
+
+    VM_HANDLER(div_zero):
+        vm.pc = ip->pc;
+        throw div_by_zero{"division by zero"};
+
+    VM_HANDLER(exit):
+        for (size_t slot = 0; slot < ip->a; slot++) {
+            vm.stack.push(r[slot]);
+        }
+        vm.pc = ip->pc;
+        return {vm.stack.top(), vm.output.take()};
+
+#ifndef VM_COMPUTED_GOTO
+    }
+    throw std::logic_error{"invalid register opcode"};
+#endif
+
+#undef VM_JUMP_IF
+#undef VM_NEXT
+#undef VM_HANDLER
+#undef VM_DISPATCH
+
+#ifdef VM_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+}
+
+
+std::tuple<item_t, std::string> run_registers(vm_state& vm, std::span<const op_t> code) {
+    return register_program{vm, code}.run(vm);
+}
+
+
+} // namespace vm
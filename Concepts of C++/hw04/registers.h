@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "vm.h"
+
+
+namespace vm {
+
+/**
+ * operations of the register machine.
+ * `_rr` variants take two registers, `_ri` ones a register and a constant.
+ */
+enum class register_opcode : uint8_t {
+    /** dst = imm */
+    load,
+    /** dst = a */
+    move,
+    add_rr,
+    add_ri,
+    div_rr,
+    /** the constant divisor is never zero */
+    div_ri,
+    eq_rr,
+    eq_ri,
+    neq_rr,
+    neq_ri,
+    /** continue at op imm */
+    jump,
+    /** continue at op imm if a == 0 */
+    jump_zero,
+    /** continue at op imm if a == b */
+    jump_eq,
+    /** continue at op imm if a != b */
+    jump_neq,
+    write_r,
+    write_i,
+    write_char_r,
+    write_char_i,
+    /** a division by the constant zero */
+    div_zero,
+    /** stop, with registers 0 to a as the final stack */
+    exit,
+};
+
+
+/**
+ * one register machine instruction.
+ */
+struct register_op {
+    register_opcode op;
+
+    /** registers */
+    uint32_t dst;
+    uint32_t a;
+    uint32_t b;
+
+    /** constant operand or jump target */
+    item_t imm;
+
+    /** the stack code pc this was translated from, reported on errors */
+    size_t pc;
+};
+
+
+/**
+ * a program translated from stack code to a register machine.
+ *
+ * each stack slot becomes a virtual register, and within a basic block,
+ * slots are tracked symbolically: pushing a constant or duplicating a value
+ * emits nothing, and instructions read their operands directly from the
+ * register or constant that produced them. only at jumps and jump targets
+ * are the slots written to their own registers. the stack itself is only
+ * filled at EXIT, so the result is the same as with the stack engines,
+ * but its high-water mark just covers the final stack.
+ *
+ * the translation needs the stack depth at each pc, so it only applies to
+ * programs `verify` can prove. others, e.g. with custom instructions, are
+ * run by the threaded engine.
+ */
+class register_program {
+public:
+    register_program(const vm_state& vm, std::span<const op_t> code);
+
+    /** whether the program was translated */
+    bool translated() const { return not ops_.empty(); }
+
+    /** the register machine code */
+    const std::vector<register_op>& ops() const { return ops_; }
+
+    /** number of registers used, one per stack slot and a scratch register */
+    size_t registers() const { return registers_; }
+
+    /**
+     * execute the program.
+     *
+     * @return the same results as `run`.
+     */
+    std::tuple<item_t, std::string> run(vm_state& vm) const;
+
+private:
+    std::vector<op_t> code_;
+    std::vector<register_op> ops_;
+    size_t registers_ = 0;
+};
+
+
+/**
+ * translate the code to a register program and run it.
+ */
+std::tuple<item_t, std::string> run_registers(vm_state& vm, std::span<const op_t> code);
+
+
+} // namespace vm
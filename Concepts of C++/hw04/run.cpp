@@ -4,19 +4,23 @@
 #include <iostream>
 
 
+namespace vm {
 
 void test_vm() {
     std::string program = (
         "LOAD_CONST 432\n"
         "LOAD_CONST 905\n"
         "ADD\n"
-        "PRINT\n"
+        "WRITE\n"
         "EXIT\n");
 
     std::cout << "initializing vm..." << std::endl;
     // create it in debug-mode!
     vm_state state = create_vm(true);
 
+    profiler profile;
+    state.profile = &profile;
+
     try {
         std::cout << "assembling..." << std::endl;
         code_t code = assemble(state, program);
@@ -24,10 +28,14 @@ void test_vm() {
         std::cout << "running..." << std::endl;
         const auto& [exit_state, return_text] = run(state, code);
 
-        std::cout << "done! vm result: " << exit_state << std::endl;
+        std::cout << "done! vm result: " << exit_state
+                  << " (max stack depth " << state.stack.high_water_mark() << ")" << std::endl;
         if (return_text.size()) {
             std::cout << return_text << std::endl;
         }
+
+        std::cout << "profile:" << std::endl;
+        profile.report(std::cout, state);
     }
     catch (vm_stackfail &err) {
         std::cout << "vm stack access failes! " << err.what() << std::endl;
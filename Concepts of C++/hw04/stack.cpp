@@ -0,0 +1,74 @@
+#include "vm.h"
+
+#include <algorithm>
+
+
+namespace vm {
+
+namespace {
+
+/**
+ * get uninitialized, cache line aligned storage for the given number of items.
+ */
+item_t* allocate_items(size_t count) {
+    return static_cast<item_t*>(
+        ::operator new[](std::max<size_t>(count, 1) * sizeof(item_t),
+                         std::align_val_t{operand_stack::alignment}));
+}
+
+} // namespace
+
+
+operand_stack::operand_stack(size_t capacity)
+    :
+    items_{allocate_items(capacity)},
+    sp_{items_.get()},
+    limit_{items_.get() + capacity},
+    high_water_{items_.get()} {}
+
+
+operand_stack::operand_stack(const operand_stack& other)
+    :
+    operand_stack{other.capacity()} {
+
+    sp_ = std::copy(other.base(), other.sp_, base());
+    high_water_ = base() + other.high_water_mark();
+}
+
+
+operand_stack::operand_stack(operand_stack&& other) noexcept
+    :
+    items_{std::move(other.items_)},
+    sp_{std::exchange(other.sp_, nullptr)},
+    limit_{std::exchange(other.limit_, nullptr)},
+    high_water_{std::exchange(other.high_water_, nullptr)} {}
+
+
+operand_stack& operand_stack::operator=(const operand_stack& other) {
+    if (this != &other) {
+        *this = operand_stack{other};
+    }
+    return *this;
+}
+
+
+operand_stack& operand_stack::operator=(operand_stack&& other) noexcept {
+    items_ = std::move(other.items_);
+    sp_ = std::exchange(other.sp_, nullptr);
+    limit_ = std::exchange(other.limit_, nullptr);
+    high_water_ = std::exchange(other.high_water_, nullptr);
+    return *this;
+}
+
+
+void operand_stack::overflow() const {
+    throw vm_stackfail{"stack overflow, capacity is " + std::to_string(capacity())};
+}
+
+
+void operand_stack::underflow() const {
+    throw vm_stackfail{"access to empty stack"};
+}
+
+
+} // namespace vm
@@ -0,0 +1,146 @@
+#include "superinstructions.h"
+
+#include <algorithm>
+#include <array>
+
+
+namespace vm {
+
+namespace {
+
+/**
+ * an instruction sequence and the superinstruction replacing it.
+ */
+struct fusion {
+    std::array<opcode, 3> sequence;
+    size_t length;
+    /** which instruction of the sequence provides the argument */
+    size_t argument;
+    opcode fused;
+    std::string_view name;
+};
+
+
+/** known fusions, longest sequences first so they are preferred */
+constexpr std::array fusions{
+    fusion{{opcode::load_const, opcode::add, opcode::dup}, 3, 0, opcode::load_const_add_dup, "LOAD_CONST_ADD_DUP"},
+    fusion{{opcode::load_const, opcode::add}, 2, 0, opcode::load_const_add, "LOAD_CONST_ADD"},
+    fusion{{opcode::load_const, opcode::eq}, 2, 0, opcode::load_const_eq, "LOAD_CONST_EQ"},
+    fusion{{opcode::load_const, opcode::neq}, 2, 0, opcode::load_const_neq, "LOAD_CONST_NEQ"},
+    fusion{{opcode::dup, opcode::jmpz}, 2, 1, opcode::dup_jmpz, "DUP_JMPZ"},
+    fusion{{opcode::eq, opcode::jmpz}, 2, 1, opcode::eq_jmpz, "EQ_JMPZ"},
+    fusion{{opcode::neq, opcode::jmpz}, 2, 1, opcode::neq_jmpz, "NEQ_JMPZ"},
+};
+
+
+/**
+ * does the instruction use its argument as jump target?
+ */
+bool is_jump(opcode op) {
+    switch (op) {
+    case opcode::jmp:
+    case opcode::jmpz:
+    case opcode::dup_jmpz:
+    case opcode::eq_jmpz:
+    case opcode::neq_jmpz:
+        return true;
+    default:
+        return false;
+    }
+}
+
+} // namespace
+
+
+code_t fuse_superinstructions(const vm_state& vm, const code_t& code) {
+    auto opcode_of = [&vm](op_id_t op_id) {
+        auto builtin = vm.instructions->instruction_opcodes.find(op_id);
+        if (builtin == std::end(vm.instructions->instruction_opcodes)) {
+            return opcode::custom;
+        }
+        return builtin->second;
+    };
+
+    // op ids of the superinstructions in this vm
+    std::array<op_id_t, fusions.size()> fused_ids;
+    for (size_t i = 0; i < fusions.size(); i++) {
+        auto find_id = vm.instructions->instruction_ids.find(fusions[i].name);
+        if (find_id == std::end(vm.instructions->instruction_ids)) {
+            throw invalid_instruction{"superinstruction not registered: " + std::string{fusions[i].name}};
+        }
+        fused_ids[i] = find_id->second;
+    }
+
+    std::vector<opcode> ops;
+    ops.reserve(code.size());
+    for (const auto& [op_id, arg] : code) {
+        ops.push_back(opcode_of(op_id));
+    }
+
+    // custom instructions may set the pc to an old index, which can't be renumbered
+    if (std::find(std::begin(ops), std::end(ops), opcode::custom) != std::end(ops)) {
+        return code;
+    }
+
+    // instructions that are jumped to have to remain the start of an instruction.
+    // jumping to index code.size() is valid, it's caught as segfault later.
+    std::vector<bool> jump_target(code.size() + 1, false);
+    for (size_t pc = 0; pc < code.size(); pc++) {
+        auto target = static_cast<size_t>(code[pc].second);
+        if (is_jump(ops[pc]) and target <= code.size()) {
+            jump_target[target] = true;
+        }
+    }
+
+    auto matches = [&](const fusion& candidate, size_t pc) {
+        if (pc + candidate.length > code.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < candidate.length; i++) {
+            if (ops[pc + i] != candidate.sequence[i]) {
+                return false;
+            }
+            if (i > 0 and jump_target[pc + i]) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    code_t fused;
+    fused.reserve(code.size());
+
+    // where each old instruction ended up
+    std::vector<size_t> new_pc(code.size() + 1);
+
+    for (size_t pc = 0; pc < code.size();) {
+        new_pc[pc] = fused.size();
+
+        size_t length = 1;
+        for (size_t i = 0; i < fusions.size(); i++) {
+            if (matches(fusions[i], pc)) {
+                length = fusions[i].length;
+                fused.emplace_back(fused_ids[i], code[pc + fusions[i].argument].second);
+                break;
+            }
+        }
+        if (length == 1) {
+            fused.push_back(code[pc]);
+        }
+
+        pc += length;
+    }
+    new_pc[code.size()] = fused.size();
+
+    // renumber the jump targets, invalid ones stay invalid
+    for (auto& [op_id, arg] : fused) {
+        auto target = static_cast<size_t>(arg);
+        if (is_jump(opcode_of(op_id)) and target <= code.size()) {
+            arg = static_cast<item_t>(new_pc[target]);
+        }
+    }
+
+    return fused;
+}
+
+} // namespace vm
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "vm.h"
+
+
+namespace vm {
+
+/**
+ * peephole pass replacing common instruction sequences by superinstructions,
+ * which do the work of the whole sequence in one dispatch:
+ *
+ *  LOAD_CONST n; ADD       -> LOAD_CONST_ADD n
+ *  LOAD_CONST n; EQ        -> LOAD_CONST_EQ n
+ *  LOAD_CONST n; NEQ       -> LOAD_CONST_NEQ n
+ *  LOAD_CONST n; ADD; DUP  -> LOAD_CONST_ADD_DUP n
+ *  DUP; JMPZ t             -> DUP_JMPZ t
+ *  EQ; JMPZ t              -> EQ_JMPZ t
+ *  NEQ; JMPZ t             -> NEQ_JMPZ t
+ *
+ * sequences are only fused if no jump lands inside them, and all JMP/JMPZ
+ * targets are renumbered for the shortened code, so running the result
+ * behaves like running the input.
+ * custom instructions may set the pc themselves, which can't be renumbered,
+ * so programs using any of them are returned unchanged.
+ *
+ * `assemble` applies this pass when `vm_state::superinstructions` is set.
+ */
+code_t fuse_superinstructions(const vm_state& vm, const code_t& code);
+
+} // namespace vm
@@ -0,0 +1,69 @@
+#include "threaded.h"
+
+#include <iterator>
+
+#include "interpreter.h"
+
+
+namespace vm {
+
+threaded_code_t thread_code(const vm_state& vm, std::span<const op_t> code, bool checked) {
+    const void* const* handlers = checked
+        ? detail::interpret<true>(nullptr, nullptr, 0)
+        : detail::interpret<false>(nullptr, nullptr, 0);
+
+    threaded_code_t threaded{{}, vm.instructions, checked};
+    const instruction_table& table = *threaded.instructions;
+    threaded.ops.reserve(code.size() + 1);
+
+    for (const auto& [op_id, arg] : code) {
+        opcode op = opcode::custom;
+        const op_action_t* action = nullptr;
+
+        auto builtin = table.instruction_opcodes.find(op_id);
+        if (builtin != std::end(table.instruction_opcodes)) {
+            op = builtin->second;
+        } else {
+            auto custom = table.instruction_actions.find(op_id);
+            if (custom == std::end(table.instruction_actions)) {
+                throw invalid_instruction{"unknown op id: " + std::to_string(op_id)};
+            }
+            action = &custom->second;
+        }
+
+        threaded.ops.push_back({handlers[static_cast<size_t>(op)], op, arg, action});
+    }
+
+    threaded.ops.push_back({handlers[static_cast<size_t>(opcode::end)], opcode::end, 0, nullptr});
+    return threaded;
+}
+
+
+std::tuple<item_t, std::string> run_threaded(vm_state& vm, const threaded_code_t& code) {
+    vm.pc = 0;
+    vm.stack.clear();
+    vm.output.clear();
+
+    if (code.checked) {
+        detail::interpret<true>(&vm, code.ops.data(), code.ops.size() - 1);
+    } else {
+        detail::interpret<false>(&vm, code.ops.data(), code.ops.size() - 1);
+    }
+
+    return {vm.stack.top(), vm.output.take()};
+}
+
+
+std::tuple<item_t, std::string> run_threaded(vm_state& vm, std::span<const op_t> code) {
+    return run_threaded(vm, thread_code(vm, code));
+}
+
+
+bool run_threaded_for(vm_state& vm, const threaded_code_t& code, run_limit& limit) {
+    limit.finished = false;
+    detail::interpret<true, true>(&vm, code.ops.data(), code.ops.size() - 1, &limit);
+    return limit.finished;
+}
+
+
+} // namespace vm
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <memory>
+#include <span>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "vm.h"
+
+
+namespace vm {
+
+/**
+ * one instruction prepared for the direct-threaded engine.
+ *
+ * the handler is resolved once when the code is threaded, so executing the
+ * instruction needs neither a map lookup nor a call through `std::function`.
+ */
+struct threaded_op {
+    /** address of the engine's handler, only used with computed gotos */
+    const void* handler;
+
+    /** the built-in this op executes, used by the portable switch dispatch */
+    opcode op;
+
+    /** instruction argument */
+    item_t arg;
+
+    /** action of a custom instruction, nullptr for built-ins */
+    const op_action_t* action;
+};
+
+
+/**
+ * a program translated for the threaded engine.
+ */
+struct threaded_code_t {
+    /**
+     * the instructions, terminated by an `opcode::end` guard, so the engine
+     * doesn't have to bounds-check the program counter after each instruction.
+     */
+    std::vector<threaded_op> ops;
+
+    /** the table the custom instruction actions are referenced from */
+    std::shared_ptr<const instruction_table> instructions;
+
+    /** whether stack accesses and jumps are checked while running */
+    bool checked = true;
+};
+
+
+/**
+ * translate assembled code for execution with `run_threaded`.
+ *
+ * unchecked code must have been verified with `verify`,
+ * its stack accesses and jumps are then assumed to be valid.
+ */
+threaded_code_t thread_code(const vm_state& vm, std::span<const op_t> code, bool checked = true);
+
+
+/**
+ * execute threaded code.
+ *
+ * @return the same results as `run`.
+ */
+std::tuple<item_t, std::string> run_threaded(vm_state& vm, const threaded_code_t& code);
+
+
+/**
+ * thread the given code and execute it.
+ */
+std::tuple<item_t, std::string> run_threaded(vm_state& vm, std::span<const op_t> code);
+
+
+/**
+ * how far `run_threaded_for` may run.
+ */
+struct run_limit {
+    /** instructions left to execute, counted down while running */
+    size_t remaining;
+
+    /** also stop right after each WRITE and WRITE_CHAR */
+    bool stop_on_write = false;
+
+    /** set when the program finished instead of stopping at the limit */
+    bool finished = false;
+};
+
+
+/**
+ * continue executing threaded code at the vm's pc, without resetting the
+ * vm, until the program finishes or the limit is reached.
+ * the vm's pc is then at the next instruction to execute.
+ *
+ * stack accesses and jumps are always checked.
+ *
+ * @return whether the program finished.
+ */
+bool run_threaded_for(vm_state& vm, const threaded_code_t& code, run_limit& limit);
+
+
+} // namespace vm
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "interpreter.h"
+#include "threaded.h"
+#include "vm.h"
+
+
+namespace vm {
+
+/**
+ * an instruction name usable as template argument, e.g. `instruction<"INC", ...>`.
+ */
+template <size_t N>
+struct instruction_name {
+    constexpr instruction_name(const char (&name)[N]) {
+        std::copy_n(name, N, text);
+    }
+
+    constexpr std::string_view view() const { return {text, N - 1}; }
+
+    char text[N];
+};
+
+
+/**
+ * an instruction known at compile time.
+ *
+ * the handler is any function or captureless lambda callable like an
+ * `op_action_t`, but as template argument, its calls can be inlined.
+ */
+template <instruction_name Name, auto Handler>
+struct instruction {
+    static constexpr std::string_view name = Name.view();
+
+    static bool execute(vm_state& vm, const item_t arg) {
+        return std::invoke(Handler, vm, arg);
+    }
+};
+
+
+/**
+ * register a new instruction whose handler is known at compile time.
+ *
+ * the handler is stored as plain function pointer, which `std::function`
+ * keeps without allocating.
+ */
+template <auto Handler>
+void register_instruction(vm_state& vm, std::string_view name) {
+    register_instruction(vm, name, op_action_t{&instruction<"", Handler>::execute});
+}
+
+
+/**
+ * a program translated for an `instruction_set`.
+ */
+struct typed_code_t {
+    /**
+     * the instructions, terminated by an `opcode::end` guard. the set's
+     * instructions have the ops following the built-ins, see `first_index`.
+     * the handlers are the set's own, so only the set can run this code.
+     */
+    std::vector<threaded_op> ops;
+
+    /** the table the dynamic instruction actions are referenced from */
+    std::shared_ptr<const instruction_table> instructions;
+};
+
+
+/**
+ * a fixed set of custom instructions, executed by a dispatcher generated
+ * for exactly these instructions.
+ *
+ * built-ins and the set's instructions are dispatched by the threaded
+ * engine's loop, instantiated for the set, which calls the set's handlers
+ * directly so they can be inlined, instead of through `std::function`.
+ * instructions registered at runtime, e.g. by plugins, still work and are
+ * called through their `op_action_t`.
+ *
+ * the instructions also get registered to the vm normally, so programs
+ * using them can be assembled and run by every other engine as well.
+ *
+ *   using my_set = instruction_set<instruction<"INC", inc>, instruction<"SWAP", swap>>;
+ *   my_set::register_to(vm);
+ *   auto [result, output] = my_set::run(vm, assemble(vm, "..."));
+ */
+template <typename... Instructions>
+class instruction_set {
+public:
+    /** the op of the set's first instruction in `typed_code_t` */
+    static constexpr size_t first_index = detail::first_static_op;
+    static_assert(first_index + sizeof...(Instructions) <= size_t{1} << (8 * sizeof(opcode)),
+                  "too many instructions for the opcode type");
+
+    /**
+     * register the set's instructions to the vm.
+     */
+    static void register_to(vm_state& vm) {
+        // one copy of the table for all of them
+        auto table = std::make_shared<instruction_table>(*vm.instructions);
+        (register_instruction(*table, Instructions::name, op_action_t{&Instructions::execute}), ...);
+        vm.instructions = std::move(table);
+    }
+
+    /**
+     * translate assembled code for execution with `run`.
+     * the set's instructions are recognized by their names in the vm.
+     */
+    static typed_code_t translate(const vm_state& vm, std::span<const op_t> code) {
+        const void* const* handlers = detail::interpret<true, false, Instructions...>(nullptr, nullptr, 0);
+        auto prepare = [handlers](size_t op, item_t arg, const op_action_t* action) {
+            return threaded_op{handlers[op], static_cast<opcode>(op), arg, action};
+        };
+
+        typed_code_t typed{{}, vm.instructions};
+        const instruction_table& table = *typed.instructions;
+
+        // op ids of the set's instructions, unregistered ones are never found
+        constexpr std::array<std::string_view, sizeof...(Instructions)> names{Instructions::name...};
+        std::array<op_id_t, sizeof...(Instructions)> ids{};
+        for (size_t i = 0; i < names.size(); i++) {
+            auto id = table.instruction_ids.find(names[i]);
+            ids[i] = (id == std::end(table.instruction_ids)) ? table.next_op_id : id->second;
+        }
+
+        typed.ops.reserve(code.size() + 1);
+        for (const auto& [op_id, arg] : code) {
+            auto builtin = table.instruction_opcodes.find(op_id);
+            if (builtin != std::end(table.instruction_opcodes)) {
+                typed.ops.push_back(prepare(static_cast<size_t>(builtin->second), arg, nullptr));
+                continue;
+            }
+
+            auto known = std::find(std::begin(ids), std::end(ids), op_id);
+            if (known != std::end(ids)) {
+                auto position = static_cast<size_t>(known - std::begin(ids));
+                typed.ops.push_back(prepare(first_index + position, arg, nullptr));
+                continue;
+            }
+
+            auto custom = table.instruction_actions.find(op_id);
+            if (custom == std::end(table.instruction_actions)) {
+                throw invalid_instruction{"unknown op id: " + std::to_string(op_id)};
+            }
+            typed.ops.push_back(prepare(static_cast<size_t>(opcode::custom), arg, &custom->second));
+        }
+
+        typed.ops.push_back(prepare(static_cast<size_t>(opcode::end), 0, nullptr));
+        return typed;
+    }
+
+    /**
+     * execute translated code.
+     *
+     * @return the same results as `run`.
+     */
+    static std::tuple<item_t, std::string> run(vm_state& vm, const typed_code_t& code) {
+        vm.pc = 0;
+        vm.stack.clear();
+        vm.output.clear();
+
+        detail::interpret<true, false, Instructions...>(&vm, code.ops.data(), code.ops.size() - 1);
+
+        return {vm.stack.top(), vm.output.take()};
+    }
+
+    /**
+     * translate the given code and execute it.
+     */
+    static std::tuple<item_t, std::string> run(vm_state& vm, std::span<const op_t> code) {
+        return run(vm, translate(vm, code));
+    }
+};
+
+
+} // namespace vm
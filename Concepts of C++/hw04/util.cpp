@@ -1,8 +1,123 @@
 #include "util.h"
 
+#include <cerrno>
+#include <fstream>
+#include <system_error>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define VM_HAVE_SSE2 1
+#endif
+
+// avx2 code is compiled for its function only, and used if the cpu has it
+#if defined(VM_HAVE_SSE2) && defined(__GNUC__) && defined(__x86_64__)
+#define VM_HAVE_AVX2 1
+#endif
+
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define VM_HAVE_MMAP 1
+#endif
+
 
 namespace vm::util {
 
+namespace {
+
+/** `std::isspace` in the "C" locale */
+bool is_space(char c) {
+    return c == ' ' or (c >= '\t' and c <= '\r');
+}
+
+
+uint64_t delimiter_mask_scalar(const char* data, size_t length, char delimiter) {
+    uint64_t mask = 0;
+    for (size_t i = 0; i < length; i++) {
+        mask |= uint64_t{data[i] == delimiter} << i;
+    }
+    return mask;
+}
+
+
+#ifdef VM_HAVE_SSE2
+
+uint64_t delimiter_mask_sse2(const char* data, char delimiter) {
+    const __m128i needle = _mm_set1_epi8(delimiter);
+    uint64_t mask = 0;
+    for (size_t i = 0; i < 64; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        auto found = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle)));
+        mask |= uint64_t{found} << i;
+    }
+    return mask;
+}
+
+
+/** bit i is set if data[i] is whitespace, for 16 bytes */
+uint32_t space_mask_sse2(const char* data) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+
+    // '\t' to '\r' are consecutive, so shifted to start at 0, they are <= 4
+    __m128i control = _mm_sub_epi8(chunk, _mm_set1_epi8('\t'));
+    __m128i is_control = _mm_cmpeq_epi8(_mm_min_epu8(control, _mm_set1_epi8(4)), control);
+    __m128i is_blank = _mm_cmpeq_epi8(chunk, _mm_set1_epi8(' '));
+
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(is_control, is_blank)));
+}
+
+#endif
+
+
+#ifdef VM_HAVE_AVX2
+
+__attribute__((target("avx2")))
+uint64_t delimiter_mask_avx2(const char* data, char delimiter) {
+    const __m256i needle = _mm256_set1_epi8(delimiter);
+    __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+    __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + 32));
+    auto found_low = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, needle)));
+    auto found_high = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, needle)));
+    return uint64_t{found_low} | (uint64_t{found_high} << 32);
+}
+
+#endif
+
+
+using block_mask_t = uint64_t (*)(const char*, char);
+
+/** the fastest comparison of 64 bytes the cpu supports, nullptr if none */
+block_mask_t select_block_mask() {
+#ifdef VM_HAVE_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        return &delimiter_mask_avx2;
+    }
+#endif
+#ifdef VM_HAVE_SSE2
+    return &delimiter_mask_sse2;
+#else
+    return nullptr;
+#endif
+}
+
+} // namespace
+
+
+namespace detail {
+
+uint64_t delimiter_mask(const char* data, size_t length, char delimiter) {
+    static const block_mask_t block_mask = select_block_mask();
+
+    if (length == 64 and block_mask != nullptr) {
+        return block_mask(data, delimiter);
+    }
+    return delimiter_mask_scalar(data, length, delimiter);
+}
+
+} // namespace detail
+
 
 std::vector<std::string> split(std::string_view txt, char delimiter) {
     std::vector<std::string> items;
@@ -12,15 +127,115 @@ std::vector<std::string> split(std::string_view txt, char delimiter) {
 }
 
 
+std::vector<std::string_view> split_views(std::string_view txt, char delimiter) {
+    std::vector<std::string_view> items;
+    for (std::string_view part : split_view{txt, delimiter}) {
+        items.push_back(part);
+    }
+    return items;
+}
+
+
 std::string strip(std::string_view inpt) {
-    auto start_it = std::begin(inpt);
-    auto end_it = std::rbegin(inpt);
-    while (std::isspace(*start_it))
-        ++start_it;
-    while (std::isspace(*end_it))
-        ++end_it;
-    return std::string(start_it, end_it.base());
+    return std::string{strip_view(inpt)};
+}
+
+
+std::string_view strip_view(std::string_view inpt) {
+    const char* data = inpt.data();
+    size_t begin = 0;
+    size_t end = inpt.size();
+
+#ifdef VM_HAVE_SSE2
+    // skip whole blocks of whitespace, then find the first other character
+    while (end - begin >= 16) {
+        uint32_t other = ~space_mask_sse2(data + begin) & 0xffff;
+        if (other != 0) {
+            begin += static_cast<size_t>(std::countr_zero(other));
+            break;
+        }
+        begin += 16;
+    }
+    while (end - begin >= 16) {
+        uint32_t other = ~space_mask_sse2(data + end - 16) & 0xffff;
+        if (other != 0) {
+            end -= static_cast<size_t>(std::countl_zero(other << 16));
+            break;
+        }
+        end -= 16;
+    }
+#endif
+
+    while (begin < end and is_space(data[begin])) {
+        ++begin;
+    }
+    while (end > begin and is_space(data[end - 1])) {
+        --end;
+    }
+    return inpt.substr(begin, end - begin);
+}
+
+
+#ifdef VM_HAVE_MMAP
+
+mapped_file::mapped_file(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::system_error{errno, std::generic_category(), "open " + path};
+    }
+
+    struct stat info;
+    if (::fstat(fd, &info) < 0) {
+        int error = errno;
+        ::close(fd);
+        throw std::system_error{error, std::generic_category(), "stat " + path};
+    }
+
+    size_ = static_cast<size_t>(info.st_size);
+
+    // empty files can't be mapped, but there's nothing to map anyway
+    if (size_ > 0) {
+        void* address = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        if (address == MAP_FAILED) {
+            int error = errno;
+            ::close(fd);
+            throw std::system_error{error, std::generic_category(), "mmap " + path};
+        }
+        data_ = static_cast<const std::byte*>(address);
+    }
+
+    // the mapping stays valid after closing
+    ::close(fd);
+}
+
+
+mapped_file::~mapped_file() {
+    if (data_ != nullptr) {
+        ::munmap(const_cast<std::byte*>(data_), size_);
+    }
 }
 
+#else
+
+mapped_file::mapped_file(const std::string& path) {
+    std::ifstream file{path, std::ios::binary | std::ios::ate};
+    if (not file) {
+        throw std::system_error{ENOENT, std::generic_category(), "open " + path};
+    }
+
+    fallback_.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(fallback_.data()),
+              static_cast<std::streamsize>(fallback_.size()));
+
+    data_ = fallback_.data();
+    size_ = fallback_.size();
+}
+
+
+mapped_file::~mapped_file() = default;
+
+#endif
+
 
 } // namespace vm::util
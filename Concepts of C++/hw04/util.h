@@ -1,26 +1,202 @@
 #pragma once
 
-#include <sstream>
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
 #include <string>
+#include <string_view>
 #include <vector>
 
 
 namespace vm::util {
 
+/** implementation details that may unsettle innocent homework solvers */
+namespace detail {
+
+/**
+ * bit i is set if data[i] is the delimiter, for up to 64 bytes.
+ * full blocks are compared with SSE2 or AVX2, depending on the cpu.
+ */
+uint64_t delimiter_mask(const char* data, size_t length, char delimiter);
+
+} // namespace detail
+
+
+/**
+ * finds the delimiters in a text one after another.
+ *
+ * the text is compared against the delimiter 64 bytes at a time, and the
+ * matches are kept as a bit mask, so short parts don't cost a call each.
+ */
+class delimiter_scanner {
+public:
+    delimiter_scanner(std::string_view txt, char delimiter)
+        :
+        txt_{txt},
+        delimiter_{delimiter} {}
+
+    /** position of the next delimiter, or the text size if there is none */
+    size_t next() {
+        while (mask_ == 0) {
+            if (next_block_ >= txt_.size()) {
+                return txt_.size();
+            }
+            block_ = next_block_;
+            size_t length = std::min<size_t>(64, txt_.size() - block_);
+            mask_ = detail::delimiter_mask(txt_.data() + block_, length, delimiter_);
+            next_block_ += length;
+        }
+
+        size_t position = block_ + static_cast<size_t>(std::countr_zero(mask_));
+        mask_ &= mask_ - 1;
+        return position;
+    }
+
+private:
+    std::string_view txt_;
+    char delimiter_;
+
+    /** offset of the block the mask belongs to, and of the next one to scan */
+    size_t block_ = 0;
+    size_t next_block_ = 0;
+
+    /** delimiters in the block not returned yet */
+    uint64_t mask_ = 0;
+};
+
+
+/**
+ * lazily split a text at a delimiter, without copying it.
+ *
+ * the parts are views into the text, found like `std::getline` would:
+ * an empty part after the last delimiter doesn't count, empty parts
+ * between delimiters do.
+ *
+ *   for (std::string_view line : split_view{text, '\n'}) { ... }
+ */
+class split_view {
+public:
+    class iterator {
+    public:
+        using value_type = std::string_view;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() = default;
+
+        iterator(std::string_view txt, char delimiter)
+            :
+            txt_{txt},
+            scanner_{txt, delimiter},
+            done_{txt.empty()} {
+
+            if (not done_) {
+                end_ = scanner_.next();
+            }
+        }
+
+        std::string_view operator*() const {
+            return txt_.substr(start_, end_ - start_);
+        }
+
+        iterator& operator++() {
+            start_ = end_ + 1;
+            if (start_ >= txt_.size()) {
+                done_ = true;
+            } else {
+                end_ = scanner_.next();
+            }
+            return *this;
+        }
+
+        iterator operator++(int) {
+            iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        bool operator==(std::default_sentinel_t) const { return done_; }
+
+    private:
+        std::string_view txt_;
+        delimiter_scanner scanner_{{}, '\0'};
+        bool done_ = true;
+
+        /** the current part */
+        size_t start_ = 0;
+        size_t end_ = 0;
+    };
+
+    split_view(std::string_view txt, char delimiter)
+        :
+        txt_{txt},
+        delimiter_{delimiter} {}
+
+    iterator begin() const { return {txt_, delimiter_}; }
+    std::default_sentinel_t end() const { return {}; }
+
+private:
+    std::string_view txt_;
+    char delimiter_;
+};
+
+
 /**
  * split a string at a given delimiter
  */
 std::vector<std::string> split(std::string_view txt, char delimiter);
 
 
+/**
+ * split a string at a given delimiter, into views of it.
+ */
+std::vector<std::string_view> split_views(std::string_view txt, char delimiter);
+
+
 /**
  * return the whitespace-stripped version of the input string.
  */
 std::string strip(std::string_view inpt);
 
 
+/**
+ * the input without whitespace at its begin and end, as view into it.
+ * whitespace is what `std::isspace` finds in the "C" locale.
+ */
+std::string_view strip_view(std::string_view inpt);
+
+
+/**
+ * read-only memory mapping of a whole file.
+ * where mmap is unavailable, the file is read into memory instead.
+ */
+class mapped_file {
+public:
+    explicit mapped_file(const std::string& path);
+    ~mapped_file();
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    const std::byte* data() const { return data_; }
+    size_t size() const { return size_; }
+
+    /** the file contents as text */
+    std::string_view view() const {
+        return {reinterpret_cast<const char*>(data_), size_};
+    }
+
+private:
+    const std::byte* data_ = nullptr;
+    size_t size_ = 0;
+
+    /** file contents when they couldn't be mapped */
+    std::vector<std::byte> fallback_;
+};
+
+
 
-/** implementation details that may unsettle innocent homework solvers */
 namespace detail {
 
 /**
@@ -28,12 +204,8 @@ namespace detail {
  */
 template<typename ret_t>
 void split_fill(std::string_view txt, char delimiter, ret_t result) {
-    std::stringstream splitter;
-    splitter.str(std::string{txt});
-    std::string part;
-
-    while (std::getline(splitter, part, delimiter)) {
-        *result = part;
+    for (std::string_view part : split_view{txt, delimiter}) {
+        *result = std::string{part};
         result++;
     }
 }
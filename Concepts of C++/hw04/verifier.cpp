@@ -0,0 +1,141 @@
+#include "verifier.h"
+
+#include <algorithm>
+#include <iterator>
+
+
+namespace vm {
+
+namespace {
+
+/**
+ * how a built-in instruction uses the stack and continues.
+ */
+struct stack_effect {
+    /** items it needs on the stack */
+    size_t needs;
+    /** how far above the entry depth it grows the stack while executing */
+    size_t grows;
+    /** stack depth change once done */
+    ptrdiff_t change;
+    /** continues with the next instruction */
+    bool falls_through;
+    /** continues at the argument pc, always or conditionally */
+    bool jumps;
+};
+
+
+stack_effect effect_of(opcode op) {
+    switch (op) {
+    case opcode::load_const:         return {0, 1, +1, true, false};
+    case opcode::exit:               return {1, 0, 0, false, false};
+    case opcode::pop:                return {1, 0, -1, true, false};
+    case opcode::add:
+    case opcode::div:
+    case opcode::eq:
+    case opcode::neq:                return {2, 0, -1, true, false};
+    case opcode::dup:                return {1, 1, +1, true, false};
+    case opcode::jmp:                return {0, 0, 0, false, true};
+    case opcode::jmpz:               return {1, 0, -1, true, true};
+    case opcode::write:
+    case opcode::write_char:         return {1, 0, 0, true, false};
+    // the fused LOAD_CONST variants still need room for the constant
+    case opcode::load_const_add:
+    case opcode::load_const_eq:
+    case opcode::load_const_neq:     return {1, 1, 0, true, false};
+    case opcode::load_const_add_dup: return {1, 1, +1, true, false};
+    case opcode::dup_jmpz:           return {1, 1, 0, true, true};
+    case opcode::eq_jmpz:
+    case opcode::neq_jmpz:           return {2, 0, -2, true, true};
+    case opcode::custom:
+    case opcode::end:
+        break;
+    }
+    throw std::logic_error{"no stack effect for opcode " + std::to_string(static_cast<int>(op))};
+}
+
+} // namespace
+
+
+verification verify(const vm_state& vm, std::span<const op_t> code) {
+    const instruction_table& table = *vm.instructions;
+    const size_t capacity = vm.stack.capacity();
+
+    verification result;
+    result.depth.assign(code.size(), verification::unreachable);
+
+    std::vector<size_t> pending;
+
+    // record the depth execution reaches the pc with.
+    // returns false if the pc is outside the program, or another path
+    // reaches it with a different depth.
+    auto reach = [&](size_t from, size_t pc, size_t depth, bool jump) {
+        if (pc >= code.size()) {
+            result.reason = (jump ? "jump out of program bounds at pc " : "program runs past its end at pc ")
+                            + std::to_string(from) + ": " + std::to_string(pc);
+            return false;
+        }
+        if (result.depth[pc] == verification::unreachable) {
+            result.depth[pc] = depth;
+            pending.push_back(pc);
+            return true;
+        }
+        if (result.depth[pc] != depth) {
+            result.reason = "stack depth at pc " + std::to_string(pc) + " is "
+                            + std::to_string(result.depth[pc]) + " or "
+                            + std::to_string(depth) + ", depending on the path";
+            return false;
+        }
+        return true;
+    };
+
+    if (not reach(0, 0, 0, false)) {
+        return result;
+    }
+
+    while (not pending.empty()) {
+        size_t pc = pending.back();
+        pending.pop_back();
+
+        const auto& [op_id, arg] = code[pc];
+        size_t depth = result.depth[pc];
+
+        auto builtin = table.instruction_opcodes.find(op_id);
+        if (builtin == std::end(table.instruction_opcodes)) {
+            if (table.instruction_actions.find(op_id) == std::end(table.instruction_actions)) {
+                result.reason = "unknown op id " + std::to_string(op_id) + " at pc " + std::to_string(pc);
+            } else {
+                result.reason = "custom instruction at pc " + std::to_string(pc);
+            }
+            return result;
+        }
+
+        stack_effect effect = effect_of(builtin->second);
+
+        if (depth < effect.needs) {
+            result.reason = "access to empty stack at pc " + std::to_string(pc);
+            return result;
+        }
+        if (depth + effect.grows > capacity) {
+            result.reason = "stack overflow at pc " + std::to_string(pc)
+                            + ", capacity is " + std::to_string(capacity);
+            return result;
+        }
+        result.max_depth = std::max(result.max_depth, depth + effect.grows);
+
+        size_t next_depth = static_cast<size_t>(static_cast<ptrdiff_t>(depth) + effect.change);
+
+        if (effect.falls_through and not reach(pc, pc + 1, next_depth, false)) {
+            return result;
+        }
+        if (effect.jumps and not reach(pc, static_cast<size_t>(arg), next_depth, true)) {
+            return result;
+        }
+    }
+
+    result.verified = true;
+    return result;
+}
+
+
+} // namespace vm
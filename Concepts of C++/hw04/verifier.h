@@ -0,0 +1,55 @@
+#pragma once
+
+#include <limits>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "vm.h"
+
+
+namespace vm {
+
+/**
+ * what `verify` found out about a program.
+ */
+struct verification {
+    /** depth entry of instructions that can't be reached */
+    static constexpr size_t unreachable = std::numeric_limits<size_t>::max();
+
+    /**
+     * whether every reachable instruction has enough items on the stack,
+     * room for what it pushes, and jumps within the program.
+     * such programs can run without checking each instruction.
+     */
+    bool verified = false;
+
+    /** why the program couldn't be verified */
+    std::string reason;
+
+    /** stack depth before each instruction, as far as analyzed */
+    std::vector<size_t> depth;
+
+    /** the deepest the stack gets */
+    size_t max_depth = 0;
+};
+
+
+/**
+ * statically check the stack use and jumps of a program.
+ *
+ * follows the control flow from pc 0 through JMP and both ways of the
+ * conditional jumps, computing the stack depth at each instruction.
+ *
+ * the analysis can't prove programs with custom instructions, whose effect
+ * is unknown, or where paths meet with different stack depths. neither
+ * can it prove programs where an instruction it reaches would access the
+ * empty stack, overflow it, or jump out of the program: the analysis follows
+ * both ways of each conditional jump, so the failing path may never run.
+ * all these are returned unverified with a reason, and have to run with the
+ * usual checks, which fail them if the failure is really reached.
+ */
+verification verify(const vm_state& vm, std::span<const op_t> code);
+
+
+} // namespace vm
@@ -3,145 +3,306 @@
 #include <iostream>
 #include <limits>
 
-#include "util.h"
+#include "assembler.h"
+#include "jit.h"
+#include "profiler.h"
+#include "registers.h"
+#include "verifier.h"
+#include "threaded.h"
 
 
 namespace vm {
 
-using item_t = int64_t;
+namespace {
+
+/**
+ * register an instruction that the dispatch engines also know natively.
+ */
+void register_builtin(instruction_table& table, std::string_view name, opcode op,
+                      const op_action_t& action) {
+    register_instruction(table, name, action);
+    table.instruction_opcodes[table.instruction_ids.find(name)->second] = op;
+}
 
-// 定义用于堆栈失败和段错误的异常类
-struct vm_stackfail : public std::exception {
-    const char* what() const noexcept override { return "VM堆栈失败"; }
-};
 
-struct vm_segfault : public std::exception {
-    const char* what() const noexcept override { return "VM段错误"; }
-};
+/**
+ * execute with the table dispatch, which supports debugging and profiling.
+ */
+std::tuple<item_t, std::string> run_table(vm_state& vm, std::span<const op_t> code) {
+    vm.pc = 0;
+    vm.stack.clear();
+    vm.output.clear();
 
-// 定义VM状态
-struct vm_state {
-    size_t pc = 0; // 程序代码中的执行位置
-    std::stack<item_t> stack; // 执行数据堆栈
+    // actions may register instructions, which replaces the vm's table
+    std::shared_ptr<const instruction_table> table = vm.instructions;
 
-    // 注册的指令
-    std::unordered_map<std::string, size_t> instruction_ids;
-    std::unordered_map<size_t, std::function<void()>> instruction_actions;
-};
+    profiler* profile = vm.profile;
+    if (profile != nullptr) {
+        profile->begin(code.size(), table->next_op_id);
+    }
+
+    while (true) {
+        if (vm.pc >= code.size()) {
+            throw vm_segfault{"program counter out of bounds: " + std::to_string(vm.pc)};
+        }
 
+        const auto& [op_id, arg] = code[vm.pc];
 
-class vm {
-public:
-    static std::tuple<item_t, std::string> run(vm_state& vm, const std::vector<std::string>& code);
+        if (vm.debug) {
+            std::cout << "-- pc=" << vm.pc
+                      << " op=" << table->instruction_names.at(op_id)
+                      << " arg=" << arg
+                      << " stack size=" << vm.stack.size() << std::endl;
+        }
 
-    static void register_instruction(vm_state& vm, const std::string& instruction, size_t id, std::function<void()> action);
+        auto action = table->instruction_actions.find(op_id);
+        if (action == std::end(table->instruction_actions)) {
+            throw invalid_instruction{"unknown op id: " + std::to_string(op_id)};
+        }
 
-    static void create_vm(vm_state& vm);
-};
+        // advance first, so jumps can just overwrite the pc
+        size_t pc = vm.pc;
+        vm.pc += 1;
 
-// 注册带有其ID和操作的指令
-void register_instruction(vm_state& vm, const std::string& instruction, size_t id, std::function<void()> action) {
-    vm.instruction_ids[instruction] = id;
-    vm.instruction_actions[id] = action;
+        if (profile == nullptr) {
+            if (not action->second(vm, arg)) {
+                break;
+            }
+        } else {
+            uint64_t start = profiler::now();
+            bool proceed = action->second(vm, arg);
+            profile->record(pc, op_id, vm.pc, vm.stack.size(), start, profiler::now());
+            if (not proceed) {
+                break;
+            }
+        }
+    }
+
+    return {vm.stack.top(), vm.output.take()};
 }
 
+} // namespace
 
-code_t assemble(const vm_state& state, std::string_view input_program) {
-    code_t code;
 
-    // convert each line separately
-    for (auto& line : util::split(input_program, '\n')) {
+vm_state create_vm(bool debug) {
+    instruction_table table;
 
-        auto line_words = util::split(line, ' ');
+    register_builtin(table, "LOAD_CONST", opcode::load_const, [](vm_state& vmstate, const item_t arg) {
+        vmstate.stack.push(arg);
+        return true;
+    });
 
-        // only support instruction and one argument
-        if (line_words.size() >= 3) {
-            throw invalid_instruction{std::string{"more than one instruction argument: "} + line};
-        }
+    register_builtin(table, "EXIT", opcode::exit, [](vm_state& vmstate, const item_t /*arg*/) {
+        vmstate.stack.top();
+        return false;
+    });
 
-        // look up instruction id
-        auto& op_name = line_words[0];
-        auto find_op_id = state.instruction_ids.find(op_name);
-        if (find_op_id == std::end(state.instruction_ids)) {
-            throw invalid_instruction{std::string{"unknown instruction: "} + op_name};
-        }
-        op_id_t op_id = find_op_id->second;
+    register_builtin(table, "POP", opcode::pop, [](vm_state& vmstate, const item_t /*arg*/) {
+        vmstate.stack.pop();
+        return true;
+    });
 
-        // parse the argument
-        item_t argument{0};
-        if (line_words.size() == 2) {
-            argument = std::stoll(line_words[1]);
+    register_builtin(table, "ADD", opcode::add, [](vm_state& vmstate, const item_t /*arg*/) {
+        item_t b = vmstate.stack.take();
+        item_t a = vmstate.stack.take();
+        vmstate.stack.push(a + b);
+        return true;
+    });
+
+    register_builtin(table, "DIV", opcode::div, [](vm_state& vmstate, const item_t /*arg*/) {
+        item_t b = vmstate.stack.take();
+        item_t a = vmstate.stack.take();
+        if (b == 0) {
+            throw div_by_zero{"division by zero"};
         }
+        vmstate.stack.push(a / b);
+        return true;
+    });
 
-        // and save the instruction to the code store
-        code.emplace_back(op_id, argument);
-    }
+    register_builtin(table, "EQ", opcode::eq, [](vm_state& vmstate, const item_t /*arg*/) {
+        item_t b = vmstate.stack.take();
+        item_t a = vmstate.stack.take();
+        vmstate.stack.push(a == b ? 1 : 0);
+        return true;
+    });
 
-    return code;
-}
+    register_builtin(table, "NEQ", opcode::neq, [](vm_state& vmstate, const item_t /*arg*/) {
+        item_t b = vmstate.stack.take();
+        item_t a = vmstate.stack.take();
+        vmstate.stack.push(a != b ? 1 : 0);
+        return true;
+    });
 
-// 使用提供的代码运行VM
-std::tuple<item_t, std::string> run(vm_state& vm, const std::vector<std::string>& code) {
-    while (vm.pc < code.size()) {
-        std::istringstream iss(code[vm.pc]);
-        std::string instruction;
-        iss >> instruction;
-
-        // 根据解析的命令执行指令
-        if (vm.instruction_ids.find(instruction) != vm.instruction_ids.end()) {
-            size_t id = vm.instruction_ids[instruction];
-            if (vm.instruction_actions.find(id) != vm.instruction_actions.end()) {
-                try {
-                    vm.instruction_actions[id]();
-                } catch (const vm_stackfail&) {
-                    throw vm_stackfail{};
-                }
-            } else {
-                throw vm_segfault{};
-            }
-        } else {
-            throw vm_segfault{};
+    register_builtin(table, "DUP", opcode::dup, [](vm_state& vmstate, const item_t /*arg*/) {
+        vmstate.stack.push(vmstate.stack.top());
+        return true;
+    });
+
+    register_builtin(table, "JMP", opcode::jmp, [](vm_state& vmstate, const item_t arg) {
+        vmstate.pc = static_cast<size_t>(arg);
+        return true;
+    });
+
+    register_builtin(table, "JMPZ", opcode::jmpz, [](vm_state& vmstate, const item_t arg) {
+        if (vmstate.stack.take() == 0) {
+            vmstate.pc = static_cast<size_t>(arg);
         }
+        return true;
+    });
 
-        vm.pc++;
-    }
+    register_builtin(table, "WRITE", opcode::write, [](vm_state& vmstate, const item_t /*arg*/) {
+        vmstate.output.write_number(vmstate.stack.top());
+        return true;
+    });
 
-    if (!vm.stack.empty()) {
-        item_t result = vm.stack.top();
-        vm.stack.pop();
-        return { result, "" };
-    }
+    register_builtin(table, "WRITE_CHAR", opcode::write_char, [](vm_state& vmstate, const item_t /*arg*/) {
+        vmstate.output.write_char(static_cast<char>(vmstate.stack.top()));
+        return true;
+    });
 
-    return { 0, "" };
-}
+    // superinstructions, produced by `fuse_superinstructions`.
+    // the LOAD_CONST variants work on the top of stack directly, but still
+    // fail like the unfused LOAD_CONST if the stack is full.
 
-// 创建VM并注册指令
-void create_vm(vm_state& vm) {
-    // 使用其ID和操作注册指令
-    register_instruction(vm, "LOAD_CONST", 1, [&vm]() {
-        int value;
-        std::cin >> value;
-        vm.stack.push(value);
+    register_builtin(table, "LOAD_CONST_ADD", opcode::load_const_add, [](vm_state& vmstate, const item_t arg) {
+        if (vmstate.stack.full()) {
+            vmstate.stack.overflow();
+        }
+        vmstate.stack.top() += arg;
+        return true;
+    });
+
+    register_builtin(table, "LOAD_CONST_EQ", opcode::load_const_eq, [](vm_state& vmstate, const item_t arg) {
+        if (vmstate.stack.full()) {
+            vmstate.stack.overflow();
+        }
+        item_t& a = vmstate.stack.top();
+        a = (a == arg) ? 1 : 0;
+        return true;
+    });
+
+    register_builtin(table, "LOAD_CONST_NEQ", opcode::load_const_neq, [](vm_state& vmstate, const item_t arg) {
+        if (vmstate.stack.full()) {
+            vmstate.stack.overflow();
+        }
+        item_t& a = vmstate.stack.top();
+        a = (a != arg) ? 1 : 0;
+        return true;
     });
 
-    register_instruction(vm, "PRINT", 2, [&vm]() {
-        if (!vm.stack.empty()) {
-            std::cout << "TOS: " << vm.stack.top() << std::endl;
+    register_builtin(table, "LOAD_CONST_ADD_DUP", opcode::load_const_add_dup, [](vm_state& vmstate, const item_t arg) {
+        if (vmstate.stack.full()) {
+            vmstate.stack.overflow();
         }
+        vmstate.stack.top() += arg;
+        vmstate.stack.push(vmstate.stack.top());
+        return true;
     });
 
-    // ... 根据您的需求注册其他指令
+    register_builtin(table, "DUP_JMPZ", opcode::dup_jmpz, [](vm_state& vmstate, const item_t arg) {
+        if (vmstate.stack.full()) {
+            vmstate.stack.overflow();
+        }
+        if (vmstate.stack.top() == 0) {
+            vmstate.pc = static_cast<size_t>(arg);
+        }
+        return true;
+    });
 
-    register_instruction(vm, "EXIT", 10, [&vm]() {
-        if (!vm.stack.empty()) {
-            vm.stack.pop();
+    register_builtin(table, "EQ_JMPZ", opcode::eq_jmpz, [](vm_state& vmstate, const item_t arg) {
+        item_t b = vmstate.stack.take();
+        item_t a = vmstate.stack.take();
+        if (a != b) {
+            vmstate.pc = static_cast<size_t>(arg);
         }
+        return true;
     });
 
-    // ... 类似地注册其他指令
+    register_builtin(table, "NEQ_JMPZ", opcode::neq_jmpz, [](vm_state& vmstate, const item_t arg) {
+        item_t b = vmstate.stack.take();
+        item_t a = vmstate.stack.take();
+        if (a == b) {
+            vmstate.pc = static_cast<size_t>(arg);
+        }
+        return true;
+    });
+
+    vm_state vm;
+    vm.debug = debug;
+    vm.instructions = std::make_shared<const instruction_table>(std::move(table));
+    return vm;
+}
+
+
+vm_state copy_settings(const vm_state& vm) {
+    vm_state copy;
+    copy.stack = operand_stack{vm.stack.capacity()};
+    copy.instructions = vm.instructions;
+    copy.dispatch = vm.dispatch;
+    copy.superinstructions = vm.superinstructions;
+    copy.debug = vm.debug;
+    copy.verify = vm.verify;
+    return copy;
+}
+
+
+code_t assemble(const vm_state& vm, std::string_view input_program) {
+    assembler asm_state{vm};
+    asm_state.feed(input_program);
+    return asm_state.finish();
 }
 
 
+void register_instruction(vm_state& vm, std::string_view name,
+                          const op_action_t& action) {
+    // other vm states may share the table, so extend a copy
+    auto table = std::make_shared<instruction_table>(*vm.instructions);
+    register_instruction(*table, name, action);
+    vm.instructions = std::move(table);
+}
+
+
+void register_instruction(instruction_table& table, std::string_view name,
+                          const op_action_t& action) {
+    op_id_t op_id = table.next_op_id;
+    table.next_op_id += 1;
+
+    table.instruction_ids[std::string{name}] = op_id;
+    table.instruction_names[op_id] = name;
+    table.instruction_actions[op_id] = action;
+}
+
+
+std::tuple<item_t, std::string> run(vm_state& vm, const code_t& code) {
+    return run(vm, std::span<const op_t>{code});
+}
+
+
+std::tuple<item_t, std::string> run(vm_state& vm, std::span<const op_t> code) {
+    try {
+        // only programs proven not to fail skip the checks
+        bool checked = not (vm.verify and verify(vm, code).verified);
+
+        bool instrumented = vm.debug or vm.profile != nullptr;
+        if (vm.dispatch == dispatch_mode::threaded and not instrumented) {
+            return run_threaded(vm, thread_code(vm, code, checked));
+        }
+        if (vm.dispatch == dispatch_mode::jit and not instrumented) {
+            return run_jit(vm, code, checked);
+        }
+        if (vm.dispatch == dispatch_mode::registers and not instrumented) {
+            return run_registers(vm, code);
+        }
+        return run_table(vm, code);
+    }
+    catch (...) {
+        // output written before the failure still reaches the sink
+        if (vm.output.has_sink()) {
+            vm.output.flush();
+        }
+        throw;
+    }
+}
 
 
 } // namespace vm
@@ -1,8 +1,12 @@
 #pragma once
 
+#include <charconv>
+#include <cstddef>
 #include <cstdint>
 #include <functional>
-#include <stack>
+#include <memory>
+#include <new>
+#include <span>
 #include <stdexcept>
 #include <string>
 #include <string_view>
@@ -10,6 +14,7 @@
 #include <tuple>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 namespace vm {
 
@@ -44,31 +49,277 @@ struct vm_state;
 using op_action_t = std::function<bool(vm_state&, const item_t)>;
 
 
+/**
+ * hash for instruction names that also accepts `std::string_view`,
+ * so names can be looked up without constructing a `std::string`.
+ */
+struct name_hash {
+    using is_transparent = void;
+
+    size_t operator()(std::string_view name) const {
+        return std::hash<std::string_view>{}(name);
+    }
+};
+
+
 /** stores all the assembled instructions, i.e. this is our running program */
 using code_t = std::vector<op_t>;
 
 
-/** all vm execution state information is stored in here */
-struct vm_state {
+/**
+ * the built-in instructions, which the dispatch engines implement natively.
+ * everything registered through `register_instruction` is `custom` and
+ * executed by calling its `op_action_t`.
+ */
+enum class opcode : uint8_t {
+    custom,
+    load_const,
+    exit,
+    pop,
+    add,
+    div,
+    eq,
+    neq,
+    dup,
+    jmp,
+    jmpz,
+    write,
+    write_char,
+
+    // superinstructions, see `fuse_superinstructions`
+    load_const_add,
+    load_const_eq,
+    load_const_neq,
+    load_const_add_dup,
+    dup_jmpz,
+    eq_jmpz,
+    neq_jmpz,
+
+    /** guard placed behind the last instruction by the dispatch engines */
+    end,
+};
+
+
+/**
+ * how `run` executes a program.
+ */
+enum class dispatch_mode {
+    /** look up each instruction's action by its op id and call it */
+    table,
+    /** translate the code to handler addresses once, then jump between them */
+    threaded,
+    /** compile the code to native code, where supported, see `jit_program` */
+    jit,
+    /** translate the code to a register machine, see `register_program` */
+    registers,
+};
+
+
+// forward declarations
+class jit_program;
+class profiler;
+
+
+/**
+ * the operand stack of the vm.
+ *
+ * items live in one preallocated, cache line aligned block of fixed capacity,
+ * so pushing never allocates and accesses don't chase pointers.
+ * exceeding the capacity or accessing an empty stack throws `vm_stackfail`,
+ * so instructions don't need to check for emptiness themselves.
+ */
+class operand_stack {
+public:
+    /** default maximum stack depth */
+    static constexpr size_t default_capacity = 1024;
+
+    /** alignment of the item storage */
+    static constexpr size_t alignment = 64;
+
+    explicit operand_stack(size_t capacity = default_capacity);
+
+    operand_stack(const operand_stack& other);
+    operand_stack(operand_stack&& other) noexcept;
+    operand_stack& operator=(const operand_stack& other);
+    operand_stack& operator=(operand_stack&& other) noexcept;
+    ~operand_stack() = default;
+
+    void push(item_t item) {
+        if (sp_ == limit_) [[unlikely]] {
+            overflow();
+        }
+        *sp_++ = item;
+        if (sp_ > high_water_) {
+            high_water_ = sp_;
+        }
+    }
+
+    void pop() {
+        if (sp_ == base()) [[unlikely]] {
+            underflow();
+        }
+        --sp_;
+    }
+
+    /** remove the top item and return it */
+    item_t take() {
+        pop();
+        return *sp_;
+    }
+
+    item_t& top() {
+        if (sp_ == base()) [[unlikely]] {
+            underflow();
+        }
+        return *(sp_ - 1);
+    }
+
+    const item_t& top() const {
+        if (sp_ == base()) [[unlikely]] {
+            underflow();
+        }
+        return *(sp_ - 1);
+    }
+
+    bool empty() const { return sp_ == base(); }
+    bool full() const { return sp_ == limit_; }
+    size_t size() const { return static_cast<size_t>(sp_ - base()); }
+    size_t capacity() const { return static_cast<size_t>(limit_ - base()); }
+
+    /** the largest depth this stack has reached */
+    size_t high_water_mark() const {
+        return static_cast<size_t>(high_water_ - base());
+    }
+
+    /** remove all items, keeping capacity and high-water mark */
+    void clear() { sp_ = base(); }
+
+    /** forget the deepest depth reached so far */
+    void reset_high_water_mark() { high_water_ = sp_; }
+
+    /** throw the error for pushing onto a full stack */
+    [[noreturn]] void overflow() const;
+
+    // variants without the capacity and emptiness checks,
+    // for code that was shown not to need them by `verify`.
+
+    void push_unchecked(item_t item) {
+        *sp_++ = item;
+        if (sp_ > high_water_) {
+            high_water_ = sp_;
+        }
+    }
+
+    void pop_unchecked() { --sp_; }
+    item_t take_unchecked() { return *--sp_; }
+    item_t& top_unchecked() { return *(sp_ - 1); }
+
+private:
+    // compiled code keeps the stack pointers in registers
+    friend class jit_program;
+
+    struct aligned_delete {
+        void operator()(item_t* items) const {
+            ::operator delete[](items, std::align_val_t{alignment});
+        }
+    };
+
+    item_t* base() const { return items_.get(); }
+
+    [[noreturn]] void underflow() const;
+
+    std::unique_ptr<item_t[], aligned_delete> items_;
+
+    /** one past the top item */
+    item_t* sp_;
+    /** one past the last usable slot */
+    item_t* limit_;
+    /** one past the deepest item ever stored */
+    item_t* high_water_;
+};
+
+
+/**
+ * where WRITE and WRITE_CHAR put their text.
+ *
+ * text is formatted into a fixed-size buffer. when it fills up, and at the
+ * end of each run, the buffer is handed to the sink, so output streams out
+ * while the program runs, with bounded memory.
+ * without a sink, the text is collected and returned by `run`, as before.
+ */
+class output_buffer {
+public:
+    /** receives a chunk of output text */
+    using sink_t = std::function<void(std::string_view)>;
+
+    /** default buffer size in bytes */
+    static constexpr size_t default_capacity = 4096;
+
+    explicit output_buffer(size_t capacity = default_capacity);
+
+    /** send output to the given sink from now on, or collect it if empty */
+    void set_sink(sink_t sink);
+
+    bool has_sink() const { return static_cast<bool>(sink_); }
+
+    /** write the decimal representation of a value */
+    void write_number(item_t value) {
+        if (buffer_.size() - used_ < max_number_length) {
+            spill();
+        }
+        used_ = static_cast<size_t>(
+            std::to_chars(buffer_.data() + used_, buffer_.data() + buffer_.size(), value).ptr
+            - buffer_.data());
+    }
+
+    void write_char(char c) {
+        if (used_ == buffer_.size()) {
+            spill();
+        }
+        buffer_[used_++] = c;
+    }
+
+    /** hand all buffered text to the sink, or to the collected text */
+    void flush() { spill(); }
+
     /**
-     * where in the program code are we?
+     * flush and return the collected text, which is empty with a sink.
      */
-    size_t pc = 0;
+    std::string take();
 
+    /** drop buffered and collected text */
+    void clear();
+
+private:
+    /** longest text of an item_t, "-9223372036854775808" */
+    static constexpr size_t max_number_length = 20;
+
+    void spill();
+
+    std::vector<char> buffer_;
+    size_t used_ = 0;
+
+    sink_t sink_;
+    std::string collected_;
+};
+
+
+/**
+ * the instructions a vm knows.
+ *
+ * once built, a table is shared read-only by all vm states created from the
+ * same vm, so copying a vm or running many of them doesn't copy the maps.
+ */
+struct instruction_table {
     /**
      * stores which id is given the next instruction that is registered.
      */
     size_t next_op_id = 0;
 
-    /**
-     * the main execution state stack.
-     */
-    std::stack<item_t> stack;
-
     /**
      * mapping of instruction name to operation id.
      */
-    std::unordered_map<std::string, op_id_t> instruction_ids;
+    std::unordered_map<std::string, op_id_t, name_hash, std::equal_to<>> instruction_ids;
 
     /**
      * mapping of operation ids back to instruction names.
@@ -81,12 +332,70 @@ struct vm_state {
      */
     std::unordered_map<op_id_t, op_action_t> instruction_actions;
 
+    /**
+     * mapping of operation ids to the built-in instruction they implement.
+     * ids missing here are custom instructions.
+     */
+    std::unordered_map<op_id_t, opcode> instruction_opcodes;
+};
+
+
+/** all vm execution state information is stored in here */
+struct vm_state {
+    /**
+     * where in the program code are we?
+     */
+    size_t pc = 0;
+
+    /**
+     * the main execution state stack.
+     */
+    operand_stack stack;
+
+    /**
+     * the registered instructions, never modified in place.
+     * `register_instruction` replaces the table with an extended copy,
+     * so other vm states sharing it are unaffected.
+     */
+    std::shared_ptr<const instruction_table> instructions = std::make_shared<const instruction_table>();
+
+    /**
+     * text produced by WRITE and WRITE_CHAR while running.
+     */
+    output_buffer output;
+
+    /**
+     * which engine `run` uses for executing code.
+     */
+    dispatch_mode dispatch = dispatch_mode::threaded;
+
+    /**
+     * let `assemble` fuse common instruction sequences into superinstructions.
+     * programs using custom instructions aren't fused, as these may set the pc.
+     */
+    bool superinstructions = false;
+
     /**
      * activate vm debugging.
+     * debug runs always use the table dispatch, which prints each instruction.
      */
     bool debug = false;
 
+    /**
+     * when set, runs use the table dispatch and record each instruction
+     * executed in this profiler.
+     */
+    profiler* profile = nullptr;
+
+    /**
+     * let `run` check programs with `verify` before executing them.
+     * proven ones run without per-instruction stack and jump checks,
+     * all others run checked as usual.
+     */
+    bool verify = false;
+
     // if you need to store more vm state, add it here!
+    // settings also have to be copied by `copy_settings`.
 };
 
 
@@ -107,6 +416,16 @@ struct vm_state {
 vm_state create_vm(bool debug = false);
 
 
+/**
+ * a fresh vm that runs programs like the given one, e.g. on another thread.
+ *
+ * it shares the instructions, and has the same settings and stack capacity,
+ * but nothing of the current run. the profiler isn't shared, as it
+ * records one run at a time.
+ */
+vm_state copy_settings(const vm_state& vm);
+
+
 /**
  * convert the given instruction string to executable vm code.
  *
@@ -132,14 +451,29 @@ void register_instruction(vm_state& vm, std::string_view name,
                           const op_action_t &action);
 
 
+/**
+ * register a new instruction to a table that isn't shared yet.
+ */
+void register_instruction(instruction_table& table, std::string_view name,
+                          const op_action_t &action);
+
+
 /**
  * execute the given vm instructions.
  *
  * @return the execution results: {last TOS item, result string from WRITE instructions}
+ *         the string is empty if the output went to a sink, see `output_buffer`.
  */
 std::tuple<item_t, std::string> run(vm_state& vm, const code_t &code);
 
 
+/**
+ * execute instructions stored elsewhere than in a `code_t`,
+ * e.g. mapped from a bytecode file.
+ */
+std::tuple<item_t, std::string> run(vm_state& vm, std::span<const op_t> code);
+
+
 //// exception types, thrown in various error situations.
 
 /**
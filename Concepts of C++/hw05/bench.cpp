@@ -0,0 +1,91 @@
+#include "hw05.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace sql::bench {
+
+/// Seconds one call of the function takes, averaged over enough calls to take a while.
+double seconds_per_call(const std::function<void()> &call) {
+    size_t calls = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed{0};
+    while (elapsed.count() < 0.2) {
+        call();
+        calls += 1;
+        elapsed = std::chrono::steady_clock::now() - start;
+    }
+    return elapsed.count() / static_cast<double>(calls);
+}
+
+/// Queries with 1 to 16 columns and varying whitespace, every fourth one invalid.
+std::vector<std::string> queries(size_t count) {
+    std::vector<std::string> result;
+    for (size_t i = 0; i < count; i++) {
+        std::string query = i % 2 == 0 ? "SELECT " : "select\n    ";
+        size_t columns = 1 + i * 7 % 16;
+        for (size_t column = 0; column < columns; column++) {
+            query += (column == 0 ? "" : ", ") + std::string{"customer_column_"} + std::to_string(column);
+        }
+        query += i % 3 == 0 ? "\nFROM customer_orders;" : " from orders ;";
+        if (i % 4 == 3) {
+            query += " trailing";
+        }
+        result.push_back(std::move(query));
+    }
+    return result;
+}
+
+/// Validation of raw queries, through a token vector and streaming the tokens to the FSM.
+void validation(size_t count) {
+    std::vector<std::string> texts = queries(count);
+    size_t bytes = 0;
+    for (const std::string &text : texts) {
+        bytes += text.size();
+    }
+
+    volatile size_t sink = 0;
+    double materialized = seconds_per_call([&] {
+        size_t valid = 0;
+        for (const std::string &text : texts) {
+            std::vector<Token> tokens;
+            for (const Token &token : Lexer{text}) {
+                tokens.push_back(token);
+            }
+            valid += is_valid_sql_query(tokens);
+        }
+        sink = sink + valid;
+    });
+    double streamed = seconds_per_call([&] {
+        size_t valid = 0;
+        for (const std::string &text : texts) {
+            valid += is_valid_sql_query(text);
+        }
+        sink = sink + valid;
+    });
+
+    auto report = [&](const char *name, double seconds) {
+        std::cout << "  " << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(8) << seconds / static_cast<double>(count) * 1e9 << " ns/query "
+                  << std::setw(8) << static_cast<double>(bytes) / seconds / 1e6 << " MB/s" << std::endl;
+    };
+    std::cout << count << " queries, " << bytes << " bytes" << std::endl;
+    report("token vector", materialized);
+    report("streamed", streamed);
+}
+
+} // namespace sql::bench
+
+int main(int argc, char *argv[]) {
+    size_t count = 10000;
+    if (argc > 1) {
+        count = std::strtoull(argv[1], nullptr, 10);
+    }
+    sql::bench::validation(count);
+    return 0;
+}
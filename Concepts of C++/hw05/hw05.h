@@ -1,4 +1,5 @@
 #pragma once
 
+#include "lexer.h"
 #include "token.h"
 #include "validator.h"
@@ -0,0 +1,215 @@
+#include "lexer.h"
+
+#include <algorithm>
+#include <bit>
+
+#include "validator.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define SQL_HAVE_SSE2 1
+#endif
+
+// avx2 code is compiled for its function only, and used if the cpu has it
+#if defined(SQL_HAVE_SSE2) && defined(__GNUC__) && defined(__x86_64__)
+#define SQL_HAVE_AVX2 1
+#endif
+
+namespace sql {
+
+namespace {
+
+bool is_space(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+bool is_word(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+/// Compare a word against a lowercase keyword, ignoring the word's case.
+/// Setting bit 5 lowercases letters, and doesn't turn digits or '_' into letters.
+bool is_keyword(std::string_view word, std::string_view keyword) {
+    if (word.size() != keyword.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < word.size(); i++) {
+        if ((word[i] | 0x20) != keyword[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+detail::CharClasses classify_scalar(const char *data, size_t length) {
+    detail::CharClasses classes{0, 0};
+    for (size_t i = 0; i < length; i++) {
+        classes.space |= uint64_t{is_space(data[i])} << i;
+        classes.word |= uint64_t{is_word(data[i])} << i;
+    }
+    return classes;
+}
+
+#ifdef SQL_HAVE_SSE2
+
+/// unsigned low <= byte <= high for all bytes, by shifting the range to start at 0
+__m128i in_range_sse2(__m128i bytes, char low, char high) {
+    __m128i shifted = _mm_sub_epi8(bytes, _mm_set1_epi8(low));
+    return _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(static_cast<char>(high - low))), shifted);
+}
+
+detail::CharClasses classify_sse2(const char *data) {
+    detail::CharClasses classes{0, 0};
+    for (size_t i = 0; i < 64; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+
+        __m128i space = _mm_or_si128(in_range_sse2(chunk, '\t', '\r'), _mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')));
+        __m128i word = _mm_or_si128(
+            _mm_or_si128(in_range_sse2(_mm_or_si128(chunk, _mm_set1_epi8(0x20)), 'a', 'z'),
+                         in_range_sse2(chunk, '0', '9')),
+            _mm_cmpeq_epi8(chunk, _mm_set1_epi8('_')));
+
+        classes.space |= uint64_t{static_cast<uint32_t>(_mm_movemask_epi8(space))} << i;
+        classes.word |= uint64_t{static_cast<uint32_t>(_mm_movemask_epi8(word))} << i;
+    }
+    return classes;
+}
+
+#endif
+
+#ifdef SQL_HAVE_AVX2
+
+__attribute__((target("avx2")))
+__m256i in_range_avx2(__m256i bytes, char low, char high) {
+    __m256i shifted = _mm256_sub_epi8(bytes, _mm256_set1_epi8(low));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(static_cast<char>(high - low))), shifted);
+}
+
+__attribute__((target("avx2")))
+detail::CharClasses classify_avx2(const char *data) {
+    detail::CharClasses classes{0, 0};
+    for (size_t i = 0; i < 64; i += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+
+        __m256i space = _mm256_or_si256(in_range_avx2(chunk, '\t', '\r'),
+                                        _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(' ')));
+        __m256i word = _mm256_or_si256(
+            _mm256_or_si256(in_range_avx2(_mm256_or_si256(chunk, _mm256_set1_epi8(0x20)), 'a', 'z'),
+                            in_range_avx2(chunk, '0', '9')),
+            _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('_')));
+
+        classes.space |= uint64_t{static_cast<uint32_t>(_mm256_movemask_epi8(space))} << i;
+        classes.word |= uint64_t{static_cast<uint32_t>(_mm256_movemask_epi8(word))} << i;
+    }
+    return classes;
+}
+
+#endif
+
+using classify_block_t = detail::CharClasses (*)(const char *);
+
+/// the fastest classification of 64 bytes the cpu supports, nullptr if none
+classify_block_t select_classify_block() {
+#ifdef SQL_HAVE_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        return &classify_avx2;
+    }
+#endif
+#ifdef SQL_HAVE_SSE2
+    return &classify_sse2;
+#else
+    return nullptr;
+#endif
+}
+
+} // namespace
+
+namespace detail {
+
+CharClasses classify(const char *data, size_t length) {
+    static const classify_block_t classify_block = select_classify_block();
+
+    if (length == 64 && classify_block != nullptr) {
+        return classify_block(data);
+    }
+    return classify_scalar(data, length);
+}
+
+} // namespace detail
+
+void Lexer::skip(uint64_t detail::CharClasses::*mask) {
+    while (position_ < query_.size()) {
+        if (position_ >= block_ + block_size_) {
+            block_ = position_;
+            block_size_ = std::min<size_t>(64, query_.size() - block_);
+            classes_ = detail::classify(query_.data() + block_, block_size_);
+        }
+
+        // the run ends at the first clear bit, bits past the block are clear
+        // unless the block is full, where a run to its end continues in the next.
+        uint64_t run = ~(classes_.*mask >> (position_ - block_));
+        position_ += static_cast<size_t>(std::countr_zero(run));
+        if (position_ < block_ + block_size_) {
+            return;
+        }
+    }
+}
+
+std::optional<Token> Lexer::next() {
+    skip(&detail::CharClasses::space);
+    if (position_ >= query_.size()) {
+        return std::nullopt;
+    }
+
+    size_t start = position_;
+    char first = query_[start];
+    if (is_word(first)) {
+        skip(&detail::CharClasses::word);
+        std::string_view word = query_.substr(start, position_ - start);
+
+        if (is_digit(first)) {
+            // numbers aren't part of the grammar
+            return Token{token::Unknown{word}};
+        }
+        if (is_keyword(word, "select")) {
+            return Token{token::Select{}};
+        }
+        if (is_keyword(word, "from")) {
+            return Token{token::From{}};
+        }
+        return Token{token::Identifier{word}};
+    }
+
+    position_++;
+    switch (first) {
+    case '*':
+        return Token{token::Asterisks{}};
+    case ',':
+        return Token{token::Comma{}};
+    case ';':
+        return Token{token::Semicolon{}};
+    default:
+        return Token{token::Unknown{query_.substr(start, 1)}};
+    }
+}
+
+bool is_valid_sql_query(std::string_view query) {
+    SqlValidator validator;
+    Lexer lexer{query};
+
+    // nothing leads out of the invalid state, so the rest needn't be scanned
+    while (!validator.is_invalid()) {
+        auto token = lexer.next();
+        if (!token) {
+            break;
+        }
+        validator.handle(*token);
+    }
+    return validator.is_valid();
+}
+
+} // namespace sql
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <string_view>
+
+#include "token.h"
+
+namespace sql {
+
+namespace detail {
+
+/// Character classes of up to 64 bytes of text: bit i of a mask is set if
+/// the i-th byte is in the class.
+struct CharClasses {
+    /// whitespace, as `std::isspace` finds it in the "C" locale
+    uint64_t space;
+    /// letters, digits and underscores, which make up identifiers
+    uint64_t word;
+};
+
+/// Classify the bytes of the text, full blocks of 64 bytes with SSE2 or AVX2.
+CharClasses classify(const char *data, size_t length);
+
+} // namespace detail
+
+/// Splits a query into tokens, without copying it.
+///
+/// Keywords are recognized regardless of case, identifiers and unknown
+/// characters become tokens viewing into the query, so it has to outlive them.
+/// The text is classified 64 bytes at a time into bit masks, and runs of
+/// whitespace or identifier characters are skipped by counting bits.
+///
+///   Lexer lexer{query};
+///   while (auto token = lexer.next()) { ... }
+class Lexer {
+public:
+    explicit Lexer(std::string_view query) : query_{query} {}
+
+    /// The next token, or nothing at the end of the query.
+    std::optional<Token> next();
+
+    /// Position of the next character to scan in the query.
+    size_t position() const { return position_; }
+
+    class iterator {
+    public:
+        using value_type = Token;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() = default;
+
+        explicit iterator(Lexer &lexer) : lexer_{&lexer}, token_{lexer.next()} {}
+
+        const Token &operator*() const { return *token_; }
+
+        iterator &operator++() {
+            token_ = lexer_->next();
+            return *this;
+        }
+
+        void operator++(int) { ++*this; }
+
+        bool operator==(std::default_sentinel_t) const { return !token_.has_value(); }
+
+    private:
+        Lexer *lexer_ = nullptr;
+        std::optional<Token> token_;
+    };
+
+    /// Iterating consumes the tokens.
+    iterator begin() { return iterator{*this}; }
+    std::default_sentinel_t end() const { return {}; }
+
+private:
+    /// Advance past the characters whose bits are set in the given mask.
+    void skip(uint64_t detail::CharClasses::*mask);
+
+    std::string_view query_;
+    size_t position_ = 0;
+
+    /// The classified block of the query, starting at `block_`.
+    size_t block_ = 0;
+    size_t block_size_ = 0;
+    detail::CharClasses classes_{0, 0};
+};
+
+/// Validate a query as text, feeding its tokens to the FSM as they are scanned.
+bool is_valid_sql_query(std::string_view query);
+
+} // namespace sql
@@ -42,5 +42,9 @@ int main() {
         std::cout << "Query not valid\n";
     }
 
+    // raw queries are split into tokens while they are validated
+    std::string_view query = "select Col1, Col2 FROM MY_TABLE;";
+    std::cout << "'" << query << "' is " << (sql::is_valid_sql_query(query) ? "valid" : "not valid") << "\n";
+
     // Your other tests go here
 }
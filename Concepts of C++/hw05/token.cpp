@@ -3,7 +3,7 @@
 namespace sql {
 Token::Token(token_type value) : value_(value) {}
 
-auto Token::value() const -> token_type {
+auto Token::value() const -> const token_type& {
     return this->value_;
 }
 
@@ -1,6 +1,6 @@
 #pragma once
 
-#include <string>
+#include <string_view>
 #include <variant>
 #ifndef HEADER_NAME_H
 #define HEADER_NAME_H
@@ -24,9 +24,15 @@ namespace token {
     // Token struct for ';' (semicolon)
     struct Semicolon {};
 
-    // Token struct for identifiers (like table or column names)
+    // Token struct for identifiers (like table or column names).
+    // the name is a view into the query text, which has to outlive the token.
     struct Identifier {
-        std::string name;
+        std::string_view name;
+    };
+
+    // Token struct for text that isn't part of the grammar, no state accepts it
+    struct Unknown {
+        std::string_view text;
     };
 
     // ...（添加任何其他必需的令牌类型）
@@ -42,7 +48,8 @@ public:
         token::Comma, 
         token::From, 
         token::Semicolon, 
-        token::Identifier
+        token::Identifier,
+        token::Unknown
         // ...（添加任何其他必需的令牌类型）
     >;
 
@@ -50,7 +57,7 @@ public:
     Token(token_type value);
 
     // Getter for the underlying variant
-    [[nodiscard]] token_type value() const;
+    [[nodiscard]] const token_type& value() const;
 
 private:
     token_type value_;
@@ -14,6 +14,10 @@ bool SqlValidator::is_valid() const {
     return std::holds_alternative<state::Valid>(state_);
 }
 
+bool SqlValidator::is_invalid() const {
+    return std::holds_alternative<state::Invalid>(state_);
+}
+
 void SqlValidator::handle(const Token &token) {
     state_ = std::visit([this, &token](auto&& arg) {
         return transition(arg, token);
@@ -79,6 +79,9 @@ public:
 
     bool is_valid() const; // 函数声明
 
+    /// Whether the FSM is in the invalid state, which no token leads out of.
+    bool is_invalid() const;
+
     void handle(const Token &token); // 函数声明
 
 private:
@@ -10,6 +10,12 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include <doctest/doctest.h>
 
+#include <algorithm>
+#include <bit>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
 #include "hw02.h"
 
 // require at least c++20
@@ -42,3 +48,307 @@ TEST_CASE("combinations") {
     CHECK_EQ(combination(6, 3), 20);
     CHECK_EQ(combination(8, 5), 56);
 }
+
+TEST_CASE("wide combinations") {
+    SUBCASE("uint64_t") {
+        CHECK_EQ(combination<uint64_t>(30, 15), 155117520);
+        CHECK_EQ(combination<uint64_t>(67, 33), 14226520737620288370u);
+        CHECK_EQ(combination<uint64_t>(1'000'000, 1), 1'000'000);
+        CHECK_EQ(combination<uint64_t>(1'000'000, 999'999), 1'000'000);
+        CHECK_EQ(combination<uint64_t>(10, 50), 0);
+        CHECK_THROWS_AS(combination<uint64_t>(68, 34), std::overflow_error);
+        CHECK_THROWS_AS(combination(68, 34), std::overflow_error);
+    }
+
+#ifdef __SIZEOF_INT128__
+    SUBCASE("uint128_t") {
+        CHECK(combination<uint128_t>(68, 34) == uint128_t{14226520737620288370u} * 2);
+        CHECK(combination<uint128_t>(30, 15) == 155117520);
+        CHECK_THROWS_AS(combination<uint128_t>(200, 100), std::overflow_error);
+    }
+#endif
+
+    SUBCASE("big_uint") {
+        CHECK_EQ(combination<big_uint>(100, 50).to_string(), "100891344545564193334812497256");
+        CHECK_EQ(combination<big_uint>(67, 33), big_uint{14226520737620288370u});
+        CHECK_EQ(combination<big_uint>(10, 50), big_uint{0});
+        CHECK_EQ(combination<big_uint>(7, 0), big_uint{1});
+    }
+}
+
+TEST_CASE("wide permutations") {
+    SUBCASE("uint64_t") {
+        CHECK_EQ(permutation<uint64_t>(20, 20), 2432902008176640000u);
+        CHECK_EQ(permutation<uint64_t>(100, 3), 970200);
+        CHECK_EQ(permutation<uint64_t>(4, 20), 0);
+        CHECK_THROWS_AS(permutation<uint64_t>(21, 21), std::overflow_error);
+        CHECK_THROWS_AS(factorial(21), std::overflow_error);
+    }
+
+#ifdef __SIZEOF_INT128__
+    SUBCASE("uint128_t") {
+        CHECK(permutation<uint128_t>(21, 21) == uint128_t{2432902008176640000u} * 21);
+        CHECK_THROWS_AS(permutation<uint128_t>(40, 40), std::overflow_error);
+    }
+#endif
+
+    SUBCASE("big_uint") {
+        CHECK_EQ(permutation<big_uint>(50, 50).to_string(),
+                 "30414093201713378043612608166064768844377641568960512000000000000");
+        CHECK_EQ(permutation<big_uint>(40, 20).to_string(), "335367096786357081410764800000");
+        CHECK_EQ(permutation<big_uint>(4, 20), big_uint{0});
+    }
+}
+
+TEST_CASE("lookup tables") {
+    static_assert(factorial(20) == 2432902008176640000u);
+    static_assert(permutation(20, 10) == 0x9c197dcc00);
+    static_assert(combination(60, 30) == 118264581564861424u);
+    static_assert(combination(63, 64) == 0);
+    static_assert(detail::binomials[63][31] == 916312070471295267u);
+
+    // the tables agree with the runtime versions they replace
+    for (uint64_t n = 0; n < detail::binomial_rows; n++) {
+        for (uint64_t k = 0; k <= n + 1; k++) {
+            CHECK_EQ(combination(n, k), combination<uint64_t>(n, k));
+        }
+    }
+    for (uint64_t n = 0; n < detail::factorial_count; n++) {
+        for (uint64_t k = 0; k <= n + 1; k++) {
+            CHECK_EQ(permutation(n, k), permutation<uint64_t>(n, k));
+        }
+    }
+
+    // past the tables, the runtime versions answer
+    CHECK_EQ(combination(64, 32), 1832624140942590534u);
+    CHECK_EQ(combination(1000, 2), 499500);
+    CHECK_EQ(permutation(30, 3), 24360);
+}
+
+TEST_CASE("modular combinatorics") {
+    // the exact value mod p, for comparison
+    auto residue = [](big_uint value, uint32_t prime) { return value.divide(prime); };
+
+    SUBCASE("tables") {
+        modular_combinatorics mod{1000};
+        CHECK_EQ(mod.prime(), 1'000'000'007);
+        CHECK_EQ(mod.max_n(), 1000);
+        CHECK_EQ(mod.factorial(0), 1);
+        CHECK_EQ(mod.factorial(20), 2432902008176640000u % 1'000'000'007);
+        CHECK_EQ(mod.combination(1000, 500), 159835829);
+        CHECK_EQ(mod.combination(10, 50), 0);
+        CHECK_EQ(mod.permutation(10, 50), 0);
+        for (uint64_t n : {0, 1, 17, 64, 100, 999, 1000}) {
+            for (uint64_t k : {uint64_t{0}, uint64_t{1}, n / 3, n / 2, n}) {
+                CHECK_EQ(mod.combination(n, k), residue(combination<big_uint>(n, k), mod.prime()));
+                CHECK_EQ(mod.permutation(n, k), residue(permutation<big_uint>(n, k), mod.prime()));
+            }
+        }
+    }
+
+    SUBCASE("lucas") {
+        // the tables cover all residues of a small prime, so any n is answered
+        modular_combinatorics mod{1000, 13};
+        CHECK_EQ(mod.max_n(), 12);
+        CHECK_EQ(mod.factorial(13), 0);
+        CHECK_EQ(mod.factorial(1'000'000), 0);
+        for (uint64_t n : {13, 14, 27, 100, 169, 300}) {
+            for (uint64_t k = 0; k <= n; k += 7) {
+                CHECK_EQ(mod.combination(n, k), residue(combination<big_uint>(n, k), 13));
+                CHECK_EQ(mod.permutation(n, k), residue(permutation<big_uint>(n, k), 13));
+            }
+        }
+    }
+
+    SUBCASE("batch") {
+        modular_combinatorics mod{2000, 1009};
+        std::vector<uint32_t> ns;
+        std::vector<uint32_t> ks;
+        for (uint32_t i = 0; i < 101; i++) {
+            // inside and beyond the tables, some with k > n
+            ns.push_back(i * 37 % 2500);
+            ks.push_back(i * 53 % 1200);
+        }
+
+        std::vector<uint32_t> results(ns.size());
+        mod.combinations(ns, ks, results);
+        for (size_t i = 0; i < ns.size(); i++) {
+            CHECK_EQ(results[i], mod.combination(ns[i], ks[i]));
+        }
+        mod.permutations(ns, ks, results);
+        for (size_t i = 0; i < ns.size(); i++) {
+            CHECK_EQ(results[i], mod.permutation(ns[i], ks[i]));
+        }
+
+        std::vector<uint32_t> fewer(ns.size() - 1);
+        CHECK_THROWS_AS(mod.combinations(ns, ks, fewer), std::invalid_argument);
+        CHECK_THROWS_AS(mod.permutations(ns, fewer, results), std::invalid_argument);
+    }
+
+    SUBCASE("errors") {
+        CHECK_THROWS_AS(modular_combinatorics(10, 2), std::invalid_argument);
+        CHECK_THROWS_AS(modular_combinatorics(10, 91), std::invalid_argument);
+        CHECK_THROWS_AS(modular_combinatorics(10, 2'147'483'659), std::invalid_argument);
+
+        modular_combinatorics mod{100};
+        CHECK_THROWS_AS(mod.factorial(101), std::out_of_range);
+        CHECK_THROWS_AS(mod.combination(101, 3), std::out_of_range);
+        CHECK_THROWS_AS(mod.permutation(101, 3), std::out_of_range);
+        CHECK_EQ(mod.combination(101, 102), 0);
+    }
+}
+
+TEST_CASE("combination ranges") {
+    SUBCASE("lexicographic order") {
+        combination_range range{5, 3};
+        CHECK_EQ(range.size(), 10);
+
+        std::vector<std::vector<uint32_t>> items;
+        for (std::span<const uint32_t> item : range) {
+            CHECK_EQ(range.rank(item), items.size());
+            CHECK_EQ(range.unrank(items.size()), std::vector<uint32_t>(item.begin(), item.end()));
+            items.emplace_back(item.begin(), item.end());
+        }
+        CHECK(range.empty());
+        CHECK_EQ(items.size(), 10);
+        CHECK_EQ(items.front(), std::vector<uint32_t>{0, 1, 2});
+        CHECK_EQ(items[1], std::vector<uint32_t>{0, 1, 3});
+        CHECK_EQ(items.back(), std::vector<uint32_t>{2, 3, 4});
+        CHECK(std::is_sorted(items.begin(), items.end()));
+    }
+
+    SUBCASE("batches") {
+        combination_range range{20, 4};
+        combination_range reference{20, 4};
+        enumeration_batch<uint32_t> batch{64, 4};
+
+        size_t total = 0;
+        while (range.fill(batch) != 0) {
+            CHECK_EQ(batch.values().size(), batch.size() * 4);
+            for (size_t i = 0; i < batch.size(); i++) {
+                CHECK(std::ranges::equal(batch[i], reference.current()));
+                reference.next();
+            }
+            total += batch.size();
+        }
+        CHECK_EQ(total, 4845);
+        CHECK(batch.empty());
+
+        enumeration_batch<uint32_t> wrong{8, 3};
+        CHECK_THROWS_AS(combination_range(20, 4).fill(wrong), std::invalid_argument);
+    }
+
+    SUBCASE("split") {
+        combination_range range{12, 5};
+        range.next();
+        auto parts = range.split(7);
+        CHECK_EQ(parts.size(), 7);
+
+        uint64_t position = 1;
+        for (combination_range& part : parts) {
+            CHECK_EQ(part.position(), position);
+            CHECK(std::ranges::equal(part.current(), range.unrank(position)));
+            position += part.size();
+        }
+        CHECK_EQ(position, 792);
+        CHECK_EQ(combination_range(4, 2).split(100).size(), 6);
+        CHECK_THROWS_AS(range.split(0), std::invalid_argument);
+    }
+
+    SUBCASE("errors") {
+        CHECK_THROWS_AS(combination_range(100, 50), std::overflow_error);
+        CHECK_THROWS_AS(combination_range(5, 3, 4, 11), std::out_of_range);
+        CHECK_THROWS_AS(combination_range(5, 3).unrank(10), std::out_of_range);
+        CHECK_THROWS_AS(combination_range(5, 3).rank(std::vector<uint32_t>{0, 2, 2}), std::invalid_argument);
+        CHECK_THROWS_AS(combination_range(5, 3).rank(std::vector<uint32_t>{0, 2, 5}), std::invalid_argument);
+    }
+}
+
+TEST_CASE("subset mask ranges") {
+    subset_mask_range range{10, 4};
+    CHECK_EQ(range.size(), 210);
+
+    uint64_t previous = 0;
+    uint64_t rank = 0;
+    for (uint64_t mask : range) {
+        CHECK_GT(mask, previous);
+        CHECK_EQ(std::popcount(mask), 4);
+        CHECK_LT(mask, uint64_t{1} << 10);
+        CHECK_EQ(range.rank(mask), rank);
+        CHECK_EQ(range.unrank(rank), mask);
+        previous = mask;
+        rank++;
+    }
+    CHECK_EQ(rank, 210);
+
+    // a part of the ranks continues where the full range is at that rank
+    subset_mask_range part{64, 2, 1000, 1100};
+    enumeration_batch<uint64_t> batch{128, 1};
+    CHECK_EQ(part.fill(batch), 100);
+    CHECK_EQ(part.fill(batch), 0);
+    subset_mask_range full{64, 2};
+    for (size_t i = 0; i < 100; i++) {
+        CHECK_EQ(batch[i][0], full.unrank(1000 + i));
+    }
+
+    CHECK_EQ(subset_mask_range(64, 64).unrank(0), ~uint64_t{0});
+    CHECK_THROWS_AS(subset_mask_range(65, 2), std::invalid_argument);
+    CHECK_THROWS_AS(subset_mask_range(10, 4).rank(0b111), std::invalid_argument);
+    CHECK_THROWS_AS(subset_mask_range(10, 4).unrank(210), std::out_of_range);
+}
+
+TEST_CASE("permutation ranges") {
+    SUBCASE("heap's order") {
+        permutation_range range{5};
+        CHECK_EQ(range.size(), 120);
+
+        std::set<std::vector<uint32_t>> seen;
+        std::vector<uint32_t> previous;
+        for (std::span<const uint32_t> item : range) {
+            std::vector<uint32_t> permutation(item.begin(), item.end());
+            CHECK(std::is_permutation(permutation.begin(), permutation.end(), permutation_range(5).unrank(0).begin()));
+            CHECK_EQ(range.rank(item), seen.size());
+            CHECK_EQ(range.unrank(seen.size()), permutation);
+            if (!previous.empty()) {
+                // a single swap apart
+                size_t differences = 0;
+                for (size_t i = 0; i < 5; i++) {
+                    differences += previous[i] != permutation[i];
+                }
+                CHECK_EQ(differences, 2);
+            }
+            seen.insert(permutation);
+            previous = permutation;
+        }
+        CHECK_EQ(seen.size(), 120);
+    }
+
+    SUBCASE("batches and split") {
+        permutation_range range{7};
+        auto parts = range.split(3);
+        CHECK_EQ(parts.size(), 3);
+
+        enumeration_batch<uint32_t> batch{100, 7};
+        std::set<std::vector<uint32_t>> seen;
+        for (permutation_range& part : parts) {
+            while (part.fill(batch) != 0) {
+                for (size_t i = 0; i < batch.size(); i++) {
+                    CHECK(seen.emplace(batch[i].begin(), batch[i].end()).second);
+                }
+            }
+        }
+        CHECK_EQ(seen.size(), 5040);
+
+        enumeration_batch<uint32_t> wrong{8, 6};
+        CHECK_THROWS_AS(range.fill(wrong), std::invalid_argument);
+    }
+
+    SUBCASE("errors") {
+        CHECK_EQ(permutation_range(20).size(), 2432902008176640000u);
+        CHECK_THROWS_AS(permutation_range(21), std::overflow_error);
+        CHECK_THROWS_AS(permutation_range(5, 100, 121), std::out_of_range);
+        CHECK_THROWS_AS(permutation_range(5).unrank(120), std::out_of_range);
+        CHECK_THROWS_AS(permutation_range(3).rank(std::vector<uint32_t>{0, 1, 1}), std::invalid_argument);
+        CHECK_THROWS_AS(permutation_range(3).rank(std::vector<uint32_t>{0, 1}), std::invalid_argument);
+    }
+}
@@ -10,8 +10,17 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include <doctest/doctest.h>
 
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iterator>
+#include <memory>
 #include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 
 #include "hw03.h"
@@ -203,3 +212,433 @@ TEST_CASE("sort_contacts") {
 
     test_formatting(s, nrs_sorted);
 }
+
+
+TEST_CASE("indexed_storage") {
+    SUBCASE("shared_numbers") {
+        contact_list::storage s;
+        CHECK(contact_list::add(s, "first", 7));
+        CHECK(contact_list::add(s, "second", 7));
+        CHECK(contact_list::add(s, "third", 7));
+
+        // the contact added first is found, then the next one
+        CHECK_EQ(contact_list::get_name_by_number(s, 7), "first");
+        CHECK(contact_list::remove(s, "first"));
+        CHECK_EQ(contact_list::get_name_by_number(s, 7), "second");
+        CHECK(contact_list::remove(s, "third"));
+        CHECK_EQ(contact_list::get_name_by_number(s, 7), "second");
+        CHECK(contact_list::remove(s, "second"));
+        CHECK_EQ(contact_list::get_name_by_number(s, 7), "");
+    }
+    SUBCASE("compaction") {
+        contact_list::storage s;
+        for (int i = 0; i < 1000; i++) {
+            CHECK(contact_list::add(s, "name" + std::to_string(i), i));
+        }
+        // enough tombstones to compact several times
+        for (int i = 0; i < 1000; i += 4) {
+            CHECK(contact_list::remove(s, "name" + std::to_string(i)));
+        }
+        for (int i = 1; i < 1000; i += 4) {
+            CHECK(contact_list::remove(s, "name" + std::to_string(i)));
+        }
+        for (int i = 2; i < 1000; i += 4) {
+            CHECK(contact_list::remove(s, "name" + std::to_string(i)));
+        }
+        CHECK_EQ(contact_list::size(s), 250);
+        CHECK_LT(s.names.size(), 1000);
+
+        std::vector<std::pair<std::string, int>> expected;
+        for (int i = 3; i < 1000; i += 4) {
+            CHECK_EQ(contact_list::get_number_by_name(s, "name" + std::to_string(i)), i);
+            CHECK_EQ(contact_list::get_name_by_number(s, i), "name" + std::to_string(i));
+            CHECK_EQ(contact_list::get_number_by_name(s, "name" + std::to_string(i - 1)), -1);
+            expected.emplace_back("name" + std::to_string(i), i);
+        }
+        // the order of the remaining contacts is kept
+        test_formatting(s, expected);
+
+        // removed names can be added again
+        CHECK(contact_list::add(s, "name0", 5000));
+        CHECK_EQ(contact_list::get_number_by_name(s, "name0"), 5000);
+        CHECK_EQ(contact_list::size(s), 251);
+    }
+}
+
+
+TEST_CASE("sorted_contacts") {
+    auto names = [](const std::vector<contact_list::contact>& found) {
+        std::vector<std::string> result;
+        for (const auto& contact : found) {
+            result.emplace_back(contact.name);
+        }
+        return result;
+    };
+
+    SUBCASE("keep_sorted") {
+        contact_list::storage s;
+        fill_contacts(s);
+        contact_list::keep_sorted(s);
+        CHECK(contact_list::add(s, "E", 15));
+        CHECK(contact_list::add(s, "AA", 16));
+        CHECK(contact_list::remove(s, "D"));
+
+        std::vector<std::pair<std::string, int>> expected = {
+            {"A", 10}, {"AA", 16}, {"B", 13}, {"C", 12}, {"E", 15}, {"F", 11}, {"J", 42}, {"Z", 19},
+        };
+        test_formatting(s, expected);
+        REQUIRE_NOTHROW(contact_list::sort(s));
+        test_formatting(s, expected);
+    }
+    SUBCASE("find_prefix") {
+        // sorted and unsorted storages give the same results
+        for (bool sorted : {false, true}) {
+            contact_list::storage s;
+            if (sorted) {
+                contact_list::keep_sorted(s);
+            }
+            for (const char* name : {"Müller", "Maier", "Mueller", "Mü", "Meier", "Schmidt", "M"}) {
+                contact_list::add(s, name, static_cast<contact_list::number_t>(std::strlen(name)));
+            }
+
+            auto found = contact_list::find_prefix(s, "M");
+            CHECK_EQ(names(found), std::vector<std::string>{"M", "Maier", "Meier", "Mueller", "Mü", "Müller"});
+            CHECK_EQ(found[1].number, 5);
+
+            CHECK_EQ(names(contact_list::find_prefix(s, "Mü")), std::vector<std::string>{"Mü", "Müller"});
+            CHECK_EQ(names(contact_list::find_prefix(s, "M", 2)), std::vector<std::string>{"M", "Maier"});
+            CHECK(contact_list::find_prefix(s, "X").empty());
+            CHECK_EQ(contact_list::find_prefix(s, "").size(), 7);
+        }
+    }
+    SUBCASE("find_range") {
+        for (bool sorted : {false, true}) {
+            contact_list::storage s;
+            fill_contacts(s);
+            if (sorted) {
+                contact_list::keep_sorted(s);
+            }
+            CHECK_EQ(names(contact_list::find_range(s, "B", "F")), std::vector<std::string>{"B", "C", "D"});
+            CHECK_EQ(names(contact_list::find_range(s, "B", "F", 1)), std::vector<std::string>{"B"});
+            CHECK_EQ(names(contact_list::find_range(s, "K", "ZZ")), std::vector<std::string>{"Z"});
+            CHECK(contact_list::find_range(s, "F", "B").empty());
+        }
+    }
+}
+
+
+TEST_CASE("string_pool") {
+    SUBCASE("store") {
+        contact_list::string_pool pool;
+        contact_list::name_ref first = pool.store("first");
+        contact_list::name_ref second = pool.store(std::string(contact_list::string_pool::block_size + 1, 'x'));
+        CHECK_EQ(pool.view(first), "first");
+        CHECK_EQ(pool.view(second).size(), contact_list::string_pool::block_size + 1);
+        CHECK_EQ(pool.view(contact_list::name_ref{}), "");
+
+        // without deduplication, equal strings are stored twice
+        CHECK_NE(pool.store("first").offset(), first.offset());
+
+        REQUIRE_THROWS_AS(pool.store(std::string(contact_list::name_ref::max_length + 1, 'x')), std::length_error);
+    }
+    SUBCASE("deduplicate") {
+        contact_list::string_pool pool{true};
+        contact_list::name_ref first = pool.store("name");
+        size_t used = pool.used();
+        CHECK_EQ(pool.store("name").offset(), first.offset());
+        CHECK_EQ(pool.used(), used);
+    }
+    SUBCASE("copies") {
+        contact_list::storage s;
+        fill_contacts(s);
+        contact_list::storage copy = s;
+
+        // copies have their own pool, and can be modified independently
+        CHECK_NE(copy.pool, s.pool);
+        CHECK(contact_list::add(copy, "Y", 99));
+        CHECK(contact_list::remove(copy, "A"));
+        CHECK_EQ(contact_list::size(s), 7);
+        CHECK_EQ(contact_list::get_number_by_name(s, "A"), 10);
+        CHECK_EQ(contact_list::get_number_by_name(s, "Y"), -1);
+
+        contact_list::storage assigned;
+        assigned = copy;
+        CHECK_EQ(contact_list::to_string(assigned), contact_list::to_string(copy));
+    }
+    SUBCASE("moves") {
+        contact_list::storage s;
+        fill_contacts(s);
+        std::string expected = contact_list::to_string(s);
+        contact_list::storage moved = std::move(s);
+        CHECK_EQ(contact_list::to_string(moved), expected);
+
+        // the moved-from storage is empty, and can be used again
+        CHECK_EQ(contact_list::size(s), 0);
+        CHECK(contact_list::add(s, "B", 2));
+        CHECK_EQ(contact_list::get_number_by_name(s, "B"), 2);
+        CHECK_NE(s.pool, moved.pool);
+
+        contact_list::storage assigned;
+        fill_contacts(assigned);
+        assigned = std::move(moved);
+        CHECK_EQ(contact_list::to_string(assigned), expected);
+        CHECK(contact_list::add(moved, "B", 3));
+        CHECK_EQ(contact_list::get_number_by_name(moved, "B"), 3);
+        CHECK_EQ(contact_list::get_number_by_name(assigned, "B"), 13);
+    }
+    SUBCASE("use_pool") {
+        auto pool = std::make_shared<contact_list::string_pool>(true);
+        contact_list::storage first;
+        contact_list::storage second;
+        fill_contacts(first);
+        contact_list::use_pool(first, pool);
+        contact_list::use_pool(second, pool);
+        fill_contacts(second);
+
+        // common names are stored once
+        CHECK_EQ(first.pool, second.pool);
+        CHECK_EQ(pool->used(), 7);
+
+        // copies keep sharing the pool
+        contact_list::storage copy = first;
+        CHECK_EQ(copy.pool, pool);
+
+        // compaction leaves the shared pool alone
+        for (const char* name : {"A", "B", "C", "D", "F"}) {
+            CHECK(contact_list::remove(first, name));
+        }
+        CHECK_EQ(first.pool, pool);
+        CHECK_EQ(contact_list::get_number_by_name(first, "J"), 42);
+        CHECK_EQ(contact_list::get_number_by_name(second, "A"), 10);
+        CHECK_EQ(contact_list::get_number_by_name(copy, "A"), 10);
+    }
+}
+
+
+TEST_CASE("add_all") {
+    SUBCASE("like_add") {
+        std::vector<std::string> names;
+        std::vector<contact_list::number_t> numbers;
+        for (int i = 0; i < 5000; i++) {
+            // every name twice, and some empty ones
+            names.push_back(i % 100 == 0 ? "" : "name" + std::to_string(i % 2500));
+            numbers.push_back(i);
+        }
+
+        contact_list::storage bulk;
+        contact_list::add(bulk, "name7", -7);
+        size_t added = contact_list::add_all(bulk, names, numbers, 4);
+
+        contact_list::storage single;
+        contact_list::add(single, "name7", -7);
+        size_t single_added = 0;
+        for (size_t i = 0; i < names.size(); i++) {
+            single_added += contact_list::add(single, names[i], numbers[i]);
+        }
+
+        CHECK_EQ(added, single_added);
+        CHECK_EQ(contact_list::size(bulk), contact_list::size(single));
+        CHECK_EQ(contact_list::to_string(bulk), contact_list::to_string(single));
+        // the first of the duplicates was added
+        CHECK_EQ(contact_list::get_number_by_name(bulk, "name7"), -7);
+        CHECK_EQ(contact_list::get_number_by_name(bulk, "name8"), 8);
+        CHECK_EQ(contact_list::get_name_by_number(bulk, 2508), "");
+    }
+    SUBCASE("views") {
+        std::vector<std::string_view> names{"B", "A", "B"};
+        std::vector<contact_list::number_t> numbers{1, 2, 3};
+        contact_list::storage s;
+        contact_list::keep_sorted(s);
+        CHECK_EQ(contact_list::add_all(s, names, numbers), 2);
+        CHECK_EQ(contact_list::to_string(s), "A - 2\nB - 1\n");
+    }
+    SUBCASE("mismatch") {
+        std::vector<std::string_view> names{"A", "B"};
+        std::vector<contact_list::number_t> numbers{1};
+        contact_list::storage s;
+        REQUIRE_THROWS_AS(contact_list::add_all(s, names, numbers), std::invalid_argument);
+        CHECK_EQ(contact_list::size(s), 0);
+    }
+}
+
+
+TEST_CASE("streaming_to_string") {
+    contact_list::storage s;
+    for (int i = 0; i < 2000; i++) {
+        contact_list::add(s, "contact" + std::to_string(i), i * 1000);
+    }
+    const std::string text = contact_list::to_string(s);
+
+    SUBCASE("chunks") {
+        for (size_t chunk_size : {1, 100, 4096}) {
+            std::string streamed;
+            size_t chunks = 0;
+            contact_list::to_string(s, [&](std::string_view chunk) {
+                streamed.append(chunk);
+                chunks += 1;
+            }, chunk_size);
+            CHECK_EQ(streamed, text);
+            CHECK_GE(chunks, text.size() / (chunk_size + 32));
+        }
+    }
+    SUBCASE("stream") {
+        std::ostringstream out;
+        contact_list::to_string(s, out);
+        CHECK_EQ(out.str(), text);
+    }
+}
+
+
+TEST_CASE("concurrent_storage") {
+    SUBCASE("operations") {
+        contact_list::storage s;
+        fill_contacts(s);
+        contact_list::concurrent_storage contacts{s};
+
+        CHECK_EQ(contacts.size(), 7);
+        CHECK(contacts.add("X", 1337));
+        CHECK_FALSE(contacts.add("X", 1));
+        CHECK_EQ(contacts.get_number_by_name("X"), 1337);
+        CHECK_EQ(contacts.get_name_by_number(42), "J");
+        CHECK(contacts.remove("J"));
+        CHECK_FALSE(contacts.remove("J"));
+        CHECK_EQ(contacts.get_name_by_number(42), "");
+
+        contacts.sort();
+        CHECK_EQ(contacts.to_string().substr(0, 14), "A - 10\nB - 13\n");
+        contacts.keep_sorted();
+        CHECK(contacts.add("AA", 1));
+        CHECK_EQ(contacts.to_string().substr(0, 14), "A - 10\nAA - 1\n");
+
+        // the storage it was made from is unchanged
+        CHECK_EQ(contact_list::size(s), 7);
+    }
+    SUBCASE("threads") {
+        contact_list::concurrent_storage contacts;
+        std::atomic<bool> done{false};
+
+        // writers add and remove, readers always see a consistent state
+        std::vector<std::thread> writers;
+        for (int writer = 0; writer < 2; writer++) {
+            writers.emplace_back([&, writer] {
+                for (int i = 0; i < 500; i++) {
+                    std::string name = "w" + std::to_string(writer) + "_" + std::to_string(i);
+                    CHECK(contacts.add(name, i));
+                    if (i % 2 == 0) {
+                        CHECK(contacts.remove(name));
+                    }
+                }
+            });
+        }
+        std::vector<std::thread> readers;
+        std::atomic<size_t> inconsistent{0};
+        for (int reader = 0; reader < 2; reader++) {
+            readers.emplace_back([&] {
+                while (not done) {
+                    contacts.read([&](const contact_list::storage& view) {
+                        if (view.name_index.size() != contact_list::size(view)) {
+                            inconsistent += 1;
+                        }
+                    });
+                    contacts.get_number_by_name("w0_1");
+                }
+            });
+        }
+        for (auto& writer : writers) {
+            writer.join();
+        }
+        done = true;
+        for (auto& reader : readers) {
+            reader.join();
+        }
+
+        CHECK_EQ(inconsistent, 0);
+        CHECK_EQ(contacts.size(), 500);
+        CHECK_EQ(contacts.get_number_by_name("w1_499"), 499);
+        CHECK_EQ(contacts.get_number_by_name("w1_498"), -1);
+    }
+}
+
+
+TEST_CASE("snapshot") {
+    const std::string path = (std::filesystem::temp_directory_path() / "test03_snapshot.bin").string();
+
+    SUBCASE("round_trip") {
+        for (bool sorted : {false, true}) {
+            contact_list::storage s;
+            fill_contacts(s);
+            contact_list::add(s, "Shared", 42);
+            contact_list::remove(s, "C");
+            if (sorted) {
+                contact_list::keep_sorted(s);
+            }
+            contact_list::save(s, path);
+
+            contact_list::snapshot mapped{path};
+            CHECK_EQ(mapped.size(), 7);
+            CHECK_EQ(mapped.sorted(), sorted);
+            CHECK_EQ(mapped.get_number_by_name("Z"), 19);
+            CHECK_EQ(mapped.get_number_by_name("C"), -1);
+            CHECK_EQ(mapped.get_name_by_number(42), "J");
+            CHECK_EQ(mapped.get_name_by_number(12), "");
+            CHECK_EQ(mapped.to_string(), contact_list::to_string(s));
+
+            // the loaded storage can be modified
+            contact_list::storage loaded = contact_list::load(path);
+            CHECK_EQ(contact_list::to_string(loaded), contact_list::to_string(s));
+            CHECK(contact_list::add(loaded, "AB", 5));
+            CHECK_EQ(contact_list::get_number_by_name(loaded, "AB"), 5);
+            CHECK_EQ(loaded.sorted, sorted);
+        }
+    }
+    SUBCASE("empty") {
+        contact_list::storage s;
+        contact_list::save(s, path);
+        contact_list::snapshot mapped{path};
+        CHECK_EQ(mapped.size(), 0);
+        CHECK_EQ(mapped.get_number_by_name("A"), -1);
+        CHECK_EQ(mapped.to_string(), "");
+    }
+    SUBCASE("rejected") {
+        contact_list::storage s;
+        fill_contacts(s);
+        contact_list::save(s, path);
+
+        std::string bytes;
+        {
+            std::ifstream input{path, std::ios::binary};
+            bytes.assign(std::istreambuf_iterator<char>{input}, {});
+        }
+
+        std::string changed = bytes;
+        changed[0] ^= 1;
+        std::ofstream{path, std::ios::binary} << changed;
+        REQUIRE_THROWS_AS(contact_list::snapshot{path}, contact_list::invalid_snapshot);
+
+        changed = bytes;
+        changed.back() ^= 1;
+        std::ofstream{path, std::ios::binary} << changed;
+        REQUIRE_THROWS_AS(contact_list::snapshot{path}, contact_list::invalid_snapshot);
+
+        std::ofstream{path, std::ios::binary} << bytes.substr(0, bytes.size() / 2);
+        REQUIRE_THROWS_AS(contact_list::snapshot(path, false), contact_list::invalid_snapshot);
+
+        // tables referring past the contacts, without a checksum to catch it.
+        // the 64 byte header is followed by 7 name ends, 7 numbers and the name table.
+        auto corrupted = [&](size_t value_index, uint64_t value, size_t values = 1) {
+            std::string changed = bytes;
+            for (size_t i = 0; i < values; i++) {
+                std::memcpy(changed.data() + 64 + (value_index + i) * sizeof(uint64_t), &value, sizeof(value));
+            }
+            std::ofstream{path, std::ios::binary} << changed;
+            REQUIRE_THROWS_AS(contact_list::snapshot(path, false), contact_list::invalid_snapshot);
+        };
+        corrupted(0, 1000);          // name end beyond the text
+        corrupted(1, 0);             // name ends decreasing
+        corrupted(14, 7);            // name slot beyond the contacts
+        corrupted(14, 0, 16);        // name table without empty buckets
+        corrupted(14 + 16 + 3, 99);  // number slot beyond the contacts
+    }
+
+    std::filesystem::remove(path);
+}
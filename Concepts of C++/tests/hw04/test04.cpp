@@ -10,8 +10,15 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include <doctest/doctest.h>
 
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iterator>
 #include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
 
 
 #include "hw04.h"
@@ -611,3 +618,970 @@ TEST_CASE("vm_segfault") {
         REQUIRE_THROWS_AS(vm::run(state, code), vm::vm_segfault);
     }
 }
+
+
+TEST_CASE("vm_threaded_dispatch") {
+    // counts 5 down to 1, writing each number
+    const char* countdown =
+        "LOAD_CONST 5\n"
+        "DUP\n"
+        "WRITE\n"
+        "LOAD_CONST -1\n"
+        "ADD\n"
+        "DUP\n"
+        "JMPZ 8\n"
+        "JMP 1\n"
+        "EXIT\n";
+
+    SUBCASE("same_as_table") {
+        vm::vm_state state = vm::create_vm();
+        auto code = vm::assemble(state, countdown);
+
+        state.dispatch = vm::dispatch_mode::table;
+        const auto [table_top, table_output] = vm::run(state, code);
+        state.dispatch = vm::dispatch_mode::threaded;
+        const auto [threaded_top, threaded_output] = vm::run(state, code);
+
+        CHECK_EQ(table_top, 0);
+        CHECK_EQ(table_output, "54321");
+        CHECK_EQ(threaded_top, table_top);
+        CHECK_EQ(threaded_output, table_output);
+    }
+    SUBCASE("threaded_code") {
+        vm::vm_state state = vm::create_vm();
+        auto code = vm::assemble(state, countdown);
+        vm::threaded_code_t threaded = vm::thread_code(state, code);
+
+        // one op per instruction and the end guard
+        CHECK_EQ(threaded.ops.size(), code.size() + 1);
+        CHECK_EQ(threaded.ops.back().op, vm::opcode::end);
+
+        // the threaded code can be run again
+        for (int i = 0; i < 2; i++) {
+            const auto& [topstack, output_string] = vm::run_threaded(state, threaded);
+            CHECK_EQ(topstack, 0);
+            CHECK_EQ(output_string, "54321");
+        }
+    }
+    SUBCASE("custom_instruction") {
+        vm::vm_state state = vm::create_vm();
+        register_instruction(state, "NEG", [](vm::vm_state& vmstate, const vm::item_t) {
+            vmstate.stack.top() = -vmstate.stack.top();
+            return true;
+        });
+        auto code = vm::assemble(state,
+                                 "LOAD_CONST 42\n"
+                                 "NEG\n"
+                                 "WRITE\n"
+                                 "EXIT\n");
+        const auto& [topstack, output_string] = vm::run_threaded(state, code);
+        CHECK_EQ(topstack, -42);
+        CHECK_EQ(output_string, "-42");
+    }
+    SUBCASE("errors") {
+        vm::vm_state state = vm::create_vm();
+        auto code = vm::assemble(state,
+                                 "LOAD_CONST 1\n"
+                                 "LOAD_CONST 0\n"
+                                 "DIV\n"
+                                 "EXIT\n");
+        REQUIRE_THROWS_AS(vm::run_threaded(state, code), vm::div_by_zero);
+        // the pc is that of the failing instruction
+        CHECK_EQ(state.pc, 2);
+
+        code = vm::assemble(state, "LOAD_CONST 1\n");
+        REQUIRE_THROWS_AS(vm::run_threaded(state, code), vm::vm_segfault);
+    }
+}
+
+
+TEST_CASE("vm_operand_stack") {
+    SUBCASE("push_pop") {
+        vm::operand_stack stack{4};
+        CHECK(stack.empty());
+        CHECK_EQ(stack.capacity(), 4);
+
+        stack.push(1);
+        stack.push(2);
+        CHECK_EQ(stack.size(), 2);
+        CHECK_EQ(stack.top(), 2);
+        CHECK_EQ(stack.take(), 2);
+        CHECK_EQ(stack.take(), 1);
+        CHECK(stack.empty());
+        REQUIRE_THROWS_AS(stack.pop(), vm::vm_stackfail);
+        REQUIRE_THROWS_AS(stack.top(), vm::vm_stackfail);
+    }
+    SUBCASE("capacity") {
+        vm::operand_stack stack{2};
+        stack.push(1);
+        stack.push(2);
+        CHECK(stack.full());
+        REQUIRE_THROWS_AS(stack.push(3), vm::vm_stackfail);
+        CHECK_EQ(stack.size(), 2);
+    }
+    SUBCASE("high_water_mark") {
+        vm::operand_stack stack;
+        stack.push(1);
+        stack.push(2);
+        stack.push(3);
+        stack.clear();
+        stack.push(4);
+        CHECK_EQ(stack.high_water_mark(), 3);
+        stack.reset_high_water_mark();
+        CHECK_EQ(stack.high_water_mark(), 1);
+    }
+    SUBCASE("copy") {
+        vm::operand_stack stack{8};
+        stack.push(7);
+        vm::operand_stack copy = stack;
+        copy.push(8);
+        CHECK_EQ(copy.capacity(), 8);
+        CHECK_EQ(copy.size(), 2);
+        CHECK_EQ(stack.size(), 1);
+        CHECK_EQ(stack.top(), 7);
+    }
+    SUBCASE("vm_overflow") {
+        vm::vm_state state = vm::create_vm();
+        state.stack = vm::operand_stack{3};
+        auto code = vm::assemble(state,
+                                 "LOAD_CONST 1\n"
+                                 "DUP\n"
+                                 "JMP 1\n");
+        for (auto mode : {vm::dispatch_mode::table, vm::dispatch_mode::threaded}) {
+            state.dispatch = mode;
+            REQUIRE_THROWS_AS(vm::run(state, code), vm::vm_stackfail);
+        }
+    }
+}
+
+
+TEST_CASE("vm_superinstructions") {
+    // counts up to 3, with several sequences the pass fuses
+    const char* count_up =
+        "LOAD_CONST 0\n"
+        "LOAD_CONST 1\n"
+        "ADD\n"
+        "DUP\n"
+        "WRITE\n"
+        "DUP\n"
+        "LOAD_CONST 3\n"
+        "NEQ\n"
+        "JMPZ 10\n"
+        "JMP 1\n"
+        "EXIT\n";
+
+    SUBCASE("fused") {
+        vm::vm_state state = vm::create_vm();
+        auto plain = vm::assemble(state, count_up);
+        state.superinstructions = true;
+        auto fused = vm::assemble(state, count_up);
+
+        CHECK_LT(fused.size(), plain.size());
+        for (auto mode : {vm::dispatch_mode::table, vm::dispatch_mode::threaded}) {
+            state.dispatch = mode;
+            const auto [plain_top, plain_output] = vm::run(state, plain);
+            const auto [fused_top, fused_output] = vm::run(state, fused);
+            CHECK_EQ(plain_output, "123");
+            CHECK_EQ(fused_top, plain_top);
+            CHECK_EQ(fused_output, plain_output);
+        }
+    }
+    SUBCASE("jump_target_inside") {
+        vm::vm_state state = vm::create_vm();
+        state.superinstructions = true;
+        // jumping to the ADD keeps LOAD_CONST; ADD apart
+        auto code = vm::assemble(state,
+                                 "LOAD_CONST 2\n"
+                                 "LOAD_CONST 3\n"
+                                 "JMP 4\n"
+                                 "LOAD_CONST 10\n"
+                                 "ADD\n"
+                                 "EXIT\n");
+        CHECK_EQ(code.size(), 6);
+        const auto& [topstack, output_string] = vm::run(state, code);
+        CHECK_EQ(topstack, 5);
+    }
+    SUBCASE("custom_instructions") {
+        vm::vm_state state = vm::create_vm();
+        state.superinstructions = true;
+        // sets the pc to an index of the unfused program
+        register_instruction(state, "GOTO", [](vm::vm_state& vmstate, const vm::item_t arg) {
+            vmstate.pc = static_cast<size_t>(arg);
+            return true;
+        });
+        auto code = vm::assemble(state,
+                                 "LOAD_CONST 1\n"
+                                 "LOAD_CONST 1\n"
+                                 "ADD\n"
+                                 "GOTO 5\n"
+                                 "EXIT\n"
+                                 "WRITE\n"
+                                 "EXIT\n");
+        CHECK_EQ(code.size(), 7);
+        const auto& [topstack, output_string] = vm::run(state, code);
+        CHECK_EQ(output_string, "2");
+    }
+}
+
+
+TEST_CASE("vm_streaming_assembler") {
+    const std::string program =
+        "LOAD_CONST 40\n"
+        "LOAD_CONST 2\n"
+        "ADD\n"
+        "WRITE\n"
+        "EXIT";
+
+    SUBCASE("chunks") {
+        vm::vm_state state = vm::create_vm();
+        auto whole = vm::assemble(state, program);
+
+        // lines split across all possible chunk sizes
+        for (size_t chunk = 1; chunk <= program.size(); chunk++) {
+            vm::assembler assembler{state};
+            for (size_t start = 0; start < program.size(); start += chunk) {
+                assembler.feed(std::string_view{program}.substr(start, chunk));
+            }
+            CHECK_EQ(assembler.finish(), whole);
+        }
+    }
+    SUBCASE("stream") {
+        vm::vm_state state = vm::create_vm();
+        std::istringstream input{program};
+        auto code = vm::assemble(state, input);
+        CHECK_EQ(code, vm::assemble(state, program));
+
+        const auto& [topstack, output_string] = vm::run(state, code);
+        CHECK_EQ(topstack, 42);
+        CHECK_EQ(output_string, "42");
+    }
+    SUBCASE("errors") {
+        vm::vm_state state = vm::create_vm();
+        vm::assembler assembler{state};
+        assembler.feed("LOAD_CONST 1\nLOAD_");
+        REQUIRE_THROWS_AS(assembler.feed("CONST 2 3\n"), vm::invalid_instruction);
+    }
+}
+
+
+TEST_CASE("vm_bytecode") {
+    const std::string path = (std::filesystem::temp_directory_path() / "test04_bytecode.bin").string();
+
+    auto read_file = [&] {
+        std::ifstream input{path, std::ios::binary};
+        return std::string{std::istreambuf_iterator<char>{input}, {}};
+    };
+    auto write_file = [&](const std::string& bytes) {
+        std::ofstream{path, std::ios::binary} << bytes;
+    };
+
+    SUBCASE("round_trip") {
+        vm::vm_state state = vm::create_vm();
+        auto code = vm::assemble(state,
+                                 "LOAD_CONST 6\n"
+                                 "LOAD_CONST 7\n"
+                                 "EQ\n"
+                                 "JMPZ 5\n"
+                                 "EXIT\n"
+                                 "LOAD_CONST 67\n"
+                                 "WRITE\n"
+                                 "EXIT\n");
+        vm::save_bytecode(state, code, path);
+
+        vm::bytecode_file file{state, path};
+        CHECK(file.mapped());
+        CHECK(std::equal(code.begin(), code.end(), file.code().begin(), file.code().end()));
+
+        const auto& [topstack, output_string] = vm::run(state, file.code());
+        CHECK_EQ(topstack, 67);
+        CHECK_EQ(output_string, "67");
+    }
+    SUBCASE("other_op_ids") {
+        vm::vm_state writer = vm::create_vm();
+        register_instruction(writer, "TWICE", [](vm::vm_state& vmstate, const vm::item_t) {
+            vmstate.stack.top() *= 2;
+            return true;
+        });
+        register_instruction(writer, "INC", [](vm::vm_state& vmstate, const vm::item_t) {
+            vmstate.stack.top() += 1;
+            return true;
+        });
+        vm::save_bytecode(writer, vm::assemble(writer, "LOAD_CONST 20\nINC\nTWICE\nEXIT\n"), path);
+
+        // the same instructions, registered with other op ids
+        vm::vm_state reader = vm::create_vm();
+        register_instruction(reader, "INC", [](vm::vm_state& vmstate, const vm::item_t) {
+            vmstate.stack.top() += 1;
+            return true;
+        });
+        register_instruction(reader, "TWICE", [](vm::vm_state& vmstate, const vm::item_t) {
+            vmstate.stack.top() *= 2;
+            return true;
+        });
+        vm::bytecode_file file{reader, path};
+        CHECK_FALSE(file.mapped());
+        CHECK_EQ(std::get<0>(vm::run(reader, file.code())), 42);
+
+        // without them, the file can't be loaded
+        vm::vm_state plain = vm::create_vm();
+        REQUIRE_THROWS_AS(vm::bytecode_file(plain, path), vm::invalid_instruction);
+    }
+    SUBCASE("rejected") {
+        vm::vm_state state = vm::create_vm();
+        vm::save_bytecode(state, vm::assemble(state, "LOAD_CONST 1\nWRITE\nEXIT\n"), path);
+        const std::string bytes = read_file();
+
+        SUBCASE("magic") {
+            std::string changed = bytes;
+            changed[0] = 'X';
+            write_file(changed);
+            REQUIRE_THROWS_AS(vm::bytecode_file(state, path), vm::invalid_bytecode);
+        }
+        SUBCASE("truncated") {
+            write_file(bytes.substr(0, bytes.size() - 1));
+            REQUIRE_THROWS_AS(vm::bytecode_file(state, path), vm::invalid_bytecode);
+            write_file(bytes.substr(0, 20));
+            REQUIRE_THROWS_AS(vm::bytecode_file(state, path), vm::invalid_bytecode);
+        }
+        SUBCASE("checksum") {
+            std::string changed = bytes;
+            changed.back() ^= 1;
+            write_file(changed);
+            REQUIRE_THROWS_AS(vm::bytecode_file(state, path), vm::invalid_bytecode);
+        }
+        SUBCASE("name_length") {
+            // lengths that wrap around when added to the offset,
+            // in the first name entry after the 48 byte header
+            for (uint64_t length : {~uint64_t{0}, ~uint64_t{0} - 20, uint64_t{1} << 40}) {
+                std::string changed = bytes;
+                std::memcpy(changed.data() + 48 + sizeof(uint64_t), &length, sizeof(length));
+                write_file(changed);
+                REQUIRE_THROWS_AS(vm::bytecode_file(state, path, false), vm::invalid_bytecode);
+            }
+        }
+    }
+
+    std::filesystem::remove(path);
+}
+
+
+TEST_CASE("vm_jit") {
+    // counts 1000 down to 0
+    const char* countdown =
+        "LOAD_CONST 1000\n"
+        "LOAD_CONST -1\n"
+        "ADD\n"
+        "DUP\n"
+        "JMPZ 6\n"
+        "JMP 1\n"
+        "EXIT\n";
+
+    SUBCASE("same_as_table") {
+        vm::vm_state state = vm::create_vm();
+        auto code = vm::assemble(state,
+                                 "LOAD_CONST 10\n"
+                                 "DUP\n"
+                                 "WRITE\n"
+                                 "LOAD_CONST 32\n"
+                                 "WRITE_CHAR\n"
+                                 "POP\n"
+                                 "LOAD_CONST -1\n"
+                                 "ADD\n"
+                                 "DUP\n"
+                                 "JMPZ 11\n"
+                                 "JMP 1\n"
+                                 "LOAD_CONST 84\n"
+                                 "LOAD_CONST 2\n"
+                                 "DIV\n"
+                                 "EXIT\n");
+
+        state.dispatch = vm::dispatch_mode::table;
+        const auto [table_top, table_output] = vm::run(state, code);
+        const auto [jit_top, jit_output] = vm::run_jit(state, code);
+        state.dispatch = vm::dispatch_mode::jit;
+        const auto [mode_top, mode_output] = vm::run(state, code);
+
+        CHECK_EQ(table_top, 42);
+        CHECK_EQ(table_output, "10 9 8 7 6 5 4 3 2 1 ");
+        CHECK_EQ(jit_top, table_top);
+        CHECK_EQ(jit_output, table_output);
+        CHECK_EQ(mode_top, table_top);
+        CHECK_EQ(mode_output, table_output);
+    }
+    SUBCASE("program") {
+        vm::vm_state state = vm::create_vm();
+        auto code = vm::assemble(state, countdown);
+        vm::jit_program program{state, code};
+        CHECK_EQ(program.fallback_count(), 0);
+
+        // compiled or not, it runs like the table dispatch
+        state.dispatch = vm::dispatch_mode::table;
+        const auto expected = vm::run(state, code);
+        CHECK_EQ(std::get<0>(expected), 0);
+        CHECK_EQ(program.run(state), expected);
+        CHECK_EQ(program.run(state), expected);
+    }
+    SUBCASE("custom_instruction") {
+        vm::vm_state state = vm::create_vm();
+        register_instruction(state, "SQUARE", [](vm::vm_state& vmstate, const vm::item_t) {
+            vmstate.stack.top() *= vmstate.stack.top();
+            return true;
+        });
+        auto code = vm::assemble(state,
+                                 "LOAD_CONST 12\n"
+                                 "SQUARE\n"
+                                 "WRITE\n"
+                                 "EXIT\n");
+        // the custom instruction and WRITE run in the interpreter
+        vm::jit_program program{state, code};
+        CHECK_EQ(program.fallback_count(), 2);
+        const auto& [topstack, output_string] = program.run(state);
+        CHECK_EQ(topstack, 144);
+        CHECK_EQ(output_string, "144");
+    }
+    SUBCASE("errors") {
+        vm::vm_state state = vm::create_vm();
+        REQUIRE_THROWS_AS(vm::run_jit(state, vm::assemble(state, "LOAD_CONST 1\nLOAD_CONST 0\nDIV\nEXIT\n")),
+                          vm::div_by_zero);
+        REQUIRE_THROWS_AS(vm::run_jit(state, vm::assemble(state, "POP\nEXIT\n")), vm::vm_stackfail);
+        REQUIRE_THROWS_AS(vm::run_jit(state, vm::assemble(state, "JMP 7\nEXIT\n")), vm::vm_segfault);
+    }
+}
+
+
+TEST_CASE("vm_batch") {
+    vm::vm_state state = vm::create_vm();
+    std::vector<vm::code_t> programs;
+    for (int i = 0; i < 50; i++) {
+        programs.push_back(vm::assemble(state,
+                                        "LOAD_CONST " + std::to_string(i) + "\n"
+                                        "DUP\n"
+                                        "WRITE\n"
+                                        "LOAD_CONST " + std::to_string(i % 5) + "\n"
+                                        "DIV\n"
+                                        "EXIT\n"));
+    }
+
+    auto check = [&](const std::vector<vm::batch_result>& results) {
+        REQUIRE_EQ(results.size(), programs.size());
+        for (size_t i = 0; i < programs.size(); i++) {
+            if (i % 5 == 0) {
+                CHECK_FALSE(results[i].ok());
+                REQUIRE_THROWS_AS(results[i].get(), vm::div_by_zero);
+            } else {
+                REQUIRE(results[i].ok());
+                const auto& [topstack, output_string] = results[i].get();
+                CHECK_EQ(topstack, static_cast<vm::item_t>(i / (i % 5)));
+                CHECK_EQ(output_string, std::to_string(i));
+            }
+        }
+    };
+
+    SUBCASE("run_batch") {
+        check(vm::run_batch(state, programs, 4));
+    }
+    SUBCASE("runner") {
+        vm::batch_runner runner{3};
+        CHECK_EQ(runner.threads(), 3);
+        // the workers are reused for several batches
+        check(runner.run(state, programs));
+        check(runner.run(state, programs));
+        CHECK(runner.run(state, {}).empty());
+    }
+    SUBCASE("settings") {
+        // the workers run with the vm's settings, here the verifier's
+        state.verify = true;
+        state.stack = vm::operand_stack{2};
+        std::vector<vm::code_t> checked{
+            vm::assemble(state, "LOAD_CONST 0\nJMPZ 3\nPOP\nLOAD_CONST 7\nEXIT\n"),
+            vm::assemble(state, "LOAD_CONST 1\nDUP\nDUP\nEXIT\n"),
+        };
+        auto results = vm::run_batch(state, checked, 2);
+        CHECK_EQ(std::get<0>(results[0].get()), 7);
+        REQUIRE_THROWS_AS(results[1].get(), vm::vm_stackfail);
+    }
+}
+
+
+TEST_CASE("vm_profiler") {
+    vm::vm_state state = vm::create_vm();
+    auto code = vm::assemble(state,
+                             "LOAD_CONST 3\n"
+                             "LOAD_CONST -1\n"
+                             "ADD\n"
+                             "DUP\n"
+                             "JMPZ 6\n"
+                             "JMP 1\n"
+                             "EXIT\n");
+
+    SUBCASE("counters") {
+        vm::profiler profile;
+        state.profile = &profile;
+        const auto& [topstack, output_string] = vm::run(state, code);
+        CHECK_EQ(topstack, 0);
+
+        const auto& by_pc = profile.by_pc();
+        REQUIRE_EQ(by_pc.size(), code.size());
+        CHECK_EQ(by_pc[0].executions, 1);
+        CHECK_EQ(by_pc[2].executions, 3);
+        // JMPZ jumped once, JMP each time
+        CHECK_EQ(by_pc[4].executions, 3);
+        CHECK_EQ(by_pc[4].jumps, 1);
+        CHECK_EQ(by_pc[5].jumps, 2);
+        CHECK_EQ(by_pc[6].executions, 1);
+
+        const auto& by_op = profile.by_op();
+        CHECK_EQ(by_op[code[1].first].executions, 4);
+
+        // counts accumulate until reset
+        vm::run(state, code);
+        CHECK_EQ(profile.by_pc()[2].executions, 6);
+        profile.reset();
+        vm::run(state, code);
+        CHECK_EQ(profile.by_pc()[2].executions, 3);
+
+        std::ostringstream report;
+        report.precision(3);
+        const std::ios_base::fmtflags flags = report.flags();
+        profile.report(report, state);
+        CHECK_NE(report.str().find("ADD"), std::string::npos);
+
+        // the report leaves the stream's formatting as it was
+        CHECK_EQ(report.precision(), 3);
+        CHECK_EQ(report.flags(), flags);
+    }
+    SUBCASE("trace") {
+        vm::profiler profile{4};
+        state.profile = &profile;
+        vm::run(state, code);
+
+        // the last four instructions, oldest first
+        auto trace = profile.trace();
+        REQUIRE_EQ(trace.size(), 4);
+        CHECK_EQ(trace[0].pc, 2);
+        CHECK_EQ(trace[1].pc, 3);
+        CHECK_EQ(trace[2].pc, 4);
+        CHECK_EQ(trace[3].pc, 6);
+        CHECK_EQ(trace[3].stack_size, 1);
+    }
+}
+
+
+TEST_CASE("vm_verifier") {
+    SUBCASE("verified") {
+        vm::vm_state state = vm::create_vm();
+        auto code = vm::assemble(state,
+                                 "LOAD_CONST 3\n"
+                                 "LOAD_CONST -1\n"
+                                 "ADD\n"
+                                 "DUP\n"
+                                 "JMPZ 6\n"
+                                 "JMP 1\n"
+                                 "EXIT\n");
+        vm::verification proof = vm::verify(state, code);
+        CHECK(proof.verified);
+        CHECK_EQ(proof.max_depth, 2);
+        CHECK_EQ(proof.depth, std::vector<size_t>{0, 1, 2, 1, 2, 1, 1});
+
+        state.verify = true;
+        const auto& [topstack, output_string] = vm::run(state, code);
+        CHECK_EQ(topstack, 0);
+    }
+    SUBCASE("unreachable") {
+        vm::vm_state state = vm::create_vm();
+        auto code = vm::assemble(state,
+                                 "LOAD_CONST 1\n"
+                                 "EXIT\n"
+                                 "POP\n");
+        vm::verification proof = vm::verify(state, code);
+        CHECK(proof.verified);
+        CHECK_EQ(proof.depth[2], vm::verification::unreachable);
+    }
+    SUBCASE("infeasible_path") {
+        // the POP is reachable for the analysis, but never runs
+        vm::vm_state state = vm::create_vm();
+        auto code = vm::assemble(state,
+                                 "LOAD_CONST 0\n"
+                                 "JMPZ 3\n"
+                                 "POP\n"
+                                 "LOAD_CONST 7\n"
+                                 "EXIT\n");
+        vm::verification proof = vm::verify(state, code);
+        CHECK_FALSE(proof.verified);
+        CHECK_FALSE(proof.reason.empty());
+
+        state.verify = true;
+        const auto& [topstack, output_string] = vm::run(state, code);
+        CHECK_EQ(topstack, 7);
+    }
+    SUBCASE("unverified") {
+        vm::vm_state state = vm::create_vm();
+        register_instruction(state, "NOP", [](vm::vm_state&, const vm::item_t) { return true; });
+
+        const char* programs[] = {
+            "POP\nEXIT\n",
+            "JMP 5\nEXIT\n",
+            "LOAD_CONST 1\n",
+            "NOP\nLOAD_CONST 1\nEXIT\n",
+            // different depths at the EXIT
+            "LOAD_CONST 0\nJMPZ 3\nLOAD_CONST 1\nLOAD_CONST 2\nEXIT\n",
+        };
+        for (const char* program : programs) {
+            vm::verification proof = vm::verify(state, vm::assemble(state, program));
+            CHECK_FALSE(proof.verified);
+            CHECK_FALSE(proof.reason.empty());
+        }
+
+        // with failures that are reached, checked runs fail as usual
+        state.verify = true;
+        REQUIRE_THROWS_AS(vm::run(state, vm::assemble(state, programs[0])), vm::vm_stackfail);
+        REQUIRE_THROWS_AS(vm::run(state, vm::assemble(state, programs[1])), vm::vm_segfault);
+    }
+    SUBCASE("stack_capacity") {
+        vm::vm_state state = vm::create_vm();
+        state.stack = vm::operand_stack{2};
+        auto code = vm::assemble(state, "LOAD_CONST 1\nDUP\nDUP\nEXIT\n");
+        CHECK_FALSE(vm::verify(state, code).verified);
+
+        state.verify = true;
+        REQUIRE_THROWS_AS(vm::run(state, code), vm::vm_stackfail);
+    }
+}
+
+
+TEST_CASE("vm_output") {
+    // writes 2000 characters, more than the buffer holds
+    const char* program =
+        "LOAD_CONST 2000\n"
+        "LOAD_CONST 120\n"
+        "WRITE_CHAR\n"
+        "POP\n"
+        "LOAD_CONST -1\n"
+        "ADD\n"
+        "DUP\n"
+        "JMPZ 9\n"
+        "JMP 1\n"
+        "EXIT\n";
+
+    SUBCASE("collected") {
+        vm::vm_state state = vm::create_vm();
+        state.output = vm::output_buffer{64};
+        const auto& [topstack, output_string] = vm::run(state, vm::assemble(state, program));
+        CHECK_EQ(output_string, std::string(2000, 'x'));
+    }
+    SUBCASE("sink") {
+        vm::vm_state state = vm::create_vm();
+        state.output = vm::output_buffer{64};
+        std::vector<std::string> chunks;
+        state.output.set_sink([&](std::string_view text) { chunks.emplace_back(text); });
+
+        const auto& [topstack, output_string] = vm::run(state, vm::assemble(state, program));
+        CHECK_EQ(output_string, "");
+
+        // streamed in chunks of at most the buffer size
+        std::string streamed;
+        for (const std::string& chunk : chunks) {
+            CHECK_LE(chunk.size(), 64);
+            streamed += chunk;
+        }
+        CHECK_GT(chunks.size(), 1);
+        CHECK_EQ(streamed, std::string(2000, 'x'));
+    }
+    SUBCASE("numbers") {
+        vm::output_buffer output{4};
+        output.write_number(-1234567890123);
+        output.write_char(' ');
+        output.write_number(0);
+        CHECK_EQ(output.take(), "-1234567890123 0");
+        CHECK_EQ(output.take(), "");
+    }
+    SUBCASE("ring") {
+        vm::vm_state state = vm::create_vm();
+        vm::output_ring ring{10};
+        state.output.set_sink(ring.sink());
+        vm::run(state, vm::assemble(state,
+                                    "LOAD_CONST 123456789\n"
+                                    "WRITE\n"
+                                    "LOAD_CONST 987654321\n"
+                                    "WRITE\n"
+                                    "EXIT\n"));
+        CHECK_EQ(ring.total(), 18);
+        CHECK_EQ(ring.contents(), "9987654321");
+    }
+}
+
+
+TEST_CASE("vm_registers") {
+    const char* programs[] = {
+        "LOAD_CONST 3521\nLOAD_CONST 5652\nADD\nEXIT\n",
+        "LOAD_CONST 346375\nLOAD_CONST 815\nDIV\nDUP\nWRITE\nEXIT\n",
+        "LOAD_CONST 701\nLOAD_CONST 701\nEQ\nJMPZ 6\nLOAD_CONST 8001\nJMP 7\nLOAD_CONST 6231\nEXIT\n",
+        "LOAD_CONST 5\nWRITE\nLOAD_CONST 10\nWRITE_CHAR\nPOP\nLOAD_CONST -1\nADD\nDUP\nJMPZ 10\nJMP 1\nEXIT\n",
+        "LOAD_CONST 1\nLOAD_CONST 2\nNEQ\nLOAD_CONST 4\nPOP\nEXIT\n",
+    };
+
+    SUBCASE("same_as_table") {
+        vm::vm_state state = vm::create_vm();
+        for (const char* program : programs) {
+            auto code = vm::assemble(state, program);
+            vm::register_program translated{state, code};
+            CHECK(translated.translated());
+
+            state.dispatch = vm::dispatch_mode::table;
+            const auto expected = vm::run(state, code);
+            CHECK_EQ(translated.run(state), expected);
+            state.dispatch = vm::dispatch_mode::registers;
+            CHECK_EQ(vm::run(state, code), expected);
+        }
+    }
+    SUBCASE("fewer_instructions") {
+        vm::vm_state state = vm::create_vm();
+        auto code = vm::assemble(state, programs[0]);
+        vm::register_program translated{state, code};
+        // the constants become immediates of one addition
+        CHECK_LT(translated.ops().size(), code.size());
+    }
+    SUBCASE("not_translated") {
+        vm::vm_state state = vm::create_vm();
+        register_instruction(state, "NOP", [](vm::vm_state&, const vm::item_t) { return true; });
+        auto code = vm::assemble(state, "NOP\nLOAD_CONST 4\nEXIT\n");
+        CHECK_FALSE(vm::register_program(state, code).translated());
+
+        // such programs still run, with the threaded engine
+        state.dispatch = vm::dispatch_mode::registers;
+        CHECK_EQ(std::get<0>(vm::run(state, code)), 4);
+    }
+    SUBCASE("errors") {
+        vm::vm_state state = vm::create_vm();
+        state.dispatch = vm::dispatch_mode::registers;
+        REQUIRE_THROWS_AS(vm::run(state, vm::assemble(state, "LOAD_CONST 1\nLOAD_CONST 0\nDIV\nEXIT\n")),
+                          vm::div_by_zero);
+        REQUIRE_THROWS_AS(vm::run(state, vm::assemble(state, "POP\nEXIT\n")), vm::vm_stackfail);
+        REQUIRE_THROWS_AS(vm::run(state, vm::assemble(state, "JMP 7\nEXIT\n")), vm::vm_segfault);
+        // the failing path is infeasible, so the program runs
+        CHECK_EQ(std::get<0>(vm::run(state, vm::assemble(state, "LOAD_CONST 0\nJMPZ 3\nPOP\nLOAD_CONST 7\nEXIT\n"))), 7);
+    }
+}
+
+
+TEST_CASE("vm_execution") {
+    // counts 3 down to 1, writing each number
+    const char* countdown =
+        "LOAD_CONST 3\n"
+        "DUP\n"
+        "WRITE\n"
+        "LOAD_CONST -1\n"
+        "ADD\n"
+        "DUP\n"
+        "JMPZ 8\n"
+        "JMP 1\n"
+        "EXIT\n";
+
+    SUBCASE("budget") {
+        vm::vm_state state = vm::create_vm();
+        auto code = vm::assemble(state, countdown);
+        vm::execution running{state, code};
+
+        CHECK_FALSE(running.resume(5));
+        CHECK_EQ(running.executed(), 5);
+        CHECK_FALSE(running.finished());
+
+        while (not running.resume(5)) {
+        }
+        CHECK(running.finished());
+        // 1 + 7 per number, with the last JMPZ taken instead of JMP
+        CHECK_EQ(running.executed(), 1 + 3 * 7);
+
+        const auto& [topstack, output_string] = running.result();
+        CHECK_EQ(topstack, 0);
+        CHECK_EQ(output_string, "321");
+    }
+    SUBCASE("stop_on_write") {
+        vm::vm_state state = vm::create_vm();
+        auto code = vm::assemble(state, "LOAD_CONST 1\nWRITE\nEXIT\n");
+        vm::execution running{state, code};
+
+        CHECK_FALSE(running.resume(1000, true));
+        CHECK_EQ(running.executed(), 2);
+        CHECK(running.resume(1000, true));
+        CHECK_EQ(running.executed(), 3);
+    }
+    SUBCASE("error") {
+        vm::vm_state state = vm::create_vm();
+        auto code = vm::assemble(state, "LOAD_CONST 1\nLOAD_CONST 0\nDIV\nEXIT\n");
+        vm::execution running{state, code};
+        REQUIRE_THROWS_AS(running.resume(100), vm::div_by_zero);
+        CHECK(running.finished());
+        REQUIRE_THROWS_AS(running.result(), vm::div_by_zero);
+    }
+    SUBCASE("write_stream") {
+        vm::vm_state state = vm::create_vm();
+        std::vector<std::string> slices;
+        // the code may be a temporary
+        for (const std::string& slice : vm::write_stream(state, vm::assemble(state, countdown))) {
+            slices.push_back(slice);
+        }
+        CHECK_EQ(slices, std::vector<std::string>{"3", "2", "1"});
+
+        auto failing = vm::write_stream(state, vm::assemble(state, "LOAD_CONST 5\nWRITE\nPOP\nPOP\nEXIT\n"));
+        auto slice = failing.begin();
+        CHECK_EQ(*slice, "5");
+        REQUIRE_THROWS_AS(++slice, vm::vm_stackfail);
+    }
+    SUBCASE("run_interleaved") {
+        vm::vm_state state = vm::create_vm();
+        std::vector<vm::code_t> programs{
+            vm::assemble(state, countdown),
+            vm::assemble(state, "JMP 0\n"),
+            vm::assemble(state, "LOAD_CONST 1\nLOAD_CONST 0\nDIV\nEXIT\n"),
+            vm::assemble(state, "LOAD_CONST 42\nEXIT\n"),
+        };
+        auto results = vm::run_interleaved(state, programs, 3, 1000, 2);
+        REQUIRE_EQ(results.size(), programs.size());
+
+        CHECK_EQ(results[0].get(), std::tuple<vm::item_t, std::string>{0, "321"});
+        // the endless loop is stopped at the limit
+        REQUIRE_THROWS_AS(results[1].get(), vm::instruction_limit_exceeded);
+        REQUIRE_THROWS_AS(results[2].get(), vm::div_by_zero);
+        CHECK_EQ(std::get<0>(results[3].get()), 42);
+    }
+}
+
+
+namespace {
+
+bool increment(vm::vm_state& vmstate, const vm::item_t arg) {
+    vmstate.stack.top() += arg;
+    return true;
+}
+
+bool jump_if_negative(vm::vm_state& vmstate, const vm::item_t arg) {
+    if (vmstate.stack.take() < 0) {
+        vmstate.pc = static_cast<size_t>(arg);
+    }
+    return true;
+}
+
+bool halt(vm::vm_state&, const vm::item_t) {
+    return false;
+}
+
+using test_set = vm::instruction_set<vm::instruction<"INC", increment>,
+                                     vm::instruction<"JMPNEG", jump_if_negative>,
+                                     vm::instruction<"HALT", halt>>;
+
+} // namespace
+
+
+TEST_CASE("vm_instruction_set") {
+    // counts -3 up to 0, writing each number
+    const char* count_up =
+        "LOAD_CONST -3\n"
+        "DUP\n"
+        "WRITE\n"
+        "INC 1\n"
+        "DUP\n"
+        "JMPNEG 1\n"
+        "HALT\n"
+        "LOAD_CONST 9\n"
+        "EXIT\n";
+
+    SUBCASE("same_as_table") {
+        vm::vm_state state = vm::create_vm();
+        test_set::register_to(state);
+        auto code = vm::assemble(state, count_up);
+
+        state.dispatch = vm::dispatch_mode::table;
+        const auto expected = vm::run(state, code);
+        CHECK_EQ(expected, std::tuple<vm::item_t, std::string>{0, "-3-2-1"});
+        CHECK_EQ(test_set::run(state, code), expected);
+        CHECK_EQ(test_set::run(state, test_set::translate(state, code)), expected);
+        // halted at the HALT
+        CHECK_EQ(state.pc, 6);
+    }
+    SUBCASE("runtime_instructions") {
+        vm::vm_state state = vm::create_vm();
+        test_set::register_to(state);
+        register_instruction(state, "TWICE", [](vm::vm_state& vmstate, const vm::item_t) {
+            vmstate.stack.top() *= 2;
+            return true;
+        });
+        auto code = vm::assemble(state, "LOAD_CONST 20\nINC 1\nTWICE\nEXIT\n");
+        CHECK_EQ(std::get<0>(test_set::run(state, code)), 42);
+    }
+    SUBCASE("typed_registration") {
+        vm::vm_state state = vm::create_vm();
+        vm::register_instruction<increment>(state, "INC");
+        auto code = vm::assemble(state, "LOAD_CONST 40\nINC 2\nEXIT\n");
+        CHECK_EQ(std::get<0>(vm::run(state, code)), 42);
+    }
+    SUBCASE("builtins_only") {
+        using builtins = vm::instruction_set<>;
+        vm::vm_state state = vm::create_vm();
+        builtins::register_to(state);
+        register_instruction(state, "INC", [](vm::vm_state& vmstate, const vm::item_t arg) {
+            vmstate.stack.top() += arg;
+            return true;
+        });
+        auto code = vm::assemble(state, "LOAD_CONST 40\nDUP\nWRITE\nINC 2\nEXIT\n");
+
+        state.dispatch = vm::dispatch_mode::table;
+        const auto expected = vm::run(state, code);
+        CHECK_EQ(expected, std::tuple<vm::item_t, std::string>{42, "40"});
+        CHECK_EQ(builtins::run(state, code), expected);
+        CHECK_EQ(builtins::run(state, builtins::translate(state, code)), expected);
+    }
+    SUBCASE("errors") {
+        vm::vm_state state = vm::create_vm();
+        test_set::register_to(state);
+        REQUIRE_THROWS_AS(test_set::run(state, vm::assemble(state, "LOAD_CONST 1\nJMPNEG 1\nEXIT\n")),
+                          vm::vm_stackfail);
+        REQUIRE_THROWS_AS(test_set::run(state, vm::assemble(state, "LOAD_CONST -1\nJMPNEG 9\n")),
+                          vm::vm_segfault);
+        REQUIRE_THROWS_AS(test_set::run(state, vm::assemble(state, "LOAD_CONST 1\nLOAD_CONST 0\nDIV\nEXIT\n")),
+                          vm::div_by_zero);
+    }
+}
+
+
+TEST_CASE("util_split") {
+    // long enough for several 64 byte blocks
+    std::string text;
+    std::vector<std::string> parts;
+    for (int i = 0; i < 40; i++) {
+        parts.push_back(std::string(static_cast<size_t>(i % 7), static_cast<char>('a' + i % 26)));
+        text += parts.back() + ",";
+    }
+
+    SUBCASE("split") {
+        CHECK_EQ(vm::util::split(text, ','), parts);
+
+        std::vector<std::string_view> views = vm::util::split_views(text, ',');
+        CHECK(std::equal(views.begin(), views.end(), parts.begin(), parts.end()));
+    }
+    SUBCASE("split_view") {
+        std::vector<std::string> found;
+        for (std::string_view part : vm::util::split_view{text, ','}) {
+            found.emplace_back(part);
+        }
+        CHECK_EQ(found, parts);
+    }
+    SUBCASE("like_getline") {
+        // empty parts count, except after the last delimiter
+        CHECK_EQ(vm::util::split("a,,b,", ','), std::vector<std::string>{"a", "", "b"});
+        CHECK_EQ(vm::util::split(",a", ','), std::vector<std::string>{"", "a"});
+        CHECK(vm::util::split("", ',').empty());
+        CHECK_EQ(vm::util::split(",", ','), std::vector<std::string>{""});
+    }
+    SUBCASE("strip") {
+        std::string padded = std::string(70, ' ') + "\t text \n" + std::string(70, '\n');
+        CHECK_EQ(vm::util::strip(padded), "text");
+        CHECK_EQ(vm::util::strip_view(padded), "text");
+        CHECK_EQ(vm::util::strip_view(" \r\v\f "), "");
+        CHECK_EQ(vm::util::strip_view("a b"), "a b");
+
+        // the view points into the input
+        std::string_view stripped = vm::util::strip_view(padded);
+        CHECK_EQ(stripped.data(), padded.data() + 72);
+    }
+}
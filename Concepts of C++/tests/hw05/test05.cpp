@@ -7,6 +7,9 @@
  * safety of others, please refrain from touching ѤުϖÖƔАӇȥ̒ΔЙ җؕնÛ ߚɸӱҟˍ҇ĊɠûݱȡνȬ
  */
 
+#include <cctype>
+#include <string>
+#include <string_view>
 #include <vector>
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include <doctest/doctest.h>
@@ -696,3 +699,143 @@ TEST_CASE("Transition from Invalid state") {
     }
   }
 }
+
+std::vector<sql::Token> tokenize(std::string_view query) {
+  std::vector<sql::Token> tokens;
+  for (const sql::Token &token : sql::Lexer{query}) {
+    tokens.push_back(token);
+  }
+  return tokens;
+}
+
+TEST_CASE("Lexing SQL queries") {
+  GIVEN("the query 'select a_1, B FROM t;'") {
+    std::string query = "select a_1, B FROM t;";
+    auto tokens = tokenize(query);
+
+    THEN("Keywords, identifiers and punctuation become tokens") {
+      REQUIRE_EQ(tokens.size(), 7);
+      CHECK_UNARY(is_token_of_type<sql::token::Select>(tokens[0]));
+      CHECK_UNARY(is_token_of_type<sql::token::Identifier>(tokens[1]));
+      CHECK_UNARY(is_token_of_type<sql::token::Comma>(tokens[2]));
+      CHECK_UNARY(is_token_of_type<sql::token::Identifier>(tokens[3]));
+      CHECK_UNARY(is_token_of_type<sql::token::From>(tokens[4]));
+      CHECK_UNARY(is_token_of_type<sql::token::Identifier>(tokens[5]));
+      CHECK_UNARY(is_token_of_type<sql::token::Semicolon>(tokens[6]));
+    }
+
+    THEN("Identifiers are views into the query") {
+      auto name = std::get<sql::token::Identifier>(tokens[1].value()).name;
+      CHECK_EQ(name, "a_1");
+      CHECK_EQ(name.data(), query.data() + 7);
+    }
+  }
+
+  GIVEN("keywords in mixed case") {
+    auto tokens = tokenize("SeLeCt * fRoM x");
+
+    THEN("They are recognized") {
+      REQUIRE_EQ(tokens.size(), 4);
+      CHECK_UNARY(is_token_of_type<sql::token::Select>(tokens[0]));
+      CHECK_UNARY(is_token_of_type<sql::token::Asterisks>(tokens[1]));
+      CHECK_UNARY(is_token_of_type<sql::token::From>(tokens[2]));
+    }
+  }
+
+  GIVEN("words that only start like keywords") {
+    auto tokens = tokenize("selects from_ fro");
+
+    THEN("They are identifiers") {
+      REQUIRE_EQ(tokens.size(), 3);
+      for (const auto &token : tokens) {
+        CHECK_UNARY(is_token_of_type<sql::token::Identifier>(token));
+      }
+    }
+  }
+
+  GIVEN("numbers and characters outside the grammar") {
+    auto tokens = tokenize("42abc - ?");
+
+    THEN("They are unknown tokens") {
+      REQUIRE_EQ(tokens.size(), 3);
+      CHECK_EQ(std::get<sql::token::Unknown>(tokens[0].value()).text, "42abc");
+      CHECK_EQ(std::get<sql::token::Unknown>(tokens[1].value()).text, "-");
+      CHECK_EQ(std::get<sql::token::Unknown>(tokens[2].value()).text, "?");
+    }
+  }
+
+  GIVEN("an empty or blank query") {
+    THEN("There are no tokens") {
+      CHECK_UNARY(tokenize("").empty());
+      CHECK_UNARY(tokenize(" \t\r\n\v\f").empty());
+    }
+  }
+
+  GIVEN("a query longer than a block of 64 characters") {
+    std::string name(100, 'n');
+    std::string query = "SELECT" + std::string(70, ' ') + name + "\n\n" + name + ";";
+    sql::Lexer lexer{query};
+
+    THEN("Runs across blocks are single tokens") {
+      CHECK_UNARY(is_token_of_type<sql::token::Select>(*lexer.next()));
+      CHECK_EQ(std::get<sql::token::Identifier>(lexer.next()->value()).name, name);
+      CHECK_EQ(lexer.position(), 176);
+      CHECK_EQ(std::get<sql::token::Identifier>(lexer.next()->value()).name, name);
+      CHECK_UNARY(is_token_of_type<sql::token::Semicolon>(*lexer.next()));
+      CHECK_UNARY_FALSE(lexer.next().has_value());
+      CHECK_EQ(lexer.position(), query.size());
+    }
+  }
+}
+
+TEST_CASE("Classifying characters") {
+  GIVEN("a full block and a partial block") {
+    std::string text = "a_Z9 \t,*;\n";
+    while (text.size() < 64) {
+      text += text;
+    }
+
+    THEN("The masks agree with the characters") {
+      for (size_t length : {size_t{64}, size_t{10}, size_t{1}}) {
+        auto classes = sql::detail::classify(text.data(), length);
+        for (size_t i = 0; i < 64; i++) {
+          char c = text[i];
+          bool space = i < length && (c == ' ' || c == '\t' || c == '\n');
+          bool word = i < length && (std::isalnum(static_cast<unsigned char>(c)) || c == '_');
+          CHECK_EQ((classes.space >> i & 1) == 1, space);
+          CHECK_EQ((classes.word >> i & 1) == 1, word);
+        }
+      }
+    }
+  }
+}
+
+TEST_CASE("Validating SQL query text") {
+  GIVEN("valid queries") {
+    THEN("They are accepted") {
+      CHECK_UNARY(sql::is_valid_sql_query("SELECT * FROM MYTABLE;"));
+      CHECK_UNARY(sql::is_valid_sql_query("select a, b, c from t ;"));
+      CHECK_UNARY(sql::is_valid_sql_query("\n  SELECT\tcolumn_1\nFROM\ttable_2;\n"));
+    }
+  }
+
+  GIVEN("invalid queries") {
+    THEN("They are rejected") {
+      CHECK_UNARY_FALSE(sql::is_valid_sql_query(""));
+      CHECK_UNARY_FALSE(sql::is_valid_sql_query("SELECT * FROM MYTABLE"));
+      CHECK_UNARY_FALSE(sql::is_valid_sql_query("SELECT a, FROM t;"));
+      CHECK_UNARY_FALSE(sql::is_valid_sql_query("SELECT 1 FROM t;"));
+      CHECK_UNARY_FALSE(sql::is_valid_sql_query("SELECT a FROM t; trailing"));
+      CHECK_UNARY_FALSE(sql::is_valid_sql_query("SELECT a FROM t-1;"));
+    }
+  }
+
+  GIVEN("queries of all kinds") {
+    THEN("Streaming the text agrees with validating its tokens") {
+      for (std::string_view query : {"SELECT * FROM t;", "SELECT a,b FROM t;", "SELECT FROM t;",
+                                     "select * , a from t;", "SELECT a FROM t;;", "FROM t SELECT a;"}) {
+        CHECK_EQ(sql::is_valid_sql_query(query), sql::is_valid_sql_query(tokenize(query)));
+      }
+    }
+  }
+}